@@ -1,10 +1,8 @@
-echo "generating"
-python3 generate_workloads.py -d SOSD/data/wiki_ts_200M_uint64 -t unit64 -s 200000000 -o workloads -a 1.1
-echo "generating"
-python3 generate_workloads.py -d SOSD/data/wiki_ts_200M_uint64 -t unit64 -s 200000000 -o workloads -a 1.3
-echo "generating"
-python3 generate_workloads.py -d SOSD/data/wiki_ts_200M_uint64 -t unit64 -s 200000000 -o workloads -a 1.5
-echo "generating"
-python3 generate_workloads.py -d SOSD/data/wiki_ts_200M_uint64 -t unit64 -s 200000000 -o workloads -a 1.7
-echo "generating"
-python3 generate_workloads.py -d SOSD/data/wiki_ts_200M_uint64 -t unit64 -s 200000000 -o workloads -a 1.9
+# Workloads and their weights with the native generator (build it first with
+# build.sh); generate_workloads.py is the original Python version.
+mkdir -p workloads weights
+for alpha in 1.1 1.3 1.5 1.7 1.9
+do
+    echo "generating"
+    ./build/generate_workload -d SOSD/data/wiki_ts_200M_uint64 -s 200000000 -o workloads -w weights -a $alpha --threads $(nproc)
+done
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "look_up_table_learned_index.h"
+#include "sosd_file.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
+
+// Replay the workload on a look-up table learned index in adaptive mode (no
+// weights file; the hot-key table follows the lookups) and print one line per
+// workload segment: the segment number, its throughput (M lookups/s), the
+// sampled hit ratio of the hot-key table in the segment, its number of table
+// refreshes and their mean and maximum cost in microseconds. The refreshes
+// run on a background thread while the main thread looks keys up.
+int main(int argc, char** argv) {
+  if (argc < 7 || argc > 10) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  int num_second_level_models = atoi(argv[1]);
+  LookUpTableLearnedIndex<K, V, STORAGE>::AdaptiveOptions options;
+  options.table_size = atoi(argv[2]);
+  std::string keys_file_path = std::string(argv[3]);
+  std::string test_workload_file_path = std::string(argv[4]);
+  int64_t num_records = atoll(argv[5]);
+  int64_t test_workload_size = atoll(argv[6]);
+  // Optional: the sampling period, the samples between refreshes and the
+  // number of workload segments to report.
+  if (argc > 7) {
+    options.sample_period = atoi(argv[7]);
+  }
+  if (argc > 8) {
+    options.refresh_samples = atoll(argv[8]);
+  }
+  int num_segments = argc > 9 ? atoi(argv[9]) : 10;
+  if (options.sample_period < 1 || options.refresh_samples < 1 ||
+      num_segments < 1) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen_payload(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
+  }
+
+  // Map the workload file
+  MappedFile workload_file(test_workload_file_path, AccessAdvice::kSequential);
+  Span<K> test_workload = raw_array<K>(workload_file, test_workload_size);
+  if (static_cast<int64_t>(test_workload.size()) != test_workload_size) {
+    std::cout << "Workload file holds fewer than " << test_workload_size
+              << " keys" << std::endl;
+    exit(1);
+  }
+
+  LookUpTableLearnedIndex<K, V, STORAGE> index(keys, std::move(values));
+  index.build_adaptive(num_second_level_models, options);
+  // From here on the keys are only probed by lookups.
+  keys_file.advise(AccessAdvice::kRandom);
+
+  std::atomic<bool> replaying(true);
+  std::thread refresher([&index, &replaying] {
+    while (replaying.load(std::memory_order_relaxed)) {
+      if (!index.maybe_refresh()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }
+  });
+
+  auto before = index.get_adaptive_stats();
+  for (int segment = 0; segment < num_segments; segment++) {
+    size_t begin = test_workload.size() * segment / num_segments;
+    size_t end = test_workload.size() * (segment + 1) / num_segments;
+    auto segment_start_time = std::chrono::high_resolution_clock::now();
+    for (size_t i = begin; i < end; i++) {
+      if (!index.get_value(test_workload[i])) {
+        exit(1);
+      }
+    }
+    double segment_time =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - segment_start_time)
+            .count();
+
+    auto after = index.get_adaptive_stats();
+    int64_t sampled_lookups = after.sampled_lookups - before.sampled_lookups;
+    int64_t refreshes = after.refreshes - before.refreshes;
+    double hit_ratio =
+        sampled_lookups > 0
+            ? static_cast<double>(after.sampled_hits - before.sampled_hits) /
+                  sampled_lookups
+            : 0;
+    double mean_refresh_us =
+        refreshes > 0
+            ? (after.total_refresh_ns - before.total_refresh_ns) / refreshes /
+                  1e3
+            : 0;
+    std::cout << segment << "\t"
+              << (segment_time > 0 ? (end - begin) / segment_time * 1e3 : 0)
+              << "\t" << hit_ratio << "\t" << refreshes << "\t"
+              << mean_refresh_us << "\t" << after.max_refresh_ns / 1e3
+              << std::endl;
+    before = after;
+  }
+  replaying = false;
+  refresher.join();
+}
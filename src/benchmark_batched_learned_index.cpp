@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+
+#include "latency_recorder.h"
+#include "learned_index.h"
+#include "sosd_file.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
+
+// Number of keys handed to get_values per call.
+#define BATCH_SIZE 1024
+
+int main(int argc, char** argv) {
+  if (argc != 6 && argc != 7) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  int num_second_level_models = atoi(argv[1]);
+  std::string keys_file_path = std::string(argv[2]);
+  std::string test_workload_file_path = std::string(argv[3]);
+  int64_t num_records = atoll(argv[4]);
+  int64_t test_workload_size = atoll(argv[5]);
+  // Optional: number of threads used to build the index.
+  int num_build_threads = argc == 7 ? atoi(argv[6]) : 1;
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Map the workload file
+  MappedFile workload_file(test_workload_file_path, AccessAdvice::kSequential);
+  Span<K> test_workload = raw_array<K>(workload_file, test_workload_size);
+  if (static_cast<int64_t>(test_workload.size()) != test_workload_size) {
+    std::cout << "Workload file holds fewer than " << test_workload_size
+              << " keys" << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen_payload(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
+  }
+
+  LearnedIndex<K, V, STORAGE> index(keys, std::move(values));
+  auto build_start_time = std::chrono::high_resolution_clock::now();
+  index.build(num_second_level_models, num_build_threads);
+  double build_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - build_start_time)
+          .count();
+  // From here on the keys are only probed by lookups.
+  keys_file.advise(AccessAdvice::kRandom);
+
+  // Scalar path: one get_value call per key, with sampled per-lookup
+  // latencies (see latency_recorder.h).
+  LatencyRecorder latency;
+  auto scalar_start_time = std::chrono::high_resolution_clock::now();
+  V scalar_sum = 0;
+  for (K key: test_workload) {
+    const V* payload = latency.measure([&]() { return index.get_value(key); });
+    if (!payload) {
+      exit(1);
+    }
+    scalar_sum += *payload;
+  }
+  double scalar_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - scalar_start_time)
+          .count();
+
+  // Batched path: get_values over consecutive slices of the workload.
+  std::vector<V*> payloads(BATCH_SIZE);
+  index.reset_last_mile_search_count();
+  auto batched_start_time = std::chrono::high_resolution_clock::now();
+  V batched_sum = 0;
+  for (int64_t first = 0; first < test_workload_size; first += BATCH_SIZE) {
+    int64_t batch_size = std::min<int64_t>(BATCH_SIZE, test_workload_size - first);
+    index.get_values(test_workload.data() + first, batch_size, payloads.data());
+    for (int64_t i = 0; i < batch_size; i++) {
+      if (!payloads[i]) {
+        exit(1);
+      }
+      batched_sum += *payloads[i];
+    }
+  }
+  double batched_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - batched_start_time)
+          .count();
+  int64_t num_last_mile_search = index.get_last_mile_search_count();
+
+  if (scalar_sum != batched_sum) {
+    std::cout << "Batched lookups returned different payloads." << std::endl;
+    exit(1);
+  }
+
+  // output model size, build time, scalar and batched workload time (seconds),
+  // scalar and batched throughput (million lookups per second), and the
+  // number of last-mile searches of the batched run, then the scalar lookup
+  // latency percentiles (nanoseconds)
+  int model_size = sizeof(index);  //bytes
+  std::cout << model_size << "\t" << build_time / 1e9 << "\t"
+            << scalar_time / 1e9 << "\t" << batched_time / 1e9 << "\t"
+            << test_workload_size / (scalar_time / 1e3) << "\t"
+            << test_workload_size / (batched_time / 1e3) << "\t"
+            << num_last_mile_search;
+  write_latency_columns(std::cout, latency);
+  std::cout << std::endl;
+}
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+
+#include "compiled_rmi.h"
+#include "latency_recorder.h"
+#include "sosd_file.h"
+// Generated by export_learned_index at build time (see CMakeLists.txt).
+#include "compiled_rmi_params.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Same workload as benchmark_learned_index, but over the RMI that was
+// exported at build time, so there is no number of models argument and no
+// build step.
+int main(int argc, char** argv) {
+  if (argc != 5) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  std::string keys_file_path = std::string(argv[1]);
+  std::string test_workload_file_path = std::string(argv[2]);
+  int64_t num_records = atoll(argv[3]);
+  int64_t test_workload_size = atoll(argv[4]);
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Map the workload file
+  MappedFile workload_file(test_workload_file_path, AccessAdvice::kSequential);
+  Span<K> test_workload = raw_array<K>(workload_file, test_workload_size);
+  if (static_cast<int64_t>(test_workload.size()) != test_workload_size) {
+    std::cout << "Workload file holds fewer than " << test_workload_size
+              << " keys" << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen_payload(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
+  }
+
+  CompiledLearnedIndex<CompiledRmiParams, K, V> index(keys, std::move(values));
+  if (!index.matches_data()) {
+    std::cout << "The compiled RMI was exported for other keys" << std::endl;
+    exit(1);
+  }
+  keys_file.advise(AccessAdvice::kRandom);
+
+  index.reset_last_mile_search_count();
+  // Sampled per-lookup latencies; see latency_recorder.h.
+  LatencyRecorder latency;
+  auto workload_start_time = std::chrono::high_resolution_clock::now();
+  for (K key: test_workload) {
+    const V* payload = latency.measure([&]() { return index.get_value(key); });
+    if (!payload) {
+      exit(1);
+    }
+  }
+  double workload_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - workload_start_time)
+          .count();
+  int64_t num_last_mile_search = index.get_last_mile_search_count();
+
+  // output model size (the index plus its static leaf table), build time
+  // (none), workload time, the number of last-mile searches and the lookup
+  // latency percentiles (nanoseconds)
+  int64_t model_size =
+      sizeof(index) + sizeof(CompiledRmiParams::kLeaves);  // bytes
+  std::cout << model_size << "\t" << 0 << "\t" << workload_time / 1e9 << "\t"
+            << num_last_mile_search;
+  write_latency_columns(std::cout, latency);
+  std::cout << std::endl;
+}
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hot_key_table.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Compare the hot-key table of LookUpTableLearnedIndex with the
+// std::unordered_map (key -> record position, then a read of the record) it
+// replaced, at the table sizes of the look-up table experiments.
+// Lookups hit a uniformly chosen hot key with probability `hit_fraction` and
+// otherwise probe a random key that is not in the table.
+// Print one line per table size: the table size, the nanoseconds per lookup of
+// the unordered_map and of the hot-key table, the speedup and the size of the
+// hot-key table in KiB.
+
+template <class Lookup>
+double time_lookups(const std::vector<K>& lookups, Lookup lookup,
+                    V* checksum) {
+  auto start_time = std::chrono::high_resolution_clock::now();
+  V sum = 0;
+  for (K key : lookups) {
+    sum += lookup(key);
+  }
+  auto end_time = std::chrono::high_resolution_clock::now();
+  *checksum = sum;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(end_time -
+                                                               start_time)
+             .count() /
+         static_cast<double>(lookups.size());
+}
+
+int main(int argc, char** argv) {
+  if (argc > 4) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+  int64_t num_lookups = argc > 1 ? atoll(argv[1]) : 10000000;
+  double hit_fraction = argc > 2 ? atof(argv[2]) : 0.5;
+  int64_t num_records = argc > 3 ? atoll(argv[3]) : 10000000;
+  const int table_sizes[] = {1000, 10000};
+  if (num_lookups <= 0 || hit_fraction < 0 || hit_fraction > 1 ||
+      num_records < table_sizes[1]) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  // Records with distinct random keys; the hot keys are random records.
+  std::mt19937_64 gen(42);
+  std::vector<std::pair<K, V>> records(num_records);
+  for (int64_t i = 0; i < num_records; i++) {
+    records[i] = {gen() | 1, static_cast<V>(gen())};
+  }
+
+  for (int table_size : table_sizes) {
+    std::uniform_int_distribution<int64_t> record_dist(0, num_records - 1);
+    std::unordered_map<K, int64_t> map;
+    HotKeyTable<K, V> table;
+    table.clear(table_size);
+    while (static_cast<int>(map.size()) < table_size) {
+      int64_t pos = record_dist(gen);
+      if (map.emplace(records[pos].first, pos).second) {
+        table.insert(records[pos].first, records[pos].second, pos);
+      }
+    }
+    std::vector<K> hot_keys;
+    for (const auto& entry : map) {
+      hot_keys.push_back(entry.first);
+    }
+
+    // Misses have an even key, which no record has.
+    std::bernoulli_distribution is_hit(hit_fraction);
+    std::uniform_int_distribution<size_t> hot_dist(0, hot_keys.size() - 1);
+    std::vector<K> lookups(num_lookups);
+    for (auto& key : lookups) {
+      key = is_hit(gen) ? hot_keys[hot_dist(gen)] : gen() & ~K(1);
+    }
+
+    V map_checksum;
+    double map_ns = time_lookups(
+        lookups,
+        [&](K key) {
+          if (map.find(key) != map.end()) {
+            return records[map.at(key)].second;
+          }
+          return V(0);
+        },
+        &map_checksum);
+    V table_checksum;
+    double table_ns = time_lookups(
+        lookups,
+        [&](K key) {
+          const V* value = table.find(key);
+          return value != nullptr ? *value : V(0);
+        },
+        &table_checksum);
+    if (map_checksum != table_checksum) {
+      std::cout << "Hot-key table and unordered_map disagree" << std::endl;
+      exit(1);
+    }
+
+    std::cout << table_size << "\t" << map_ns << "\t" << table_ns << "\t"
+              << map_ns / table_ns << "\t" << table.table_bytes() / 1024.0
+              << std::endl;
+  }
+}
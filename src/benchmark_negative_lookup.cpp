@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "learned_index.h"
+#include "sosd_file.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
+
+// Share of the keys left out of the index to serve as absent keys.
+#define HELD_OUT_FRACTION 0.1
+
+// Lookups of absent keys on LearnedIndex. As in SOSD, a random tenth of the
+// keys is held out of the index and the absent lookups are drawn from it, so
+// they follow the key distribution. Each lookup is of a held-out key with
+// probability `negative_ratio`, and of an indexed key otherwise. For every
+// filter size in bits per key the same lookups are replayed, and a line
+// holds the bits per key, the filter and fence sizes in KiB, the nanoseconds
+// per lookup, the shares of the absent lookups rejected by the fences and by
+// the filter, and the filter's false-positive rate.
+int main(int argc, char** argv) {
+  if (argc < 5 || argc > 8) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  int num_second_level_models = atoi(argv[1]);
+  std::string keys_file_path = std::string(argv[2]);
+  int64_t num_records = atoll(argv[3]);
+  int64_t num_lookups = atoll(argv[4]);
+  // Optional: share of absent lookups, comma-separated filter sizes in bits
+  // per key (0 keeps only the fences) and number of threads used to build the
+  // index.
+  double negative_ratio = argc > 5 ? atof(argv[5]) : 0.33;
+  std::vector<double> filter_bits_per_key;
+  std::stringstream bits(argc > 6 ? argv[6] : "0,4,8,12");
+  for (std::string bits_per_key; std::getline(bits, bits_per_key, ',');) {
+    filter_bits_per_key.push_back(atof(bits_per_key.c_str()));
+  }
+  int num_build_threads = argc > 7 ? atoi(argv[7]) : 1;
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Split the keys into indexed and held-out keys, and generate random
+  // payloads for the indexed ones.
+  std::mt19937_64 gen(std::random_device{}());
+  std::bernoulli_distribution held_out(HELD_OUT_FRACTION);
+  std::vector<K> indexed_keys;
+  std::vector<K> absent_keys;
+  std::vector<V> values;
+  for (int64_t i = 0; i < num_records; i++) {
+    if (i > 0 && keys[i] == keys[i - 1]) {
+      continue;
+    }
+    if (held_out(gen)) {
+      absent_keys.push_back(keys[i]);
+    } else {
+      indexed_keys.push_back(keys[i]);
+      values.push_back(static_cast<V>(gen()));
+    }
+  }
+  if (indexed_keys.empty() || absent_keys.empty()) {
+    std::cout << "Too few keys to hold some out" << std::endl;
+    exit(1);
+  }
+
+  std::vector<K> lookups(num_lookups);
+  std::vector<bool> expected_found(num_lookups);
+  std::bernoulli_distribution is_negative(negative_ratio);
+  std::uniform_int_distribution<size_t> indexed_dist(0, indexed_keys.size() - 1);
+  std::uniform_int_distribution<size_t> absent_dist(0, absent_keys.size() - 1);
+  int64_t num_negative_lookups = 0;
+  for (int64_t i = 0; i < num_lookups; i++) {
+    bool negative = is_negative(gen);
+    num_negative_lookups += negative;
+    lookups[i] = negative ? absent_keys[absent_dist(gen)]
+                          : indexed_keys[indexed_dist(gen)];
+    expected_found[i] = !negative;
+  }
+
+  LearnedIndex<K, V, STORAGE> index(Span<K>(indexed_keys), std::move(values));
+  index.build(num_second_level_models, num_build_threads);
+
+  for (double bits_per_key : filter_bits_per_key) {
+    index.build_negative_lookup_filter(bits_per_key);
+    index.reset_negative_lookup_stats();
+    auto workload_start_time = std::chrono::high_resolution_clock::now();
+    for (int64_t i = 0; i < num_lookups; i++) {
+      if ((index.get_value(lookups[i]) != nullptr) != expected_found[i]) {
+        exit(1);
+      }
+    }
+    double workload_time =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - workload_start_time)
+            .count();
+
+    auto stats = index.get_negative_lookup_stats();
+    double negatives = std::max<int64_t>(num_negative_lookups, 1);
+    std::cout << bits_per_key << "\t"
+              << index.negative_lookup_filter_bytes() / 1024.0 << "\t"
+              << index.fence_bytes() / 1024.0 << "\t"
+              << workload_time / num_lookups << "\t"
+              << stats.fence_rejections / negatives << "\t"
+              << stats.filter_rejections / negatives << "\t"
+              << stats.filter_false_positive_rate() << std::endl;
+  }
+}
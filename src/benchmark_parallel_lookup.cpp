@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "learned_index.h"
+#include "look_up_table_learned_index.h"
+#include "parallel_replay.h"
+#include "sosd_file.h"
+#include "weighted_learned_index.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Replay the workload on 1, 2, ..., max_threads pinned threads and print one
+// line per thread count: the thread count, the aggregate throughput, the
+// minimum, mean and maximum per-thread throughput (all in M lookups/s), the
+// scaling efficiency relative to one thread and the number of last-mile
+// searches ("NA" for binary search).
+template <class Lookup, class LastMileCount>
+void report_scaling(Span<K> workload, int max_threads, Lookup lookup,
+                    LastMileCount last_mile_count) {
+  double single_thread_throughput = 0;
+  for (int num_threads = 1; num_threads <= max_threads; num_threads++) {
+    int64_t last_mile_before = last_mile_count();
+    ReplayResult result = replay_parallel(workload, num_threads, lookup);
+    if (!result.ok) {
+      exit(1);
+    }
+    double min_throughput = result.thread_throughput(0);
+    double max_throughput = min_throughput;
+    double sum_throughput = 0;
+    for (int thread = 0; thread < num_threads; thread++) {
+      double throughput = result.thread_throughput(thread);
+      min_throughput = std::min(min_throughput, throughput);
+      max_throughput = std::max(max_throughput, throughput);
+      sum_throughput += throughput;
+    }
+    if (num_threads == 1) {
+      single_thread_throughput = result.aggregate_throughput();
+    }
+    double efficiency =
+        single_thread_throughput > 0
+            ? result.aggregate_throughput() /
+                  (num_threads * single_thread_throughput)
+            : 0;
+    int64_t last_mile = last_mile_count();
+    std::cout << num_threads << "\t" << result.aggregate_throughput() << "\t"
+              << min_throughput << "\t" << sum_throughput / num_threads << "\t"
+              << max_throughput << "\t" << efficiency << "\t";
+    if (last_mile < 0) {
+      std::cout << "NA" << std::endl;
+    } else {
+      std::cout << last_mile - last_mile_before << std::endl;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 7 || argc > 10) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  // One of learned_index, weighted_learned_index,
+  // look_up_table_learned_index and binary_search.
+  std::string index_type = std::string(argv[1]);
+  int max_threads = atoi(argv[2]);
+  std::string keys_file_path = std::string(argv[3]);
+  std::string test_workload_file_path = std::string(argv[4]);
+  int64_t num_records = atoll(argv[5]);
+  int64_t test_workload_size = atoll(argv[6]);
+  // Optional for binary search: the number of second-level models, the
+  // weights file (weighted and look-up table indexes) and the table size.
+  int num_second_level_models = argc > 7 ? atoi(argv[7]) : 1000;
+  std::string weights_file_path = argc > 8 ? std::string(argv[8]) : "";
+  int table_size = argc > 9 ? atoi(argv[9]) : 1000;
+  bool needs_weights = index_type == "weighted_learned_index" ||
+                       index_type == "look_up_table_learned_index";
+  if (max_threads < 1 || (needs_weights && weights_file_path.empty())) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  MappedFile weights_file;
+  Span<double> weights;
+  if (needs_weights) {
+    weights_file = MappedFile(weights_file_path, AccessAdvice::kSequential);
+    weights = raw_array<double>(weights_file, num_records);
+    if (static_cast<int64_t>(weights.size()) != num_records) {
+      std::cout << "Weights file holds fewer than " << num_records
+                << " weights" << std::endl;
+      exit(1);
+    }
+  }
+
+  // Map the workload file
+  MappedFile workload_file(test_workload_file_path, AccessAdvice::kSequential);
+  Span<K> test_workload = raw_array<K>(workload_file, test_workload_size);
+  if (static_cast<int64_t>(test_workload.size()) != test_workload_size) {
+    std::cout << "Workload file holds fewer than " << test_workload_size
+              << " keys" << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen_payload(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
+  }
+
+  if (index_type == "learned_index") {
+    LearnedIndex<K, V> index(keys, std::move(values));
+    index.build(num_second_level_models);
+    keys_file.advise(AccessAdvice::kRandom);
+    report_scaling(
+        test_workload, max_threads,
+        [&](K key) { return index.get_value(key) != nullptr; },
+        [&]() { return index.get_last_mile_search_count(); });
+  } else if (index_type == "weighted_learned_index") {
+    WLearnedIndex<K, V> index(keys, std::move(values), weights);
+    index.build(num_second_level_models);
+    keys_file.advise(AccessAdvice::kRandom);
+    report_scaling(
+        test_workload, max_threads,
+        [&](K key) { return index.get_value(key) != nullptr; },
+        [&]() { return index.get_last_mile_search_count(); });
+  } else if (index_type == "look_up_table_learned_index") {
+    LookUpTableLearnedIndex<K, V> index(keys, std::move(values), weights);
+    index.build(num_second_level_models, table_size);
+    keys_file.advise(AccessAdvice::kRandom);
+    report_scaling(
+        test_workload, max_threads,
+        [&](K key) { return index.get_value(key) != nullptr; },
+        [&]() { return index.get_last_mile_search_count(); });
+  } else if (index_type == "binary_search") {
+    std::vector<std::pair<K, V>> data(num_records);
+    for (int64_t i = 0; i < num_records; i++) {
+      data[i] = {keys[i], values[i]};
+    }
+    keys_file.advise(AccessAdvice::kRandom);
+    report_scaling(
+        test_workload, max_threads,
+        [&](K key) {
+          auto it = std::lower_bound(
+              data.begin(), data.end(), key,
+              [](auto const& pair, K key) { return pair.first < key; });
+          return it != data.end() && it->first == key;
+        },
+        []() { return int64_t(-1); });
+  } else {
+    std::cout << "Unknown index type " << index_type << std::endl;
+    exit(1);
+  }
+}
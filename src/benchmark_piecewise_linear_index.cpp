@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "latency_recorder.h"
+#include "learned_index.h"
+#include "piecewise_linear_index.h"
+#include "sosd_file.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
+
+// Width of the widest last-mile window of an index.
+int64_t max_window(const PiecewiseLinearIndex<K, V, STORAGE>& index) {
+  const ErrorBound& error_bound = index.leaf_error_bound();
+  return error_bound.max_error - error_bound.min_error + 1;
+}
+
+int64_t max_window(const LearnedIndex<K, V, STORAGE>& index) {
+  int64_t window = 0;
+  for (const ErrorBound& error_bound : index.second_level_error_bounds()) {
+    window = std::max(window, error_bound.max_error - error_bound.min_error + 1);
+  }
+  return window;
+}
+
+// Time `build` on `index`, replay the workload on it and print one line: the
+// index name, its parameter, the model size in KiB, the number of pieces or
+// second-level models, the widest last-mile window, the build time, the
+// workload time, the nanoseconds per lookup, the last-mile searches and the
+// latency columns.
+template <class Index, class Build>
+void run(const std::string& name, size_t parameter, Index& index, Build build,
+         Span<K> test_workload) {
+  auto build_start_time = std::chrono::high_resolution_clock::now();
+  size_t num_leaves = build();
+  double build_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - build_start_time)
+          .count();
+
+  // Sampled per-lookup latencies; see latency_recorder.h.
+  LatencyRecorder latency;
+  index.reset_last_mile_search_count();
+  auto workload_start_time = std::chrono::high_resolution_clock::now();
+  for (K key : test_workload) {
+    if (!latency.measure([&]() { return index.get_value(key); })) {
+      exit(1);
+    }
+  }
+  double workload_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - workload_start_time)
+          .count();
+
+  std::cout << name << "\t" << parameter << "\t"
+            << index.model_bytes() / 1024.0 << "\t" << num_leaves << "\t"
+            << max_window(index) << "\t" << build_time / 1e9 << "\t"
+            << workload_time / 1e9 << "\t"
+            << workload_time / test_workload.size() << "\t"
+            << index.get_last_mile_search_count();
+  write_latency_columns(std::cout, latency);
+  std::cout << std::endl;
+}
+
+// Compares the error-bounded piecewise linear build (piecewise_linear_index.h)
+// with the two-level RMI of LearnedIndex at equal memory. For every epsilon,
+// one line is printed for the piecewise linear index and one for a
+// LearnedIndex with as many second-level models as fit in the same model
+// bytes.
+int main(int argc, char** argv) {
+  if (argc < 6 || argc > 7) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  std::vector<size_t> epsilons;
+  std::stringstream epsilon_list(argv[1]);
+  for (std::string epsilon; std::getline(epsilon_list, epsilon, ',');) {
+    epsilons.push_back(atoll(epsilon.c_str()));
+  }
+  std::string keys_file_path = std::string(argv[2]);
+  std::string test_workload_file_path = std::string(argv[3]);
+  int64_t num_records = atoll(argv[4]);
+  int64_t test_workload_size = atoll(argv[5]);
+  // Optional: number of threads used to build the indexes.
+  int num_build_threads = argc > 6 ? atoi(argv[6]) : 1;
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Map the workload file
+  MappedFile workload_file(test_workload_file_path, AccessAdvice::kSequential);
+  Span<K> test_workload = raw_array<K>(workload_file, test_workload_size);
+  if (static_cast<int64_t>(test_workload.size()) != test_workload_size) {
+    std::cout << "Workload file holds fewer than " << test_workload_size
+              << " keys" << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen_payload(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
+  }
+
+  for (size_t epsilon : epsilons) {
+    PiecewiseLinearIndex<K, V, STORAGE> piecewise_index(keys, values);
+    run("piecewise", epsilon, piecewise_index,
+        [&]() {
+          piecewise_index.build(
+              epsilon, PiecewiseLinearIndex<K, V, STORAGE>::kDefaultRoutingEpsilon,
+              num_build_threads);
+          return piecewise_index.num_pieces();
+        },
+        test_workload);
+
+    size_t model_bytes = piecewise_index.model_bytes();
+    int num_second_level_models = std::max<size_t>(
+        (model_bytes - sizeof(LinearModel<K>)) /
+            (sizeof(LinearModel<K>) + sizeof(ErrorBound)),
+        1);
+    LearnedIndex<K, V, STORAGE> rmi_index(keys, values);
+    run("rmi", epsilon, rmi_index,
+        [&]() {
+          rmi_index.build(num_second_level_models, num_build_threads);
+          return rmi_index.second_level_models().size();
+        },
+        test_workload);
+  }
+}
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "latency_recorder.h"
+#include "learned_index.h"
+#include "sosd_file.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
+
+// Time `build` on a fresh LearnedIndex, replay the workload on it and print
+// one line: the root stage, the model size in KiB, the number of empty
+// second-level models, the largest model's record count, the standard
+// deviation of the record counts, the widest last-mile window, the build
+// time, the workload time, the nanoseconds per lookup, the last-mile
+// searches and the latency columns.
+template <class Build>
+void run(const std::string& name, Span<K> keys, const std::vector<V>& values,
+         Build build, Span<K> test_workload) {
+  LearnedIndex<K, V, STORAGE> index(keys, values);
+  auto build_start_time = std::chrono::high_resolution_clock::now();
+  build(index);
+  double build_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - build_start_time)
+          .count();
+
+  // Sampled per-lookup latencies; see latency_recorder.h.
+  LatencyRecorder latency;
+  auto workload_start_time = std::chrono::high_resolution_clock::now();
+  for (K key : test_workload) {
+    if (!latency.measure([&]() { return index.get_value(key); })) {
+      exit(1);
+    }
+  }
+  double workload_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - workload_start_time)
+          .count();
+
+  int64_t max_window = 0;
+  for (const ErrorBound& error_bound : index.second_level_error_bounds()) {
+    max_window =
+        std::max(max_window, error_bound.max_error - error_bound.min_error + 1);
+  }
+  const SegmentSizeStats& sizes = index.segment_size_stats();
+  std::cout << name << "\t" << index.model_bytes() / 1024.0 << "\t"
+            << sizes.empty_segments << "\t" << sizes.max_size << "\t"
+            << std::sqrt(sizes.size_variance) << "\t" << max_window << "\t"
+            << build_time / 1e9 << "\t" << workload_time / 1e9 << "\t"
+            << workload_time / test_workload.size() << "\t"
+            << index.get_last_mile_search_count();
+  write_latency_columns(std::cout, latency);
+  std::cout << std::endl;
+}
+
+// Compares the linear root of LearnedIndex with the radix-table root of
+// build_radix_root (see radix_root.h) for the same number of second-level
+// models, one line each. On skewed keys the linear root leaves many models
+// empty and overloads a few; the radix root gives every model the same
+// number of records.
+int main(int argc, char** argv) {
+  if (argc < 6 || argc > 7) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  int num_second_level_models = atoi(argv[1]);
+  std::string keys_file_path = std::string(argv[2]);
+  std::string test_workload_file_path = std::string(argv[3]);
+  int64_t num_records = atoll(argv[4]);
+  int64_t test_workload_size = atoll(argv[5]);
+  // Optional: number of threads used to build the index.
+  int num_build_threads = argc > 6 ? atoi(argv[6]) : 1;
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Map the workload file
+  MappedFile workload_file(test_workload_file_path, AccessAdvice::kSequential);
+  Span<K> test_workload = raw_array<K>(workload_file, test_workload_size);
+  if (static_cast<int64_t>(test_workload.size()) != test_workload_size) {
+    std::cout << "Workload file holds fewer than " << test_workload_size
+              << " keys" << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen_payload(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
+  }
+
+  run("linear", keys, values,
+      [&](LearnedIndex<K, V, STORAGE>& index) {
+        index.build(num_second_level_models, num_build_threads);
+      },
+      test_workload);
+  run("radix", keys, values,
+      [&](LearnedIndex<K, V, STORAGE>& index) {
+        index.build_radix_root(num_second_level_models, num_build_threads);
+      },
+      test_workload);
+}
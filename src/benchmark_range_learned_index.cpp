@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "learned_index.h"
+#include "sosd_file.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
+
+// Range queries on LearnedIndex. For every range length L, `num_queries`
+// ranges [lo, hi) are drawn: lo is uniform between two neighbouring keys, so
+// it is usually not in the data, and hi is the key L records further on. The
+// ranges are scanned once through LearnedIndex::scan and once with a binary
+// search over all records for the lower bound instead of the models; both
+// sum the payloads, and the sums must agree. Each line holds L, the mean
+// records per range, the nanoseconds per range of the learned index and of
+// the binary search, and the learned index's scan rate in M records/s.
+int main(int argc, char** argv) {
+  if (argc < 5 || argc > 7) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  int num_second_level_models = atoi(argv[1]);
+  std::string keys_file_path = std::string(argv[2]);
+  int64_t num_records = atoll(argv[3]);
+  int64_t num_queries = atoll(argv[4]);
+  // Optional: comma-separated range lengths in records and number of threads
+  // used to build the index.
+  std::vector<int64_t> range_lengths;
+  std::stringstream lengths(argc > 5 ? argv[5] : "10,1000,100000");
+  for (std::string length; std::getline(lengths, length, ',');) {
+    range_lengths.push_back(atoll(length.c_str()));
+  }
+  int num_build_threads = argc > 6 ? atoi(argv[6]) : 1;
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen());
+  }
+
+  LearnedIndex<K, V, STORAGE> index(keys, std::move(values));
+  index.build(num_second_level_models, num_build_threads);
+  const STORAGE& data = index.data();
+
+  for (int64_t range_length : range_lengths) {
+    std::uniform_int_distribution<int64_t> start_dist(0, num_records - 1);
+    std::vector<std::pair<K, K>> queries(num_queries);
+    for (auto& query : queries) {
+      int64_t start = start_dist(gen);
+      K start_key = data.key(start);
+      K next_key = start + 1 < num_records ? data.key(start + 1) : start_key;
+      query.first = start_key +
+                    std::uniform_int_distribution<K>(0, next_key - start_key)(gen);
+      query.second = start + range_length < num_records
+                         ? data.key(start + range_length)
+                         : std::numeric_limits<K>::max();
+    }
+
+    auto timed_pass = [&](auto&& scan_range, int64_t* num_scanned,
+                          uint64_t* sum) {
+      *num_scanned = 0;
+      *sum = 0;
+      // Unsigned, so that the sum may wrap around.
+      auto add = [sum](K, V value) { *sum += static_cast<uint64_t>(value); };
+      auto start_time = std::chrono::high_resolution_clock::now();
+      for (const auto& query : queries) {
+        *num_scanned += scan_range(query.first, query.second, add);
+      }
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::high_resolution_clock::now() - start_time)
+          .count();
+    };
+
+    int64_t learned_scanned;
+    uint64_t learned_sum;
+    double learned_time = timed_pass(
+        [&](K lo, K hi, auto&& fn) { return index.scan(lo, hi, fn); },
+        &learned_scanned, &learned_sum);
+    int64_t binary_scanned;
+    uint64_t binary_sum;
+    double binary_time = timed_pass(
+        [&](K lo, K hi, auto&& fn) {
+          auto records = RecordRange<STORAGE>::until(
+              data, data.lower_bound(lo, 0, data.size()), hi);
+          records.for_each(fn);
+          return records.size();
+        },
+        &binary_scanned, &binary_sum);
+    if (learned_scanned != binary_scanned || learned_sum != binary_sum) {
+      std::cout << "Range scans disagree" << std::endl;
+      exit(1);
+    }
+
+    std::cout << range_length << "\t"
+              << static_cast<double>(learned_scanned) / num_queries << "\t"
+              << learned_time / num_queries << "\t"
+              << binary_time / num_queries << "\t"
+              << learned_scanned / learned_time * 1e3 << std::endl;
+  }
+}
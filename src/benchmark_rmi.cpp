@@ -0,0 +1,149 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "latency_recorder.h"
+#include "recursive_model_index.h"
+#include "sosd_file.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
+
+// Build one RMI configuration over the keys, replay the workload on it and
+// print one line: the configuration name, the model size in KiB, the build
+// time, the workload time, the last-mile searches and the latency columns.
+template <class Levels>
+void run_configuration(const std::string& name,
+                       const std::vector<size_t>& level_sizes, Span<K> keys,
+                       const std::vector<V>& values, Span<double> weights,
+                       Span<K> test_workload, int num_build_threads) {
+  RecursiveModelIndex<K, V, Levels, STORAGE> index(keys, values);
+  auto build_start_time = std::chrono::high_resolution_clock::now();
+  index.build(level_sizes, weights, num_build_threads);
+  double build_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - build_start_time)
+          .count();
+
+  // Sampled per-lookup latencies; see latency_recorder.h.
+  LatencyRecorder latency;
+  auto workload_start_time = std::chrono::high_resolution_clock::now();
+  for (K key : test_workload) {
+    if (!latency.measure([&]() { return index.get_value(key); })) {
+      exit(1);
+    }
+  }
+  double workload_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - workload_start_time)
+          .count();
+
+  std::cout << name << "\t" << index.model_bytes() / 1024.0 << "\t"
+            << build_time / 1e9 << "\t" << workload_time / 1e9 << "\t"
+            << index.get_last_mile_search_count();
+  write_latency_columns(std::cout, latency);
+  std::cout << std::endl;
+}
+
+// Compares RMI configurations with `num_models` models on the last level:
+// the two-level linear RMI of LearnedIndex, the same with a cubic, radix or
+// linear-spline root, and three-level RMIs with sqrt(num_models) models in
+// the middle. With a weights file, a linear root over weighted linear leaves
+// (the models of WLearnedIndex) is added.
+int main(int argc, char** argv) {
+  if (argc < 6 || argc > 8) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  size_t num_models = atoll(argv[1]);
+  std::string keys_file_path = std::string(argv[2]);
+  std::string test_workload_file_path = std::string(argv[3]);
+  int64_t num_records = atoll(argv[4]);
+  int64_t test_workload_size = atoll(argv[5]);
+  // Optional: weights file ("-" for none) and number of threads used to
+  // build the index.
+  std::string weights_file_path = argc > 6 ? std::string(argv[6]) : "-";
+  int num_build_threads = argc > 7 ? atoi(argv[7]) : 1;
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Map the workload file
+  MappedFile workload_file(test_workload_file_path, AccessAdvice::kSequential);
+  Span<K> test_workload = raw_array<K>(workload_file, test_workload_size);
+  if (static_cast<int64_t>(test_workload.size()) != test_workload_size) {
+    std::cout << "Workload file holds fewer than " << test_workload_size
+              << " keys" << std::endl;
+    exit(1);
+  }
+
+  MappedFile weights_file;
+  Span<double> weights;
+  if (weights_file_path != "-") {
+    weights_file = MappedFile(weights_file_path, AccessAdvice::kSequential);
+    weights = raw_array<double>(weights_file, num_records);
+    if (static_cast<int64_t>(weights.size()) != num_records) {
+      std::cout << "Weights file holds fewer than " << num_records
+                << " weights" << std::endl;
+      exit(1);
+    }
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen_payload(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
+  }
+
+  std::vector<size_t> two_levels = {num_models};
+  std::vector<size_t> three_levels = {
+      static_cast<size_t>(std::ceil(std::sqrt(num_models))), num_models};
+  run_configuration<std::tuple<LinearModel<K>, LinearModel<K>>>(
+      "linear,linear", two_levels, keys, values, Span<double>(), test_workload,
+      num_build_threads);
+  run_configuration<std::tuple<CubicModel<K>, LinearModel<K>>>(
+      "cubic,linear", two_levels, keys, values, Span<double>(), test_workload,
+      num_build_threads);
+  run_configuration<std::tuple<RadixModel<K>, LinearModel<K>>>(
+      "radix,linear", two_levels, keys, values, Span<double>(), test_workload,
+      num_build_threads);
+  run_configuration<std::tuple<LinearSplineModel<K>, LinearModel<K>>>(
+      "linear_spline,linear", two_levels, keys, values, Span<double>(),
+      test_workload, num_build_threads);
+  run_configuration<
+      std::tuple<LinearModel<K>, LinearModel<K>, LinearModel<K>>>(
+      "linear,linear,linear", three_levels, keys, values, Span<double>(),
+      test_workload, num_build_threads);
+  run_configuration<
+      std::tuple<CubicModel<K>, LinearSplineModel<K>, LinearModel<K>>>(
+      "cubic,linear_spline,linear", three_levels, keys, values, Span<double>(),
+      test_workload, num_build_threads);
+  if (!weights.empty()) {
+    run_configuration<std::tuple<LinearModel<K>, WLinearModel<K, V>>>(
+        "linear,weighted_linear", two_levels, keys, values, weights,
+        test_workload, num_build_threads);
+  }
+}
@@ -0,0 +1,440 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "latency_recorder.h"
+#include "learned_index.h"
+#include "look_up_table_learned_index.h"
+#include "sosd_file.h"
+#include "utils/cxxopts.hpp"
+#include "weighted_learned_index.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
+
+/* Run the whole evaluation grid in one process.
+ *
+ * The keys, payloads, weights and workloads are loaded once and every index
+ * variant is built over the same sorted data, for every number of
+ * second-level models (and table size). A learned index is built once per
+ * model count and replayed on every workload; the weighted and look-up table
+ * indexes are trained on the weights of a workload and replayed on that
+ * workload. Each replay runs a number of untimed warm-up passes, then timed
+ * repeats whose median and 95% confidence interval are reported.
+ */
+
+// Summary of the timed repeats of one replay, in seconds.
+struct RunSummary {
+  int repeats = 0;
+  double median = 0;
+  // Distribution-free 95% confidence interval of the median (the order
+  // statistics around it); with fewer than 6 repeats it spans all of them.
+  double ci_low = 0;
+  double ci_high = 0;
+};
+
+RunSummary summarize_runs(std::vector<double> times) {
+  RunSummary summary;
+  summary.repeats = times.size();
+  if (times.empty()) {
+    return summary;
+  }
+  std::sort(times.begin(), times.end());
+  int64_t n = times.size();
+  summary.median = n % 2 == 1 ? times[n / 2]
+                              : (times[n / 2 - 1] + times[n / 2]) / 2;
+  double spread = 0.98 * std::sqrt(static_cast<double>(n));
+  int64_t low_rank = std::max<int64_t>(
+      static_cast<int64_t>(std::floor(n / 2.0 - spread)), 1);
+  int64_t high_rank = std::min<int64_t>(
+      static_cast<int64_t>(std::ceil(1 + n / 2.0 + spread)), n);
+  summary.ci_low = times[low_rank - 1];
+  summary.ci_high = times[high_rank - 1];
+  return summary;
+}
+
+// One row of the results.
+struct SweepResult {
+  std::string index;
+  int num_second_level_models = 0;  // 0: not applicable
+  int table_size = 0;               // 0: not applicable
+  std::string train_workload;       // empty: not applicable
+  std::string test_workload;
+  int64_t model_size = -1;          // bytes, -1: not applicable
+  double build_time = -1;           // seconds, -1: not applicable
+  int64_t workload_size = 0;
+  RunSummary workload_time;
+  int64_t num_last_mile_search = -1;  // per replay, -1: not applicable
+  const LatencyRecorder* latency = nullptr;
+};
+
+// Writes results as CSV rows or as a JSON array, one result at a time so
+// that a long sweep leaves usable partial output.
+class SweepWriter {
+ public:
+  SweepWriter(std::ostream& os, bool json) : os_(os), json_(json) {
+    if (json_) {
+      os_ << "[";
+    } else {
+      os_ << "index,num_second_level_models,table_size,train_workload,"
+             "test_workload,model_size,build_time,repeats,"
+             "workload_time_median,workload_time_ci_low,"
+             "workload_time_ci_high,throughput_median,num_last_mile_search,"
+             "p50_latency_ns,p90_latency_ns,p99_latency_ns,p999_latency_ns,"
+             "max_latency_ns\n";
+    }
+    os_.flush();
+  }
+
+  ~SweepWriter() {
+    if (json_) {
+      os_ << (first_ ? "]\n" : "\n]\n");
+    }
+    os_.flush();
+  }
+
+  void write(const SweepResult& result) {
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    std::vector<std::pair<std::string, std::string>> fields = {
+        {"index", quote(result.index)},
+        {"num_second_level_models",
+         or_na(result.num_second_level_models > 0,
+               result.num_second_level_models)},
+        {"table_size", or_na(result.table_size > 0, result.table_size)},
+        {"train_workload",
+         result.train_workload.empty() ? na() : quote(result.train_workload)},
+        {"test_workload", quote(result.test_workload)},
+        {"model_size", or_na(result.model_size >= 0, result.model_size)},
+        {"build_time", or_na(result.build_time >= 0, result.build_time)},
+        {"repeats", number(result.workload_time.repeats)},
+        {"workload_time_median", number(result.workload_time.median)},
+        {"workload_time_ci_low", number(result.workload_time.ci_low)},
+        {"workload_time_ci_high", number(result.workload_time.ci_high)},
+        {"throughput_median",
+         or_na(result.workload_time.median > 0,
+               result.workload_size / result.workload_time.median / 1e6)},
+        {"num_last_mile_search",
+         or_na(result.num_last_mile_search >= 0,
+               result.num_last_mile_search)},
+    };
+    const char* latency_names[] = {"p50_latency_ns", "p90_latency_ns",
+                                   "p99_latency_ns", "p999_latency_ns"};
+    for (int i = 0; i < 4; i++) {
+      fields.emplace_back(latency_names[i],
+                          number(result.latency->percentile_ns(quantiles[i])));
+    }
+    fields.emplace_back("max_latency_ns", number(result.latency->max_ns()));
+
+    if (json_) {
+      os_ << (first_ ? "\n  {" : ",\n  {");
+      for (size_t i = 0; i < fields.size(); i++) {
+        os_ << (i > 0 ? ", " : "") << "\"" << fields[i].first
+            << "\": " << fields[i].second;
+      }
+      os_ << "}";
+    } else {
+      for (size_t i = 0; i < fields.size(); i++) {
+        os_ << (i > 0 ? "," : "") << fields[i].second;
+      }
+      os_ << "\n";
+    }
+    first_ = false;
+    os_.flush();
+  }
+
+ private:
+  template <class T>
+  static std::string number(T value) {
+    std::ostringstream os;
+    os << value;
+    return os.str();
+  }
+  std::string na() const { return json_ ? "null" : "NA"; }
+  template <class T>
+  std::string or_na(bool applicable, T value) const {
+    return applicable ? number(value) : na();
+  }
+  // File names are the only strings; they are quoted for JSON only.
+  std::string quote(const std::string& s) const {
+    return json_ ? "\"" + s + "\"" : s;
+  }
+
+  std::ostream& os_;
+  bool json_;
+  bool first_ = true;
+};
+
+// Replay the workload `warmups` times, then `repeats` times while timing each
+// pass and sampling lookup latencies. lookup(key) returns false on failure.
+template <class Lookup>
+RunSummary replay_repeated(Span<K> workload, int warmups, int repeats,
+                           Lookup lookup, LatencyRecorder* latency) {
+  for (int run = 0; run < warmups; run++) {
+    for (K key : workload) {
+      if (!lookup(key)) {
+        std::cerr << "Lookup of key " << key << " failed" << std::endl;
+        exit(1);
+      }
+    }
+  }
+  std::vector<double> times;
+  for (int run = 0; run < repeats; run++) {
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (K key : workload) {
+      if (!latency->measure([&]() { return lookup(key); })) {
+        std::cerr << "Lookup of key " << key << " failed" << std::endl;
+        exit(1);
+      }
+    }
+    times.push_back(std::chrono::duration<double>(
+                        std::chrono::high_resolution_clock::now() - start_time)
+                        .count());
+  }
+  return summarize_runs(times);
+}
+
+template <class Fn>
+double time_seconds(Fn fn) {
+  auto start_time = std::chrono::high_resolution_clock::now();
+  fn();
+  return std::chrono::duration<double>(
+             std::chrono::high_resolution_clock::now() - start_time)
+      .count();
+}
+
+std::vector<int> parse_int_list(const std::vector<std::string>& items) {
+  std::vector<int> values;
+  for (const std::string& item : items) {
+    values.push_back(atoi(item.c_str()));
+  }
+  return values;
+}
+
+int main(int argc, char** argv) {
+  cxxopts::Options options("benchmark_sweep",
+                           "Evaluate a grid of learned index configurations");
+  options.add_options()
+      ("keys", "SOSD key file", cxxopts::value<std::string>())
+      ("num_records", "Number of keys to index", cxxopts::value<int64_t>())
+      ("workloads", "Comma-separated workload files",
+       cxxopts::value<std::vector<std::string>>())
+      ("weights", "Comma-separated weight files, one per workload (needed by "
+       "the weighted and look-up table indexes)",
+       cxxopts::value<std::vector<std::string>>())
+      ("workload_size", "Number of lookups per workload",
+       cxxopts::value<int64_t>())
+      ("indexes", "Comma-separated variants: linear_model, "
+       "weighted_linear_model, look_up_table_linear_model, binary_search",
+       cxxopts::value<std::vector<std::string>>()->default_value(
+           "linear_model,weighted_linear_model,look_up_table_linear_model"))
+      ("models", "Comma-separated numbers of second-level models",
+       cxxopts::value<std::vector<std::string>>()->default_value("1000"))
+      ("table_sizes", "Comma-separated look-up table sizes",
+       cxxopts::value<std::vector<std::string>>()->default_value("1000"))
+      ("threads", "Number of threads used to build an index",
+       cxxopts::value<int>()->default_value("1"))
+      ("warmups", "Untimed replays before the timed ones",
+       cxxopts::value<int>()->default_value("1"))
+      ("repeats", "Timed replays per configuration",
+       cxxopts::value<int>()->default_value("5"))
+      ("output", "Result file (- for stdout)",
+       cxxopts::value<std::string>()->default_value("-"))
+      ("format", "csv or json",
+       cxxopts::value<std::string>()->default_value("csv"))
+      ("help", "Print usage");
+  auto args = options.parse(argc, argv);
+  if (args.count("help") || !args.count("keys") ||
+      !args.count("num_records") || !args.count("workloads") ||
+      !args.count("workload_size")) {
+    std::cout << options.help() << std::endl;
+    exit(args.count("help") ? 0 : 1);
+  }
+
+  std::string keys_file_path = args["keys"].as<std::string>();
+  int64_t num_records = args["num_records"].as<int64_t>();
+  std::vector<std::string> workload_paths =
+      args["workloads"].as<std::vector<std::string>>();
+  std::vector<std::string> weights_paths =
+      args.count("weights") ? args["weights"].as<std::vector<std::string>>()
+                            : std::vector<std::string>();
+  int64_t test_workload_size = args["workload_size"].as<int64_t>();
+  std::vector<std::string> indexes =
+      args["indexes"].as<std::vector<std::string>>();
+  std::vector<int> model_counts =
+      parse_int_list(args["models"].as<std::vector<std::string>>());
+  std::vector<int> table_sizes =
+      parse_int_list(args["table_sizes"].as<std::vector<std::string>>());
+  int num_build_threads = args["threads"].as<int>();
+  int warmups = std::max(args["warmups"].as<int>(), 0);
+  int repeats = std::max(args["repeats"].as<int>(), 1);
+  std::string format = args["format"].as<std::string>();
+  auto runs = [&](const std::string& index) {
+    return std::find(indexes.begin(), indexes.end(), index) != indexes.end();
+  };
+  bool needs_weights =
+      runs("weighted_linear_model") || runs("look_up_table_linear_model");
+  if ((format != "csv" && format != "json") ||
+      (needs_weights && weights_paths.size() != workload_paths.size())) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the indexes.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Map every workload and weights file once.
+  std::vector<MappedFile> workload_files;
+  std::vector<Span<K>> workloads;
+  for (const std::string& path : workload_paths) {
+    workload_files.emplace_back(path, AccessAdvice::kSequential);
+    workloads.push_back(raw_array<K>(workload_files.back(), test_workload_size));
+    if (static_cast<int64_t>(workloads.back().size()) != test_workload_size) {
+      std::cout << "Workload file " << path << " holds fewer than "
+                << test_workload_size << " keys" << std::endl;
+      exit(1);
+    }
+  }
+  std::vector<MappedFile> weights_files;
+  std::vector<Span<double>> weights;
+  for (size_t i = 0; needs_weights && i < weights_paths.size(); i++) {
+    weights_files.emplace_back(weights_paths[i], AccessAdvice::kSequential);
+    weights.push_back(raw_array<double>(weights_files.back(), num_records));
+    if (static_cast<int64_t>(weights.back().size()) != num_records) {
+      std::cout << "Weights file " << weights_paths[i] << " holds fewer than "
+                << num_records << " weights" << std::endl;
+      exit(1);
+    }
+  }
+
+  // Generate random payloads for the keys once; every index copies them.
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen_payload(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
+  }
+
+  std::ofstream output_file;
+  std::string output_path = args["output"].as<std::string>();
+  if (output_path != "-") {
+    output_file.open(output_path);
+    if (!output_file) {
+      std::cout << "Could not open " << output_path << std::endl;
+      exit(1);
+    }
+  }
+  SweepWriter writer(output_path == "-" ? std::cout : output_file,
+                     format == "json");
+
+  // Replay workload w on a built index and write its row.
+  auto evaluate = [&](auto& index, SweepResult result, size_t w) {
+    keys_file.advise(AccessAdvice::kRandom);
+    LatencyRecorder latency;
+    index.reset_last_mile_search_count();
+    result.test_workload = workload_paths[w];
+    result.workload_size = test_workload_size;
+    result.model_size = sizeof(index);
+    result.workload_time = replay_repeated(
+        workloads[w], warmups, repeats,
+        [&](K key) { return index.get_value(key) != nullptr; }, &latency);
+    result.num_last_mile_search =
+        index.get_last_mile_search_count() / (warmups + repeats);
+    result.latency = &latency;
+    writer.write(result);
+  };
+
+  for (int num_models : model_counts) {
+    if (runs("linear_model")) {
+      auto index = std::make_unique<LearnedIndex<K, V, STORAGE>>(keys, values);
+      keys_file.advise(AccessAdvice::kSequential);
+      SweepResult result;
+      result.index = "linear_model";
+      result.num_second_level_models = num_models;
+      result.build_time = time_seconds(
+          [&]() { index->build(num_models, num_build_threads); });
+      for (size_t w = 0; w < workloads.size(); w++) {
+        evaluate(*index, result, w);
+      }
+    }
+    for (size_t w = 0; w < weights.size(); w++) {
+      if (runs("weighted_linear_model")) {
+        auto index = std::make_unique<WLearnedIndex<K, V, STORAGE>>(
+            keys, values, weights[w]);
+        keys_file.advise(AccessAdvice::kSequential);
+        SweepResult result;
+        result.index = "weighted_linear_model";
+        result.num_second_level_models = num_models;
+        result.train_workload = workload_paths[w];
+        result.build_time = time_seconds(
+            [&]() { index->build(num_models, num_build_threads); });
+        evaluate(*index, result, w);
+      }
+      for (size_t t = 0;
+           runs("look_up_table_linear_model") && t < table_sizes.size(); t++) {
+        int table_size = table_sizes[t];
+        auto index = std::make_unique<LookUpTableLearnedIndex<K, V, STORAGE>>(
+            keys, values, weights[w]);
+        keys_file.advise(AccessAdvice::kSequential);
+        SweepResult result;
+        result.index = "look_up_table_linear_model";
+        result.num_second_level_models = num_models;
+        result.table_size = table_size;
+        result.train_workload = workload_paths[w];
+        result.build_time = time_seconds([&]() {
+          index->build(num_models, table_size, num_build_threads);
+        });
+        evaluate(*index, result, w);
+      }
+    }
+  }
+
+  if (runs("binary_search")) {
+    std::vector<std::pair<K, V>> data(num_records);
+    for (int64_t i = 0; i < num_records; i++) {
+      data[i] = {keys[i], values[i]};
+    }
+    for (size_t w = 0; w < workloads.size(); w++) {
+      SweepResult result;
+      result.index = "binary_search";
+      result.test_workload = workload_paths[w];
+      result.workload_size = test_workload_size;
+      LatencyRecorder latency;
+      result.workload_time = replay_repeated(
+          workloads[w], warmups, repeats,
+          [&](K key) {
+            auto it = std::lower_bound(
+                data.begin(), data.end(), key,
+                [](auto const& pair, K key) { return pair.first < key; });
+            return it != data.end() && it->first == key;
+          },
+          &latency);
+      result.latency = &latency;
+      writer.write(result);
+    }
+  }
+}
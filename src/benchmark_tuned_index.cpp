@@ -0,0 +1,146 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "latency_recorder.h"
+#include "learned_index.h"
+#include "look_up_table_learned_index.h"
+#include "sosd_file.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
+
+// Time build_tuned on `index`, print the Pareto frontier the tuner
+// considered, replay the workload and print the results of the chosen
+// configuration.
+template <class Index, class BuildTuned>
+void run(Index& index, BuildTuned build_tuned, Span<K> test_workload) {
+  auto build_start_time = std::chrono::high_resolution_clock::now();
+  TunerResult result = build_tuned();
+  double build_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - build_start_time)
+          .count();
+  if (result.frontier.empty()) {
+    std::cout << "The tuner found no candidate" << std::endl;
+    exit(1);
+  }
+
+  // One line per frontier candidate: the number of models, the table size,
+  // the footprint in KiB, the estimated cost in ns, the estimated mean
+  // log2(window + 1), the estimated hot share and a mark on the chosen one.
+  for (size_t i = 0; i < result.frontier.size(); i++) {
+    const TunerCandidate& candidate = result.frontier[i];
+    std::cout << "frontier\t" << candidate.num_models << "\t"
+              << candidate.table_size << "\t"
+              << candidate.memory_bytes / 1024.0 << "\t" << candidate.cost_ns
+              << "\t" << candidate.log2_window << "\t" << candidate.hot_share
+              << (i == result.chosen ? "\t*" : "") << std::endl;
+  }
+
+  // Sampled per-lookup latencies; see latency_recorder.h.
+  LatencyRecorder latency;
+  index.reset_last_mile_search_count();
+  auto workload_start_time = std::chrono::high_resolution_clock::now();
+  for (K key : test_workload) {
+    if (!latency.measure([&]() { return index.get_value(key); })) {
+      exit(1);
+    }
+  }
+  double workload_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - workload_start_time)
+          .count();
+
+  const TunerCandidate& chosen = result.chosen_candidate();
+  std::cout << "chosen\t" << chosen.num_models << "\t" << chosen.table_size
+            << "\t" << result.num_candidates << "\t" << build_time / 1e9
+            << "\t" << workload_time / 1e9 << "\t"
+            << workload_time / test_workload.size() << "\t"
+            << index.get_last_mile_search_count();
+  write_latency_columns(std::cout, latency);
+  std::cout << std::endl;
+}
+
+// Builds the configuration that the cost-model tuner (index_tuner.h) picks
+// within a memory budget and replays the workload on it. With a weights
+// file the tuner also sizes the hot-key table of LookUpTableLearnedIndex;
+// without one it only picks the number of models of LearnedIndex.
+int main(int argc, char** argv) {
+  if (argc < 6 || argc > 8) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  TunerOptions options;
+  options.memory_budget_bytes = atoll(argv[1]) * 1024;
+  std::string keys_file_path = std::string(argv[2]);
+  std::string test_workload_file_path = std::string(argv[3]);
+  int64_t num_records = atoll(argv[4]);
+  int64_t test_workload_size = atoll(argv[5]);
+  // Optional: weights file ("-" for none) and number of threads used to
+  // build the index.
+  std::string weights_file_path = argc > 6 ? std::string(argv[6]) : "-";
+  int num_build_threads = argc > 7 ? atoi(argv[7]) : 1;
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Map the workload file
+  MappedFile workload_file(test_workload_file_path, AccessAdvice::kSequential);
+  Span<K> test_workload = raw_array<K>(workload_file, test_workload_size);
+  if (static_cast<int64_t>(test_workload.size()) != test_workload_size) {
+    std::cout << "Workload file holds fewer than " << test_workload_size
+              << " keys" << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen_payload(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
+  }
+
+  if (weights_file_path == "-") {
+    LearnedIndex<K, V, STORAGE> index(keys, std::move(values));
+    run(index,
+        [&]() {
+          return index.build_tuned(options, Span<double>(), num_build_threads);
+        },
+        test_workload);
+    return 0;
+  }
+
+  MappedFile weights_file(weights_file_path, AccessAdvice::kSequential);
+  Span<double> weights = raw_array<double>(weights_file, num_records);
+  if (static_cast<int64_t>(weights.size()) != num_records) {
+    std::cout << "Weights file holds fewer than " << num_records << " weights"
+              << std::endl;
+    exit(1);
+  }
+  LookUpTableLearnedIndex<K, V, STORAGE> index(keys, std::move(values),
+                                               weights);
+  run(index, [&]() { return index.build_tuned(options, num_build_threads); },
+      test_workload);
+}
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+
+#include "latency_recorder.h"
+#include "look_up_table_learned_index.h"
+#include "sosd_file.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
+
+int main(int argc, char** argv) {
+  if (argc < 8 || argc > 10) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  int num_second_level_models = atoi(argv[1]);
+  // Cache budget of the hot tier in KiB.
+  size_t cache_budget_bytes = atoll(argv[2]) * 1024;
+  std::string keys_file_path = std::string(argv[3]);
+  std::string weights_file_path = std::string(argv[4]);
+  std::string test_workload_file_path = std::string(argv[5]);
+  int64_t num_records = atoll(argv[6]);
+  int64_t test_workload_size = atoll(argv[7]);
+  // Optional: share of the weight the hot tier should cover and number of
+  // threads used to build the index.
+  double coverage = argc > 8 ? atof(argv[8]) : 0.99;
+  int num_build_threads = argc > 9 ? atoi(argv[9]) : 1;
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
+  std::mt19937_64 gen_payload(std::random_device{}());
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
+  }
+
+  // Map the weights generated from the workload. The file has no header;
+  // weights[i] is the weight of the i-th key.
+  MappedFile weights_file(weights_file_path, AccessAdvice::kSequential);
+  if (!weights_file.is_open()) {
+    std::cout << "Run `python generate_workflow` then `convert_workload_to_weights` to generate weights" << std::endl;
+    return 0;
+  }
+  Span<double> weights = raw_array<double>(weights_file, num_records);
+  if (static_cast<int64_t>(weights.size()) != num_records) {
+    std::cout << "Weights file holds fewer than " << num_records << " weights"
+              << std::endl;
+    exit(1);
+  }
+
+  // Map the workload file
+  MappedFile workload_file(test_workload_file_path, AccessAdvice::kSequential);
+  Span<K> test_workload = raw_array<K>(workload_file, test_workload_size);
+  if (static_cast<int64_t>(test_workload.size()) != test_workload_size) {
+    std::cout << "Workload file holds fewer than " << test_workload_size
+              << " keys" << std::endl;
+    exit(1);
+  }
+
+  LookUpTableLearnedIndex<K, V, STORAGE> index(keys, std::move(values), weights);
+  auto build_start_time = std::chrono::high_resolution_clock::now();
+  index.build_tiered(num_second_level_models, cache_budget_bytes, coverage,
+                     num_build_threads);
+  double build_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - build_start_time)
+          .count();
+  // From here on the keys are only probed by lookups.
+  keys_file.advise(AccessAdvice::kRandom);
+
+  index.reset_last_mile_search_count();
+  auto workload_start_time = std::chrono::high_resolution_clock::now();
+  for (K key : test_workload) {
+    if (!index.get_value(key)) {
+      exit(1);
+    }
+  }
+  double workload_time =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - workload_start_time)
+          .count();
+  int64_t num_last_mile_search = index.get_last_mile_search_count();
+
+  // Second, untimed pass: sort the lookups by the tier that serves them and
+  // sample the latency of each tier.
+  LatencyRecorder hot_latency;
+  LatencyRecorder cold_latency;
+  int64_t num_hot_lookups = 0;
+  for (K key : test_workload) {
+    bool hot = index.is_hot_key(key);
+    num_hot_lookups += hot;
+    LatencyRecorder& latency = hot ? hot_latency : cold_latency;
+    if (!latency.measure([&]() { return index.get_value(key); })) {
+      exit(1);
+    }
+  }
+
+  // Output the model size, build and workload time, last-mile searches, the
+  // hot tier's size in keys and KiB, the share of lookups it served, then
+  // the latency columns of the hot tier and of the cold RMI.
+  int model_size = sizeof(index);  //bytes
+  size_t tier_size = index.hot_key_count();
+  std::cout << model_size << "\t" << build_time / 1e9 << "\t"
+            << workload_time / 1e9 << "\t" << num_last_mile_search << "\t"
+            << tier_size << "\t"
+            << tier_size * HotTier<K, V>::kEntryBytes / 1024.0 << "\t"
+            << static_cast<double>(num_hot_lookups) / test_workload_size;
+  write_latency_columns(std::cout, hot_latency);
+  write_latency_columns(std::cout, cold_latency);
+  std::cout << std::endl;
+}
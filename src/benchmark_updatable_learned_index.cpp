@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "latency_recorder.h"
+#include "sosd_file.h"
+#include "updatable_learned_index.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Mixed read/write replay on UpdatableLearnedIndex. The index is built over
+// the keys at even positions; writes insert the keys at odd positions in
+// random order, and reads look up random keys of the initial set. For every
+// write ratio the index is rebuilt and `num_operations` operations are run.
+// Each line holds the write ratio, the overall throughput, the insert and the
+// lookup throughput (all in M operations/s; each operation is timed with the
+// time-stamp counter), the number of segments after the run and the number of
+// segment expansions, splits and retrains during it.
+int main(int argc, char** argv) {
+  if (argc < 5 || argc > 6) {
+    std::cout << "Incorrect usage." << std::endl;
+    exit(1);
+  }
+
+  int num_second_level_models = atoi(argv[1]);
+  std::string keys_file_path = std::string(argv[2]);
+  int64_t num_records = atoll(argv[3]);
+  int64_t num_operations = atoll(argv[4]);
+  // Optional: comma-separated write ratios.
+  std::vector<double> write_ratios;
+  std::stringstream ratios(argc > 5 ? argv[5] : "0,0.1,0.5,0.9");
+  for (std::string ratio; std::getline(ratios, ratio, ',');) {
+    write_ratios.push_back(atof(ratio.c_str()));
+  }
+
+  // Map the keys file. Keys follow the SOSD 8-byte record count header.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
+    std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
+    return 0;
+  }
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::mt19937_64 gen(std::random_device{}());
+  std::vector<std::pair<K, V>> initial_records;
+  std::vector<std::pair<K, V>> insert_records;
+  for (int64_t i = 0; i < num_records; i++) {
+    (i % 2 == 0 ? initial_records : insert_records)
+        .emplace_back(keys[i], static_cast<V>(gen()));
+  }
+  const LatencyTimerCalibration& calibration = latency_timer_calibration();
+
+  for (double write_ratio : write_ratios) {
+    UpdatableLearnedIndex<K, V> index(initial_records);
+    index.build(num_second_level_models);
+    std::shuffle(insert_records.begin(), insert_records.end(), gen);
+    std::bernoulli_distribution is_write(write_ratio);
+    std::uniform_int_distribution<size_t> read_dist(
+        0, initial_records.size() - 1);
+
+    size_t num_inserts = 0;
+    size_t num_lookups = 0;
+    uint64_t insert_ticks = 0;
+    uint64_t lookup_ticks = 0;
+    for (int64_t op = 0; op < num_operations; op++) {
+      if (is_write(gen) && num_inserts < insert_records.size()) {
+        const auto& record = insert_records[num_inserts++];
+        uint64_t begin = latency_timer_begin();
+        index.insert(record.first, record.second);
+        insert_ticks += latency_timer_end() - begin;
+      } else {
+        K key = initial_records[read_dist(gen)].first;
+        uint64_t begin = latency_timer_begin();
+        const V* payload = index.get_value(key);
+        lookup_ticks += latency_timer_end() - begin;
+        if (!payload) {
+          exit(1);
+        }
+        num_lookups++;
+      }
+    }
+    insert_ticks -= std::min(insert_ticks,
+                             num_inserts * calibration.overhead_ticks);
+    lookup_ticks -= std::min(lookup_ticks,
+                             num_lookups * calibration.overhead_ticks);
+
+    // Operations per tick, times ticks per ns, is operations per ns, or
+    // 1e3 M operations per second.
+    auto throughput = [&](size_t count, uint64_t ticks) {
+      return ticks > 0 ? count * calibration.ticks_per_ns / ticks * 1e3 : 0;
+    };
+    auto stats = index.get_update_stats();
+    std::cout << write_ratio << "\t"
+              << throughput(num_inserts + num_lookups,
+                            insert_ticks + lookup_ticks)
+              << "\t" << throughput(num_inserts, insert_ticks) << "\t"
+              << throughput(num_lookups, lookup_ticks) << "\t"
+              << index.num_segments() << "\t" << stats.expansions << "\t"
+              << stats.splits << "\t" << stats.retrains << std::endl;
+  }
+}
@@ -1,30 +1,27 @@
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
-#include <fstream>
 #include <iostream>
 #include <random>
+#include <tuple>
 
+#include "latency_recorder.h"
 #include "weighted_learned_index.h"
+#include "perf_counters.h"
+#include "sosd_file.h"
 
 #define K uint64_t
 #define V int64_t
 
-std::vector<K> read_workload(std::string workload_path, int wl_size) {
-  auto workload_data = new K[wl_size];
-  std::ifstream is_workload(workload_path.c_str(), std::ios::binary | std::ios::in);
-    
-  is_workload.read(reinterpret_cast<char*>(workload_data),
-          std::streamsize(wl_size * sizeof(K)));
-  is_workload.close();
-
-  std::vector<K> ret_workload(wl_size);
-  for (int i = 0; i < wl_size; i++) {
-    ret_workload[i] = workload_data[i];
-  }
-  return ret_workload;
-}
+// Built with -DSPLIT_STORAGE for the structure-of-arrays record layout.
+#ifdef SPLIT_STORAGE
+#define STORAGE SplitStorage<K, V>
+#else
+#define STORAGE PairStorage<K, V>
+#endif
 
 int main(int argc, char** argv) {
-  if (argc != 7) {
+  if (argc != 7 && argc != 8) {
     std::cout << "Incorrect usage." << std::endl;
     exit(1);
   }
@@ -34,59 +31,76 @@ int main(int argc, char** argv) {
   std::string weights_file_path = std::string(argv[3]);
   std::string test_workload_file_path = std::string(argv[4]);
   //int num_records = 200000000;
-  int num_records = atoi(argv[5]);
+  int64_t num_records = atoll(argv[5]);
   //int workload_size = 100000;;
-  int test_workload_size = atoi(argv[6]);
+  int64_t test_workload_size = atoll(argv[6]);
+  // Optional: number of threads used to build the index.
+  int num_build_threads = argc == 8 ? atoi(argv[7]) : 1;
         
-  // Read keys from file. Keys are in random order (not sorted).
-  auto keys = new K[num_records];
-  std::ifstream is(keys_file_path.c_str(), std::ios::binary | std::ios::in);
-  if (!is.is_open()) {
+  // Map the keys file. Keys follow the SOSD 8-byte record count header and
+  // are used in place; the mapping must outlive the index.
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  if (!keys_file.is_open()) {
     std::cout << "Run `sh download.sh` to download the keys file" << std::endl;
     return 0;
   }
-  is.read(reinterpret_cast<char*>(keys),
-          std::streamsize(num_records * sizeof(K)));
-  is.close();
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Keys file holds fewer than " << num_records << " keys"
+              << std::endl;
+    exit(1);
+  }
 
-  // Read weights generated from workload
-  auto weights = new double[num_records];
-  std::ifstream is_weight(weights_file_path.c_str(), std::ios::binary | std::ios::in);
-  if (!is_weight.is_open()) {
+  // Map the weights generated from the workload. The file has no header;
+  // weights[i] is the weight of the i-th key.
+  MappedFile weights_file(weights_file_path, AccessAdvice::kSequential);
+  if (!weights_file.is_open()) {
     std::cout << "Run `python generate_workflow` then `convert_workload_to_weights` to generate weights" << std::endl;
     return 0;
   }
-        
-  is_weight.read(reinterpret_cast<char*>(weights),
-          std::streamsize(num_records * sizeof(double)));
-  is_weight.close();
-    
-  // Combine loaded keys with randomly generated values
-  std::vector<std::tuple<K, V, double>> data(num_records);
+  Span<double> weights = raw_array<double>(weights_file, num_records);
+  if (static_cast<int64_t>(weights.size()) != num_records) {
+    std::cout << "Weights file holds fewer than " << num_records << " weights"
+              << std::endl;
+    exit(1);
+  }
+
+  // Generate random payloads for the keys
+  std::vector<V> values(num_records);
   std::mt19937_64 gen_payload(std::random_device{}());
-  for (int i = 0; i < num_records; i++) {
-    std::get<0>(data[i]) = keys[i];
-    std::get<1>(data[i]) = static_cast<V>(gen_payload());
-    std::get<2>(data[i]) = weights[i];
+  for (int64_t i = 0; i < num_records; i++) {
+    values[i] = static_cast<V>(gen_payload());
   }
-  delete[] keys;
-  delete[] weights;
 
-  // read test workload
-  std::vector<K> test_workload = read_workload(test_workload_file_path, test_workload_size);
+  // Map the workload file
+  MappedFile workload_file(test_workload_file_path, AccessAdvice::kSequential);
+  Span<K> test_workload = raw_array<K>(workload_file, test_workload_size);
+  if (static_cast<int64_t>(test_workload.size()) != test_workload_size) {
+    std::cout << "Workload file holds fewer than " << test_workload_size
+              << " keys" << std::endl;
+    exit(1);
+  }
 
   // Build index index
   /*
   std::cout << "Building learned index with " << num_second_level_models
             << " second level models..." << std::endl;
   */
-  WLearnedIndex<K, V> index(data);
+  WLearnedIndex<K, V, STORAGE> index(keys, std::move(values), weights);
+  // Hardware counters of the build and of the lookups; see perf_counters.h.
+  PerfCounters perf_counters;
+  perf_counters.start();
   auto build_start_time = std::chrono::high_resolution_clock::now();
-  index.build(num_second_level_models);
+  index.build(num_second_level_models, num_build_threads);
   double build_time =
       std::chrono::duration_cast<std::chrono::nanoseconds>(
           std::chrono::high_resolution_clock::now() - build_start_time)
           .count();
+  PhaseCounters build_counters = perf_counters.stop(num_records);
+  // The weights are only read by the build; unmap them.
+  weights_file = MappedFile();
+  // From here on the keys are only probed by lookups.
+  keys_file.advise(AccessAdvice::kRandom);
 
   // Run workload using learned index
   /*
@@ -111,9 +125,12 @@ int main(int argc, char** argv) {
             << " seconds, proof of work: " << sum << std::endl;
   */
   index.reset_last_mile_search_count();
+  // Sampled per-lookup latencies; see latency_recorder.h.
+  LatencyRecorder latency;
+  perf_counters.start();
   auto workload_start_time = std::chrono::high_resolution_clock::now();
   for (K key: test_workload) {
-    const V* payload = index.get_value(key);
+    const V* payload = latency.measure([&]() { return index.get_value(key); });
     if (!payload) {
       exit(1);
     }
@@ -122,8 +139,13 @@ int main(int argc, char** argv) {
       std::chrono::duration_cast<std::chrono::nanoseconds>(
           std::chrono::high_resolution_clock::now() - workload_start_time)
           .count();
-  int num_last_mile_search = index.get_last_mile_search_count();
+  PhaseCounters lookup_counters = perf_counters.stop(test_workload_size);
+  int64_t num_last_mile_search = index.get_last_mile_search_count();
   
   int model_size = sizeof(index);  //bytes
-  std::cout << model_size << "\t" << build_time / 1e9 << "\t" << workload_time / 1e9 << "\t" << num_last_mile_search << std::endl;
+  std::cout << model_size << "\t" << build_time / 1e9 << "\t" << workload_time / 1e9 << "\t" << num_last_mile_search;
+  write_latency_columns(std::cout, latency);
+  write_perf_columns(std::cout, build_counters);
+  write_perf_columns(std::cout, lookup_counters);
+  std::cout << std::endl;
 }
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "index_file.h"
+#include "last_mile_search.h"
+#include "record_storage.h"
+#include "sharded_counter.h"
+#include "span.h"
+
+/* Lookups over a two-level RMI whose parameters were fixed at compile time.
+ *
+ * rmi_codegen.h exports a trained LearnedIndex as a header that defines a
+ * parameter struct like
+ *
+ *   struct Rmi {
+ *     static constexpr double kRootSlope = ...;
+ *     static constexpr double kRootIntercept = ...;
+ *     static constexpr int64_t kNumModels = ...;
+ *     static constexpr int64_t kNumRecords = ...;
+ *     static constexpr uint64_t kDataFingerprint = ...;
+ *     static constexpr bool kAnyExponentialSearch = ...;
+ *     alignas(64) static constexpr CompiledLeaf kLeaves[kNumModels] = {...};
+ *   };
+ *
+ * CompiledLearnedIndex<Rmi, ...> performs the same lookup (with the same
+ * fused multiply-add rounding) as LearnedIndex::get_value, but the root
+ * model, the number of models and the number of records are immediates, the
+ * clamps fold into constants, and the leaf table is a static array instead of
+ * two heap-allocated vectors. If no leaf uses exponential search, the
+ * strategy branch is compiled out.
+ */
+
+// One second-level model with its error bound, packed into 32 bytes so that
+// a lookup touches a single cache line of the leaf table.
+struct CompiledLeaf {
+  double slope;
+  double intercept;
+  int32_t min_error;
+  int32_t max_error;
+  SearchStrategy strategy;
+};
+
+template <class Rmi, class K, class V, class Storage = PairStorage<K, V>>
+class CompiledLearnedIndex {
+  static_assert(Rmi::kNumModels > 0, "The RMI needs at least one leaf.");
+
+ public:
+  typedef std::pair<K, V> record;
+
+  // The records must be the ones the RMI was trained on (see matches_data).
+  CompiledLearnedIndex(std::vector<record> data) : data_(std::move(data)) {}
+  CompiledLearnedIndex(Span<K> keys, std::vector<V> values)
+      : data_(keys, std::move(values)) {}
+
+  // Return true if the records have the size and fingerprint of the data the
+  // RMI was exported from. Lookups over other data return wrong results.
+  bool matches_data() const {
+    return static_cast<int64_t>(data_.size()) == Rmi::kNumRecords &&
+           data_fingerprint(data_) == Rmi::kDataFingerprint;
+  }
+
+  // If the key exists, return a pointer to the corresponding value in data_.
+  // If the key does not exist, return a nullptr.
+  V* get_value(K key) {
+    int64_t leaf_index = static_cast<int64_t>(std::fma(
+        Rmi::kRootSlope, static_cast<double>(key), Rmi::kRootIntercept));
+    leaf_index = std::min<int64_t>(std::max<int64_t>(leaf_index, 0),
+                                   Rmi::kNumModels - 1);
+    const CompiledLeaf& leaf = Rmi::kLeaves[leaf_index];
+
+    int64_t predicted_index = static_cast<int64_t>(
+        std::fma(leaf.slope, static_cast<double>(key), leaf.intercept));
+    predicted_index = std::min<int64_t>(std::max<int64_t>(predicted_index, 0),
+                                        Rmi::kNumRecords - 1);
+    if (data_.key(predicted_index) == key) {
+      return data_.value(predicted_index);
+    }
+    last_mile_search_count_.add(1);
+
+    int64_t start_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + leaf.min_error, 0),
+        Rmi::kNumRecords);
+    int64_t end_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + leaf.max_error + 1, 0),
+        Rmi::kNumRecords);
+    int64_t pos;
+    if (Rmi::kAnyExponentialSearch &&
+        leaf.strategy == SearchStrategy::kExponential &&
+        start_search < end_search) {
+      predicted_index = std::min(std::max(predicted_index, start_search),
+                                 end_search - 1);
+      pos = exponential_search(data_, key, predicted_index, start_search,
+                               end_search);
+    } else {
+      pos = data_.lower_bound(key, start_search, end_search);
+    }
+    if (pos >= Rmi::kNumRecords || data_.key(pos) != key) {
+      return nullptr;
+    }
+    return data_.value(pos);
+  }
+
+  int64_t get_last_mile_search_count() {
+    return last_mile_search_count_.load();
+  }
+
+  void reset_last_mile_search_count() {
+    last_mile_search_count_.reset();
+  }
+
+ private:
+  Storage data_;
+  ShardedCounter last_mile_search_count_;
+};
@@ -0,0 +1,46 @@
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+#include "learned_index.h"
+#include "rmi_codegen.h"
+#include "sosd_file.h"
+
+#define K uint64_t
+#define V int64_t
+
+// Train a LearnedIndex on a SOSD key file and export it as a C++ header for
+// CompiledLearnedIndex (see compiled_rmi.h and rmi_codegen.h).
+int main(int argc, char** argv) {
+  if (argc != 5 && argc != 6) {
+    std::cout << "Usage: export_learned_index num_second_level_models "
+                 "keys_file num_records output_header [struct_name]"
+              << std::endl;
+    exit(1);
+  }
+
+  int num_second_level_models = atoi(argv[1]);
+  std::string keys_file_path = std::string(argv[2]);
+  int64_t num_records = atoll(argv[3]);
+  std::string output_path = std::string(argv[4]);
+  std::string struct_name =
+      argc == 6 ? std::string(argv[5]) : "CompiledRmiParams";
+
+  MappedFile keys_file(keys_file_path, AccessAdvice::kSequential);
+  Span<K> keys = sosd_keys<K>(keys_file, num_records);
+  if (static_cast<int64_t>(keys.size()) != num_records) {
+    std::cout << "Could not read " << num_records << " keys from "
+              << keys_file_path << std::endl;
+    exit(1);
+  }
+
+  // Payloads do not affect the models.
+  LearnedIndex<K, V> index(keys, std::vector<V>(num_records));
+  index.build(num_second_level_models);
+
+  std::ofstream os(output_path);
+  if (!export_rmi_header(index, struct_name, os)) {
+    std::cout << "Could not export the index to " << output_path << std::endl;
+    exit(1);
+  }
+}
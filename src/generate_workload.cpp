@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parallel_build.h"
+#include "sosd_file.h"
+#include "utils/cxxopts.hpp"
+
+/* Generate a Zipf lookup workload over a SOSD key file and the matching
+ * per-key weights, in the formats of generate_workloads.py and
+ * convert_workload_tobinary.py:
+ *
+ *  - the distinct keys are ranked by their number of occurrences in the key
+ *    file (most frequent first, ties in key order) and the key of rank r is
+ *    drawn with probability proportional to r^-alpha;
+ *  - the workload file is a raw array of the drawn uint64 keys;
+ *  - the weights file holds one double per record of the key file: the
+ *    number of lookups of its key plus one, divided by the largest such value.
+ *
+ * With --phases P > 1 the hotspot shifts: the workload is split into P equal
+ * phases and in phase p the ranking is rotated by p * (number of distinct
+ * keys) / P, so every phase has a different set of hot keys.
+ *
+ * Ranks are drawn from an alias table in chunks of kChunkSize lookups. Every
+ * chunk has its own random generator seeded from --seed and the chunk number,
+ * so the output only depends on the seed and not on the number of threads.
+ * Chunks are generated by all threads in rounds and written in order, so
+ * memory use does not grow with the workload size.
+ */
+
+constexpr size_t kChunkSize = size_t(1) << 20;
+// Lookups of the hottest ranks are counted per thread, since a shared counter
+// for them would be contended by all threads.
+constexpr size_t kNumThreadLocalRanks = 4096;
+
+// Vose's alias method: sample(rng) returns i with probability
+// weights[i] / sum(weights) in constant time.
+class AliasTable {
+ public:
+  explicit AliasTable(std::vector<double> weights)
+      : prob_(std::move(weights)), alias_(prob_.size()) {
+    size_t n = prob_.size();
+    assert(n > 0 && n <= UINT32_MAX);
+    double sum = 0;
+    for (double weight : prob_) {
+      sum += weight;
+    }
+    // Small entries (scaled weight below 1) are stacked from the front of
+    // `work`, large ones from the back; every step removes one entry.
+    std::vector<uint32_t> work(n);
+    size_t num_small = 0;
+    size_t num_large = 0;
+    for (size_t i = 0; i < n; i++) {
+      prob_[i] *= n / sum;
+      if (prob_[i] < 1) {
+        work[num_small++] = i;
+      } else {
+        work[n - ++num_large] = i;
+      }
+    }
+    while (num_small > 0 && num_large > 0) {
+      uint32_t small = work[--num_small];
+      uint32_t large = work[n - num_large--];
+      alias_[small] = large;
+      prob_[large] = (prob_[large] + prob_[small]) - 1;
+      if (prob_[large] < 1) {
+        work[num_small++] = large;
+      } else {
+        work[n - ++num_large] = large;
+      }
+    }
+    // What is left has a scaled weight of 1 up to rounding.
+    while (num_small > 0) {
+      uint32_t i = work[--num_small];
+      prob_[i] = 1;
+      alias_[i] = i;
+    }
+    while (num_large > 0) {
+      uint32_t i = work[n - num_large--];
+      prob_[i] = 1;
+      alias_[i] = i;
+    }
+  }
+
+  template <class Rng>
+  uint64_t sample(Rng& rng) const {
+    uint64_t column = static_cast<uint64_t>(
+        (static_cast<unsigned __int128>(rng()) * prob_.size()) >> 64);
+    double coin = (rng() >> 11) * 0x1.0p-53;
+    return coin < prob_[column] ? column : alias_[column];
+  }
+
+ private:
+  std::vector<double> prob_;
+  std::vector<uint32_t> alias_;
+};
+
+uint64_t splitmix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Format alpha like Python's str(float), which names the Python outputs.
+std::string alpha_string(double alpha) {
+  std::ostringstream os;
+  os << alpha;
+  std::string s = os.str();
+  return s.find_first_of(".e") == std::string::npos ? s + ".0" : s;
+}
+
+std::string base_name(const std::string& path) {
+  size_t slash = path.find_last_of('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Distinct keys of the sorted `keys` ranked by decreasing number of
+// occurrences, ties in key order. Keys are grouped with a counting sort on
+// their occurrence counts, which keeps the ranking stable and only needs the
+// output array.
+class FrequencyRanking {
+ public:
+  explicit FrequencyRanking(Span<uint64_t> keys) : keys_(keys) {
+    std::map<uint64_t, uint64_t, std::greater<uint64_t>> num_keys_by_count;
+    for_each_run([&](uint64_t, uint64_t count) { num_keys_by_count[count]++; });
+    uint64_t start = 0;
+    for (const auto& entry : num_keys_by_count) {
+      group_starts_[entry.first] = start;
+      start += entry.second;
+    }
+    ranked_keys_.resize(start);
+    for_each_ranked_run([&](uint64_t key, uint64_t, uint64_t rank) {
+      ranked_keys_[rank] = key;
+    });
+  }
+
+  size_t num_distinct_keys() const { return ranked_keys_.size(); }
+  uint64_t key(uint64_t rank) const { return ranked_keys_[rank]; }
+
+  // Call fn(key, count, rank) for every run of equal keys in key order.
+  template <class Fn>
+  void for_each_ranked_run(Fn fn) const {
+    std::map<uint64_t, uint64_t, std::greater<uint64_t>> next = group_starts_;
+    for_each_run([&](uint64_t key, uint64_t count) {
+      fn(key, count, next[count]++);
+    });
+  }
+
+ private:
+  template <class Fn>
+  void for_each_run(Fn fn) const {
+    for (size_t i = 0; i < keys_.size();) {
+      size_t end = i + 1;
+      while (end < keys_.size() && keys_[end] == keys_[i]) {
+        end++;
+      }
+      fn(keys_[i], end - i);
+      i = end;
+    }
+  }
+
+  Span<uint64_t> keys_;
+  // First rank of the keys that occur `count` times, by count.
+  std::map<uint64_t, uint64_t, std::greater<uint64_t>> group_starts_;
+  std::vector<uint64_t> ranked_keys_;
+};
+
+int main(int argc, char** argv) {
+  cxxopts::Options options(
+      "generate_workload",
+      "Generate a Zipf lookup workload and its per-key weights");
+  options.add_options()
+      ("d,dataset", "SOSD key file", cxxopts::value<std::string>())
+      ("s,size", "Number of lookups", cxxopts::value<uint64_t>())
+      ("a,alpha", "Zipf exponent",
+       cxxopts::value<double>()->default_value("2"))
+      ("o,output", "Directory of the workload file",
+       cxxopts::value<std::string>()->default_value("workloads"))
+      ("w,weights", "Directory of the weights file (empty: no weights)",
+       cxxopts::value<std::string>()->default_value("weights"))
+      ("phases", "Number of hotspot phases (1: static Zipf)",
+       cxxopts::value<uint64_t>()->default_value("1"))
+      ("seed", "Random seed", cxxopts::value<uint64_t>()->default_value("0"))
+      ("threads", "Number of sampling threads",
+       cxxopts::value<int>()->default_value("1"))
+      ("help", "Print usage");
+  auto args = options.parse(argc, argv);
+  if (args.count("help") || !args.count("dataset") || !args.count("size")) {
+    std::cout << options.help() << std::endl;
+    exit(args.count("help") ? 0 : 1);
+  }
+  std::string dataset_path = args["dataset"].as<std::string>();
+  uint64_t workload_size = args["size"].as<uint64_t>();
+  double alpha = args["alpha"].as<double>();
+  std::string weights_dir = args["weights"].as<std::string>();
+  uint64_t num_phases = std::max<uint64_t>(args["phases"].as<uint64_t>(), 1);
+  uint64_t seed = args["seed"].as<uint64_t>();
+  int num_threads = std::max(args["threads"].as<int>(), 1);
+  if (!(alpha > 0) || workload_size >= UINT32_MAX) {
+    std::cout << "alpha must be positive and the size below 2^32" << std::endl;
+    exit(1);
+  }
+
+  // Same names as generate_workloads.py; shifting hotspots add the phases.
+  std::string workload_name =
+      base_name(dataset_path) + "_workload" +
+      std::to_string(workload_size / 1000) + "k_alpha" + alpha_string(alpha);
+  if (num_phases > 1) {
+    workload_name += "_phases" + std::to_string(num_phases);
+  }
+  std::string workload_path =
+      args["output"].as<std::string>() + "/" + workload_name;
+
+  MappedFile dataset_file(dataset_path, AccessAdvice::kSequential);
+  Span<uint64_t> header = raw_array<uint64_t>(dataset_file, 1);
+  if (header.empty()) {
+    std::cout << "Could not read " << dataset_path << std::endl;
+    exit(1);
+  }
+  Span<uint64_t> keys = sosd_keys<uint64_t>(dataset_file, header[0]);
+  if (keys.size() != header[0] || keys.empty()) {
+    std::cout << dataset_path << " is not a SOSD key file" << std::endl;
+    exit(1);
+  }
+
+  FrequencyRanking ranking(keys);
+  uint64_t num_ranks = ranking.num_distinct_keys();
+  std::vector<double> rank_weights(num_ranks);
+  for (uint64_t r = 0; r < num_ranks; r++) {
+    rank_weights[r] = std::pow(static_cast<double>(r + 1), -alpha);
+  }
+  AliasTable alias_table(std::move(rank_weights));
+
+  // Lookups per ranked key. The hottest ranks of every phase are counted in
+  // per-thread arrays that are added in at the end.
+  std::vector<std::atomic<uint32_t>> lookups(num_ranks);
+  size_t num_local_ranks = std::min<uint64_t>(kNumThreadLocalRanks, num_ranks);
+  std::vector<std::vector<uint32_t>> local_lookups(
+      num_threads, std::vector<uint32_t>(num_phases * num_local_ranks, 0));
+  // Phase p covers lookups [phase_start(p), phase_start(p + 1)).
+  auto phase_start = [&](uint64_t phase) {
+    return static_cast<uint64_t>(
+        (static_cast<unsigned __int128>(phase) * workload_size + num_phases -
+         1) / num_phases);
+  };
+  auto phase_shift = [&](uint64_t phase) {
+    return static_cast<uint64_t>(
+        static_cast<unsigned __int128>(phase) * num_ranks / num_phases);
+  };
+
+  std::ofstream workload_file(workload_path, std::ios::binary);
+  if (!workload_file) {
+    std::cout << "Could not write " << workload_path << std::endl;
+    exit(1);
+  }
+  uint64_t num_chunks = (workload_size + kChunkSize - 1) / kChunkSize;
+  std::vector<std::vector<uint64_t>> buffers(num_threads);
+  for (uint64_t first_chunk = 0; first_chunk < num_chunks;
+       first_chunk += num_threads) {
+    uint64_t round_chunks =
+        std::min<uint64_t>(num_threads, num_chunks - first_chunk);
+    parallel_chunks(round_chunks, round_chunks,
+                    [&](size_t thread, size_t begin, size_t) {
+      uint64_t chunk = first_chunk + begin;
+      uint64_t start = chunk * kChunkSize;
+      uint64_t end = std::min<uint64_t>(start + kChunkSize, workload_size);
+      std::mt19937_64 rng(splitmix64(seed ^ splitmix64(chunk)));
+      std::vector<uint64_t>& buffer = buffers[begin];
+      std::vector<uint32_t>& local = local_lookups[thread];
+      buffer.resize(end - start);
+      uint64_t phase = static_cast<uint64_t>(
+          static_cast<unsigned __int128>(start) * num_phases / workload_size);
+      uint64_t next_phase_start = phase_start(phase + 1);
+      uint64_t shift = phase_shift(phase);
+      for (uint64_t i = start; i < end; i++) {
+        if (i == next_phase_start) {
+          phase++;
+          next_phase_start = phase_start(phase + 1);
+          shift = phase_shift(phase);
+        }
+        uint64_t rank = alias_table.sample(rng);
+        uint64_t shifted = (rank + shift) % num_ranks;
+        if (rank < num_local_ranks) {
+          local[phase * num_local_ranks + rank]++;
+        } else {
+          lookups[shifted].fetch_add(1, std::memory_order_relaxed);
+        }
+        buffer[i - start] = ranking.key(shifted);
+      }
+    });
+    for (uint64_t c = 0; c < round_chunks; c++) {
+      workload_file.write(reinterpret_cast<const char*>(buffers[c].data()),
+                          buffers[c].size() * sizeof(uint64_t));
+    }
+  }
+  workload_file.close();
+  if (workload_file.fail()) {
+    std::cout << "Could not write " << workload_path << std::endl;
+    exit(1);
+  }
+  std::cout << workload_path << std::endl;
+  if (weights_dir.empty()) {
+    return 0;
+  }
+
+  for (const std::vector<uint32_t>& local : local_lookups) {
+    for (uint64_t phase = 0; phase < num_phases; phase++) {
+      for (uint64_t rank = 0; rank < num_local_ranks; rank++) {
+        lookups[(rank + phase_shift(phase)) % num_ranks].fetch_add(
+            local[phase * num_local_ranks + rank], std::memory_order_relaxed);
+      }
+    }
+  }
+  uint32_t max_lookups = 0;
+  for (const auto& count : lookups) {
+    max_lookups = std::max(max_lookups, count.load(std::memory_order_relaxed));
+  }
+
+  // One weight per record, streamed in key order.
+  std::string weights_path = weights_dir + "/" + workload_name;
+  std::ofstream weights_file(weights_path, std::ios::binary);
+  if (!weights_file) {
+    std::cout << "Could not write " << weights_path << std::endl;
+    exit(1);
+  }
+  std::vector<double> weights;
+  weights.reserve(kChunkSize);
+  ranking.for_each_ranked_run([&](uint64_t, uint64_t count, uint64_t rank) {
+    double weight = (lookups[rank].load(std::memory_order_relaxed) + 1.0) /
+                    (max_lookups + 1.0);
+    for (uint64_t i = 0; i < count; i++) {
+      weights.push_back(weight);
+    }
+    if (weights.size() >= kChunkSize) {
+      weights_file.write(reinterpret_cast<const char*>(weights.data()),
+                         weights.size() * sizeof(double));
+      weights.clear();
+    }
+  });
+  weights_file.write(reinterpret_cast<const char*>(weights.data()),
+                     weights.size() * sizeof(double));
+  weights_file.close();
+  if (weights_file.fail()) {
+    std::cout << "Could not write " << weights_path << std::endl;
+    exit(1);
+  }
+  std::cout << weights_path << std::endl;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "key_hash.h"
+
+/* Flat open-addressing hash table for the hot keys of
+ * LookUpTableLearnedIndex.
+ *
+ * Slots are grouped in buckets of 16. Each bucket has 16 one-byte tags, and
+ * the tags of all buckets are packed together (four buckets per cache line)
+ * apart from the (key, payload) entries. A key's hash selects its home bucket
+ * and a 7-bit tag; a lookup compares the 16 tags of a bucket with one SIMD
+ * byte compare and only reads the entries whose tag matches. Buckets are
+ * probed linearly and a bucket with an empty slot ends the probe, since
+ * entries are never removed.
+ *
+ * A miss therefore usually reads one line of tags, which stay cache-resident
+ * (2 KiB for a thousand keys, 16 KiB for ten thousand), and a hit one more
+ * line for the entry. The payload is stored next to the key, so a hit needs
+ * no access to the indexed records. The table is sized for a load of at most
+ * 7/8, which puts the entries of a thousand 8-byte keys and payloads (32 KiB)
+ * in L1 and of ten thousand (256 KiB) in L2.
+ *
+ * The record position of every entry is kept in a separate array that
+ * payload lookups never touch (it is used to save the table, and by the
+ * adaptive index to read payloads from its records).
+ */
+template <class K, class V>
+class HotKeyTable {
+  static_assert(std::is_arithmetic<K>::value && sizeof(K) <= 8,
+                "Hot key table keys must be numeric and at most 8 bytes.");
+
+  static constexpr size_t kBucketSlots = 16;
+
+  // 0 marks an empty slot; tags of used slots have their top bit set.
+  struct alignas(kBucketSlots) BucketTags {
+    uint8_t tags[kBucketSlots];
+  };
+  struct Entry {
+    K key;
+    V value;
+  };
+
+ public:
+  HotKeyTable() { clear(); }
+
+  // Remove all keys and size the table for `expected_size` keys.
+  void clear(size_t expected_size = 0) {
+    resize(num_buckets_for(expected_size));
+  }
+
+  size_t size() const { return size_; }
+  // Bytes of the tags and entries, which is what lookups touch.
+  size_t table_bytes() const {
+    return tags_.size() * sizeof(BucketTags) + entries_.size() * sizeof(Entry);
+  }
+
+  // Bytes of a table cleared for `expected_size` keys.
+  static size_t table_bytes_for(size_t expected_size) {
+    return num_buckets_for(expected_size) *
+           (sizeof(BucketTags) + kBucketSlots * sizeof(Entry));
+  }
+
+  // Insert `key` with its payload and record position. Return false, leaving
+  // the table unchanged, if the key is already in it.
+  bool insert(K key, V value, int64_t position) {
+    if (find(key) != nullptr) {
+      return false;
+    }
+    if ((size_ + 1) * 8 > entries_.size() * 7) {
+      grow();
+    }
+    place(key, value, position);
+    return true;
+  }
+
+  // Return a pointer to the payload of `key`, or nullptr if it is not in the
+  // table.
+  V* find(K key) {
+    return const_cast<V*>(static_cast<const HotKeyTable*>(this)->find(key));
+  }
+  const V* find(K key) const {
+    int64_t slot = find_slot(key);
+    return slot == -1 ? nullptr : &entries_[slot].value;
+  }
+
+  // Return the record position of `key`, or -1 if it is not in the table.
+  int64_t position_of(K key) const {
+    int64_t slot = find_slot(key);
+    return slot == -1 ? -1 : positions_[slot];
+  }
+
+  // Call fn(key, position) for every key in the table.
+  template <class Fn>
+  void for_each(Fn fn) const {
+    for (size_t b = 0; b < tags_.size(); b++) {
+      for (size_t slot = 0; slot < kBucketSlots; slot++) {
+        if (tags_[b].tags[slot] != 0) {
+          fn(entries_[b * kBucketSlots + slot].key,
+             positions_[b * kBucketSlots + slot]);
+        }
+      }
+    }
+  }
+
+ private:
+  static uint64_t hash_key(K key) { return hash_key_bits(key); }
+
+  // Return the slot of `key`, or -1 if it is not in the table.
+  int64_t find_slot(K key) const {
+    uint64_t hash = hash_key(key);
+    uint8_t tag = tag_of(hash);
+    for (size_t b = hash & bucket_mask_;; b = (b + 1) & bucket_mask_) {
+      for (uint32_t matches = match_tags(tags_[b], tag); matches != 0;
+           matches &= matches - 1) {
+        size_t slot = b * kBucketSlots + __builtin_ctz(matches);
+        if (entries_[slot].key == key) {
+          return slot;
+        }
+      }
+      if (match_tags(tags_[b], 0) != 0) {
+        return -1;
+      }
+    }
+  }
+
+  // Smallest power-of-two number of buckets that holds `expected_size` keys
+  // at a load of at most 7/8.
+  static size_t num_buckets_for(size_t expected_size) {
+    size_t num_buckets = 1;
+    while (num_buckets * kBucketSlots * 7 < expected_size * 8) {
+      num_buckets *= 2;
+    }
+    return num_buckets;
+  }
+
+  // The home bucket uses the low bits of the hash, the tag its top 7 bits.
+  static uint8_t tag_of(uint64_t hash) {
+    return static_cast<uint8_t>(0x80 | (hash >> 57));
+  }
+
+  // Bitmask of the slots of a bucket whose tag equals `tag`.
+  static uint32_t match_tags(const BucketTags& bucket, uint8_t tag) {
+#if defined(__SSE2__)
+    __m128i tags =
+        _mm_load_si128(reinterpret_cast<const __m128i*>(bucket.tags));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(tag))));
+#else
+    uint32_t matches = 0;
+    for (size_t slot = 0; slot < kBucketSlots; slot++) {
+      matches |= uint32_t(bucket.tags[slot] == tag) << slot;
+    }
+    return matches;
+#endif
+  }
+
+  void resize(size_t num_buckets) {
+    tags_.assign(num_buckets, BucketTags());
+    entries_.assign(num_buckets * kBucketSlots, Entry());
+    positions_.assign(num_buckets * kBucketSlots, -1);
+    bucket_mask_ = num_buckets - 1;
+    size_ = 0;
+  }
+
+  void place(K key, V value, int64_t position) {
+    uint64_t hash = hash_key(key);
+    for (size_t b = hash & bucket_mask_;; b = (b + 1) & bucket_mask_) {
+      uint32_t empty = match_tags(tags_[b], 0);
+      if (empty != 0) {
+        size_t slot = __builtin_ctz(empty);
+        tags_[b].tags[slot] = tag_of(hash);
+        entries_[b * kBucketSlots + slot] = {key, value};
+        positions_[b * kBucketSlots + slot] = position;
+        size_++;
+        return;
+      }
+    }
+  }
+
+  void grow() {
+    std::vector<BucketTags> old_tags = std::move(tags_);
+    std::vector<Entry> old_entries = std::move(entries_);
+    std::vector<int64_t> old_positions = std::move(positions_);
+    resize(old_tags.size() * 2);
+    for (size_t b = 0; b < old_tags.size(); b++) {
+      for (size_t slot = 0; slot < kBucketSlots; slot++) {
+        if (old_tags[b].tags[slot] != 0) {
+          const Entry& entry = old_entries[b * kBucketSlots + slot];
+          place(entry.key, entry.value,
+                old_positions[b * kBucketSlots + slot]);
+        }
+      }
+    }
+  }
+
+  std::vector<BucketTags> tags_;
+  std::vector<Entry> entries_;
+  std::vector<int64_t> positions_;
+  size_t bucket_mask_ = 0;
+  size_t size_ = 0;
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "last_mile_search.h"
+#include "linear_model.h"
+#include "span.h"
+
+/* Sorted hot tier of LookUpTableLearnedIndex (see build_tiered()).
+ *
+ * The hot keys are kept in a small sorted array with their payloads in a
+ * parallel array, and a linear model over the array predicts where a key
+ * sits. A lookup searches the model's error window and returns the payload,
+ * so a hot hit touches only the tier. The record positions are kept apart
+ * for saving the index.
+ */
+template <class K, class V>
+class HotTier {
+ public:
+  struct Entry {
+    K key;
+    V value;
+    int64_t position;
+  };
+
+  // Bytes a lookup may touch per hot key: the key and its payload.
+  static constexpr size_t kEntryBytes = sizeof(K) + sizeof(V);
+
+  // Replace the tier by `entries`, whose keys must be distinct.
+  void build(std::vector<Entry> entries) {
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.key < b.key; });
+    keys_.resize(entries.size());
+    values_.resize(entries.size());
+    positions_.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+      keys_[i] = entries[i].key;
+      values_[i] = entries[i].value;
+      positions_[i] = entries[i].position;
+    }
+    model_ = LinearModel<K>();
+    model_.train([this](auto&& add) {
+      for (size_t i = 0; i < keys_.size(); i++) {
+        add(keys_[i], i);
+      }
+    });
+    ErrorBoundTracker error_tracker;
+    for (size_t i = 0; i < keys_.size(); i++) {
+      error_tracker.add(static_cast<int64_t>(i) - predict_clamped(keys_[i]));
+    }
+    error_bound_ = error_tracker.finish();
+  }
+
+  void clear() { build({}); }
+
+  bool empty() const { return keys_.empty(); }
+  size_t size() const { return keys_.size(); }
+  size_t size_bytes() const { return keys_.size() * kEntryBytes; }
+
+  // Return a pointer to the payload of `key`, or nullptr if it is not in the
+  // tier.
+  V* find(K key) {
+    if (keys_.empty()) {
+      return nullptr;
+    }
+    int64_t num_keys = keys_.size();
+    int64_t predicted_pos = predict_clamped(key);
+    int64_t start_pos = std::min<int64_t>(
+        std::max<int64_t>(predicted_pos + error_bound_.min_error, 0),
+        num_keys);
+    int64_t end_pos = std::min<int64_t>(
+        std::max<int64_t>(predicted_pos + error_bound_.max_error + 1, 0),
+        num_keys);
+    size_t pos = lower_bound(key, start_pos, end_pos);
+    if (pos >= static_cast<size_t>(end_pos) || keys_[pos] != key) {
+      return nullptr;
+    }
+    return &values_[pos];
+  }
+
+  // Call fn(key, position) for every key in the tier.
+  template <class Fn>
+  void for_each(Fn fn) const {
+    for (size_t i = 0; i < keys_.size(); i++) {
+      fn(keys_[i], positions_[i]);
+    }
+  }
+
+  // Return the first position in [start_pos, end_pos) whose key is not less
+  // than `key` (or end_pos). The windows are short and in cache, so the
+  // search is branchless: a mispredicted branch costs more than a probe.
+  size_t lower_bound(K key, size_t start_pos, size_t end_pos) const {
+    if (start_pos >= end_pos) {
+      return end_pos;
+    }
+    const K* base = keys_.data() + start_pos;
+    size_t n = end_pos - start_pos;
+    while (n > 1) {
+      size_t half = n / 2;
+      base = base[half] < key ? base + half : base;
+      n -= half;
+    }
+    return (base - keys_.data()) + (*base < key);
+  }
+
+ private:
+  int64_t predict_clamped(K key) const {
+    return std::min<int64_t>(std::max<int64_t>(model_.predict(key), 0),
+                             static_cast<int64_t>(keys_.size()) - 1);
+  }
+
+  std::vector<K> keys_;
+  std::vector<V> values_;
+  std::vector<int64_t> positions_;
+  LinearModel<K> model_;
+  ErrorBound error_bound_;
+};
+
+// Pick the number of hot keys from the weight curve: the fewest heaviest
+// records that carry `coverage` of the lookups, but no more than fit in
+// `cache_budget_bytes` at `entry_bytes` each. The lookups of a record are
+// estimated by its weight in excess of the smallest weight, since the weights
+// of generate_workload and convert_workload_tobinary.py are proportional to
+// the lookup count plus one.
+inline size_t choose_hot_tier_size(Span<double> weights,
+                                   size_t cache_budget_bytes,
+                                   size_t entry_bytes, double coverage) {
+  size_t max_size = std::min(cache_budget_bytes / entry_bytes, weights.size());
+  if (max_size == 0) {
+    return 0;
+  }
+  double min_weight = *std::min_element(weights.begin(), weights.end());
+  double total_excess = 0;
+  for (double weight : weights) {
+    total_excess += weight - min_weight;
+  }
+  if (total_excess <= 0) {
+    return 0;
+  }
+
+  // Min-heap of the max_size largest weights.
+  std::vector<double> heaviest;
+  heaviest.reserve(max_size);
+  for (double weight : weights) {
+    if (heaviest.size() < max_size) {
+      heaviest.push_back(weight);
+      std::push_heap(heaviest.begin(), heaviest.end(), std::greater<double>());
+    } else if (weight > heaviest.front()) {
+      std::pop_heap(heaviest.begin(), heaviest.end(), std::greater<double>());
+      heaviest.back() = weight;
+      std::push_heap(heaviest.begin(), heaviest.end(), std::greater<double>());
+    }
+  }
+  std::sort(heaviest.begin(), heaviest.end(), std::greater<double>());
+
+  double covered = 0;
+  for (size_t size = 0; size < heaviest.size(); size++) {
+    if (heaviest[size] <= min_weight || covered >= coverage * total_excess) {
+      return size;
+    }
+    covered += heaviest[size] - min_weight;
+  }
+  return heaviest.size();
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "last_mile_search.h"
+#include "sosd_file.h"
+#include "span.h"
+
+/* On-disk format shared by the save()/load() methods of the learned indexes.
+ *
+ * A file is a fixed-size header followed by sections, each starting on a
+ * 64-byte boundary so that a mapped file can be read in place:
+ *
+ *   IndexFileHeader  magic, format version, index kind, key size, number of
+ *                    records and a fingerprint of the indexed keys, then a
+ *                    table of (id, offset, size, checksum) for every section
+ *                    and a checksum of the header itself
+ *   sections         root model, leaf models, error bounds, hot-key table,
+ *                    the pivot keys of a radix root; a RecursiveModelIndex
+ *                    stores its levels and their model parameters instead of
+ *                    the root and leaf models
+ *
+ * Only the models are stored, not the records: an index is loaded on top of
+ * the same sorted keys it was built from (e.g., a mapped SOSD file), and the
+ * fingerprint rejects files built over other data. Every section carries a
+ * checksum, so truncated or corrupted files are rejected as well. Integers
+ * and doubles are stored in the native byte order.
+ */
+
+constexpr char kIndexFileMagic[8] = {'L', 'R', 'N', 'D', 'I', 'D', 'X', '\0'};
+// Bump whenever the layout of the header or of any section changes, or a
+// section is added that older readers would silently skip. Version 2 added
+// the kLevels, kModelParameters and kRootPivots sections.
+constexpr uint32_t kIndexFileVersion = 2;
+constexpr size_t kIndexFileAlignment = 64;
+constexpr size_t kMaxIndexFileSections = 8;
+
+enum class IndexKind : uint32_t {
+  kLearnedIndex = 1,
+  kLookUpTableLearnedIndex = 2,
+  kRecursiveModelIndex = 3,
+};
+
+enum class SectionId : uint32_t {
+  kRootModel = 1,
+  kLeafModels = 2,
+  kErrorBounds = 3,
+  kHotTable = 4,
+  kLevels = 5,
+  kModelParameters = 6,
+  kRootPivots = 7,
+};
+
+struct SectionEntry {
+  SectionId id;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+  uint64_t checksum;
+};
+
+struct IndexFileHeader {
+  char magic[8];
+  uint32_t version;
+  IndexKind kind;
+  uint32_t key_size;
+  uint32_t num_sections;
+  uint64_t num_records;
+  uint64_t data_fingerprint;
+  SectionEntry sections[kMaxIndexFileSections];
+  // Checksum of all the bytes above.
+  uint64_t header_checksum;
+};
+
+// Section payloads. A model is its slope and intercept; an error bound keeps
+// its strategy in a full word so that every record is 8-byte aligned.
+struct StoredModel {
+  double slope;
+  double intercept;
+};
+
+struct StoredErrorBound {
+  int64_t min_error;
+  int64_t max_error;
+  uint64_t strategy;
+};
+
+// A level of a RecursiveModelIndex: the model family (its kModelId) and the
+// number of models. Their parameters follow level by level in the
+// kModelParameters section.
+struct StoredLevel {
+  uint64_t model_id;
+  uint64_t num_models;
+};
+
+template <class K>
+struct StoredHotKey {
+  K key;
+  int64_t position;
+};
+
+template <class Model>
+std::vector<StoredModel> store_models(const std::vector<Model>& models) {
+  std::vector<StoredModel> stored(models.size());
+  for (size_t i = 0; i < models.size(); i++) {
+    stored[i] = {models[i].m_, models[i].b_};
+  }
+  return stored;
+}
+
+template <class Model>
+std::vector<Model> restore_models(Span<StoredModel> stored) {
+  std::vector<Model> models(stored.size());
+  for (size_t i = 0; i < stored.size(); i++) {
+    models[i].m_ = stored[i].slope;
+    models[i].b_ = stored[i].intercept;
+  }
+  return models;
+}
+
+inline std::vector<StoredErrorBound> store_error_bounds(
+    const std::vector<ErrorBound>& bounds) {
+  std::vector<StoredErrorBound> stored(bounds.size());
+  for (size_t i = 0; i < bounds.size(); i++) {
+    stored[i] = {bounds[i].min_error, bounds[i].max_error,
+                 static_cast<uint64_t>(bounds[i].strategy)};
+  }
+  return stored;
+}
+
+// Return false if a stored bound is not valid.
+inline bool restore_error_bounds(Span<StoredErrorBound> stored,
+                                 std::vector<ErrorBound>* bounds) {
+  bounds->resize(stored.size());
+  for (size_t i = 0; i < stored.size(); i++) {
+    if (stored[i].min_error > stored[i].max_error ||
+        stored[i].strategy >
+            static_cast<uint64_t>(SearchStrategy::kExponential)) {
+      return false;
+    }
+    (*bounds)[i].min_error = stored[i].min_error;
+    (*bounds)[i].max_error = stored[i].max_error;
+    (*bounds)[i].strategy = static_cast<SearchStrategy>(stored[i].strategy);
+  }
+  return true;
+}
+
+// FNV-1a over 64-bit words (and the trailing bytes one at a time), which
+// checks a large section at memory speed.
+inline uint64_t index_file_checksum(const void* data, size_t size) {
+  const uint64_t kPrime = 0x100000001b3ULL;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  const char* bytes = static_cast<const char*>(data);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * kPrime;
+  }
+  for (; i < size; i++) {
+    hash = (hash ^ static_cast<unsigned char>(bytes[i])) * kPrime;
+  }
+  return hash;
+}
+
+// Fingerprint of the sorted keys in `data`: the record count and an evenly
+// spaced sample of keys, including the first and the last one.
+template <class Storage>
+uint64_t data_fingerprint(const Storage& data) {
+  constexpr size_t kNumSamples = 64;
+  uint64_t hash = index_file_checksum(nullptr, 0);
+  size_t n = data.size();
+  hash = (hash ^ n) * 0x100000001b3ULL;
+  for (size_t i = 0; n > 0 && i <= kNumSamples; i++) {
+    auto key = data.key(std::min(n - 1, i * (n - 1) / kNumSamples));
+    hash ^= index_file_checksum(&key, sizeof(key));
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Collects sections in memory, then writes the whole file at once.
+class IndexFileWriter {
+ public:
+  IndexFileWriter(IndexKind kind, uint32_t key_size, uint64_t num_records,
+                  uint64_t fingerprint) {
+    std::memset(&header_, 0, sizeof(header_));
+    std::memcpy(header_.magic, kIndexFileMagic, sizeof(header_.magic));
+    header_.version = kIndexFileVersion;
+    header_.kind = kind;
+    header_.key_size = key_size;
+    header_.num_records = num_records;
+    header_.data_fingerprint = fingerprint;
+  }
+
+  template <class T>
+  void add_section(SectionId id, const std::vector<T>& items) {
+    assert(header_.num_sections < kMaxIndexFileSections);
+    size_t size = items.size() * sizeof(T);
+    SectionEntry& entry = header_.sections[header_.num_sections++];
+    entry.id = id;
+    entry.offset = align(sizeof(IndexFileHeader) + body_.size());
+    entry.size = size;
+    entry.checksum = index_file_checksum(items.data(), size);
+    body_.resize(entry.offset - sizeof(IndexFileHeader) + size, 0);
+    if (size > 0) {
+      std::memcpy(&body_[entry.offset - sizeof(IndexFileHeader)], items.data(),
+                  size);
+    }
+  }
+
+  // Return false if the file could not be written.
+  bool write(const std::string& path) {
+    header_.header_checksum =
+        index_file_checksum(&header_, offsetof(IndexFileHeader, header_checksum));
+    std::ofstream os(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    os.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    os.write(body_.data(), body_.size());
+    os.close();
+    return !os.fail();
+  }
+
+ private:
+  static size_t align(size_t offset) {
+    return (offset + kIndexFileAlignment - 1) / kIndexFileAlignment *
+           kIndexFileAlignment;
+  }
+
+  IndexFileHeader header_;
+  std::vector<char> body_;
+};
+
+// Maps an index file and validates it against the index that loads it.
+class IndexFileReader {
+ public:
+  // Return false unless `path` is an intact index file of the given kind and
+  // key size, built over data with the given record count and fingerprint.
+  bool open(const std::string& path, IndexKind kind, uint32_t key_size,
+            uint64_t num_records, uint64_t fingerprint) {
+    file_ = MappedFile(path, AccessAdvice::kSequential);
+    if (!file_.is_open() || file_.size() < sizeof(IndexFileHeader)) {
+      return false;
+    }
+    std::memcpy(&header_, file_.data(), sizeof(header_));
+    if (std::memcmp(header_.magic, kIndexFileMagic, sizeof(header_.magic)) !=
+            0 ||
+        header_.version != kIndexFileVersion ||
+        header_.header_checksum !=
+            index_file_checksum(&header_,
+                                offsetof(IndexFileHeader, header_checksum))) {
+      return false;
+    }
+    if (header_.kind != kind || header_.key_size != key_size ||
+        header_.num_records != num_records ||
+        header_.data_fingerprint != fingerprint ||
+        header_.num_sections > kMaxIndexFileSections) {
+      return false;
+    }
+    for (uint32_t i = 0; i < header_.num_sections; i++) {
+      const SectionEntry& entry = header_.sections[i];
+      if (entry.offset % kIndexFileAlignment != 0 ||
+          entry.offset > file_.size() ||
+          entry.size > file_.size() - entry.offset ||
+          entry.checksum !=
+              index_file_checksum(file_.data() + entry.offset, entry.size)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // View of the items of a section, or an empty span if the file has no such
+  // section or its size is not a whole number of items.
+  template <class T>
+  Span<T> section(SectionId id) const {
+    for (uint32_t i = 0; i < header_.num_sections; i++) {
+      const SectionEntry& entry = header_.sections[i];
+      if (entry.id == id && entry.size % sizeof(T) == 0) {
+        return Span<T>(reinterpret_cast<const T*>(file_.data() + entry.offset),
+                       entry.size / sizeof(T));
+      }
+    }
+    return Span<T>();
+  }
+
+  bool has_section(SectionId id) const {
+    for (uint32_t i = 0; i < header_.num_sections; i++) {
+      if (header_.sections[i].id == id) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  MappedFile file_;
+  IndexFileHeader header_;
+};
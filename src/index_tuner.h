@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "linear_model.h"
+#include "rmi_models.h"
+#include "span.h"
+
+/* Cost-model tuner for the number of second-level models and the hot-key
+ * table size (LearnedIndex::build_tuned, LookUpTableLearnedIndex::
+ * build_tuned), in the spirit of CDFShop: instead of building every
+ * configuration, it estimates the lookup cost of each candidate from cheap
+ * statistics and builds only the one it picks.
+ *
+ * The statistics come from one pass over the records. Every `stride`-th
+ * record is sampled together with the lookup weight of the block of
+ * `stride` records it starts, and prefix sums over the sample give the
+ * least-squares fit of any run of sampled records in constant time. For a
+ * candidate number of models M, the root model (fit on the sample) splits
+ * the sample into runs, one per second-level model; each run is fit from the
+ * prefix sums and its last-mile window is estimated from the spread of the
+ * sampled errors plus the stride, for the records between the samples.
+ *
+ * The estimated cost of a lookup in nanoseconds is then
+ *
+ *   table probe + (1 - hot share) * (root + model fetch + record fetch
+ *                                    + probe cost * E[log2(window + 1)])
+ *
+ * where the table probe and the model fetch cost the latency of the cache
+ * level that holds the table and the models (CacheCostModel), the hot share
+ * is the share of the lookups that the table's heaviest keys carry, and the
+ * expectation is over the lookups the table misses. Every candidate also has
+ * a memory footprint (models, error bounds and table), and the tuner picks
+ * the cheapest candidate of the cost/memory Pareto frontier that fits the
+ * memory budget. The estimates rank configurations; they do not predict
+ * absolute times.
+ */
+
+// Latencies of the memory hierarchy as seen by a random access.
+struct CacheCostModel {
+  size_t l1_bytes = 32 << 10;
+  size_t l2_bytes = 1 << 20;
+  size_t l3_bytes = 16 << 20;
+  double l1_ns = 1;
+  double l2_ns = 4;
+  double l3_ns = 15;
+  double dram_ns = 80;
+  // One probe of a last-mile search. Most probes hit lines that the probes
+  // before them or the hardware prefetcher brought in, so this is well below
+  // a DRAM access.
+  double probe_ns = 8;
+
+  // The default latencies with the cache sizes of this machine, where the
+  // C library reports them.
+  static CacheCostModel detect() {
+    CacheCostModel model;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    model.l1_bytes = l1 > 0 ? l1 : model.l1_bytes;
+    model.l2_bytes = l2 > 0 ? l2 : model.l2_bytes;
+    model.l3_bytes = l3 > 0 ? l3 : model.l3_bytes;
+#endif
+    return model;
+  }
+
+  // Latency of a random access into a structure of `bytes` bytes that the
+  // lookups keep warm.
+  double access_ns(size_t bytes) const {
+    if (bytes <= l1_bytes) {
+      return l1_ns;
+    }
+    if (bytes <= l2_bytes) {
+      return l2_ns;
+    }
+    if (bytes <= l3_bytes) {
+      return l3_ns;
+    }
+    return dram_ns;
+  }
+};
+
+struct TunerOptions {
+  // Largest footprint of the models, error bounds and hot-key table.
+  size_t memory_budget_bytes = 1 << 20;
+  std::vector<size_t> model_counts = {100,   300,    1000,   3000,   10000,
+                                      30000, 100000, 300000, 1000000};
+  // Hot-key table sizes; only used by LookUpTableLearnedIndex, and only
+  // with weights.
+  std::vector<size_t> table_sizes = {0, 1000, 10000, 100000};
+  // Number of records sampled for the statistics.
+  size_t sample_size = 1 << 20;
+  CacheCostModel cache = CacheCostModel::detect();
+};
+
+struct TunerCandidate {
+  size_t num_models = 0;
+  size_t table_size = 0;
+  size_t memory_bytes = 0;
+  // Estimated share of the lookups served by the hot-key table.
+  double hot_share = 0;
+  // Estimated mean of log2(window + 1) over the other lookups.
+  double log2_window = 0;
+  // Estimated lookup cost in nanoseconds.
+  double cost_ns = 0;
+};
+
+struct TunerResult {
+  // The candidates on the cost/memory Pareto frontier, by increasing memory
+  // (and so decreasing cost).
+  std::vector<TunerCandidate> frontier;
+  // Index into `frontier` of the built configuration: the cheapest one
+  // within the budget, or the smallest if none fits.
+  size_t chosen = 0;
+  size_t num_candidates = 0;
+
+  // The frontier is only empty when there are no records.
+  const TunerCandidate& chosen_candidate() const {
+    assert(!frontier.empty());
+    return frontier[chosen];
+  }
+};
+
+// Estimate every candidate configuration over `num_records` sorted records,
+// whose keys key_at(pos) returns, and return the Pareto frontier.
+// `weights` holds the lookup weight of every record (empty: uniform
+// lookups), `record_bytes`, `model_bytes` and table_bytes(size) the sizes of
+// a record, of one second-level model with its error bound, and of a hot-key
+// table of `size` keys. Model counts above `num_records` are clamped to it,
+// and one model without a table is tried if no option applies, so the
+// frontier is never empty when there are records.
+template <class K, class KeyAt, class TableBytes>
+TunerResult tune_index(size_t num_records, KeyAt key_at, Span<double> weights,
+                       size_t record_bytes, size_t model_bytes,
+                       TableBytes table_bytes, const TunerOptions& options) {
+  TunerResult result;
+  if (num_records == 0) {
+    return result;
+  }
+  const CacheCostModel& cache = options.cache;
+  size_t stride = std::max<size_t>(
+      1, (num_records + options.sample_size - 1) /
+             std::max<size_t>(options.sample_size, 1));
+  size_t num_samples = (num_records + stride - 1) / stride;
+
+  // The lookups of a record are estimated by its weight in excess of the
+  // smallest weight, as in choose_hot_tier_size.
+  double min_weight = 0;
+  double total_excess = 0;
+  if (!weights.empty()) {
+    min_weight = *std::min_element(weights.begin(), weights.end());
+    for (double weight : weights) {
+      total_excess += weight - min_weight;
+    }
+  }
+  bool weighted = total_excess > 0;
+  auto lookups_of = [&](size_t pos) {
+    return weighted ? weights[pos] - min_weight : 1.0;
+  };
+
+  // Sample keys, block lookup shares and prefix sums of the least-squares
+  // terms, with keys measured from the smallest key.
+  std::vector<K> sample_keys(num_samples);
+  std::vector<double> block_lookups(num_samples, 0);
+  std::vector<double> sum_x(num_samples + 1, 0);
+  std::vector<double> sum_y(num_samples + 1, 0);
+  std::vector<double> sum_xx(num_samples + 1, 0);
+  std::vector<double> sum_xy(num_samples + 1, 0);
+  K origin = key_at(0);
+  for (size_t i = 0; i < num_samples; i++) {
+    size_t pos = i * stride;
+    sample_keys[i] = key_at(pos);
+    for (size_t j = pos; j < std::min(pos + stride, num_records); j++) {
+      block_lookups[i] += lookups_of(j);
+    }
+    double x = key_offset(sample_keys[i], origin);
+    double y = static_cast<double>(pos);
+    sum_x[i + 1] = sum_x[i] + x;
+    sum_y[i + 1] = sum_y[i] + y;
+    sum_xx[i + 1] = sum_xx[i] + x * x;
+    sum_xy[i + 1] = sum_xy[i] + x * y;
+  }
+
+  // Heaviest records for the hot-key tables: hot_lookups[t] is the lookup
+  // share of the t heaviest records, hot_blocks[t] the sample block of the
+  // t-th heaviest.
+  size_t max_table_size = 0;
+  if (weighted) {
+    for (size_t table_size : options.table_sizes) {
+      max_table_size = std::max(max_table_size, table_size);
+    }
+  }
+  max_table_size = std::min(max_table_size, num_records);
+  std::vector<std::pair<double, size_t>> heaviest;
+  heaviest.reserve(max_table_size);
+  auto lighter = std::greater<std::pair<double, size_t>>();
+  for (size_t pos = 0; pos < num_records && max_table_size > 0; pos++) {
+    std::pair<double, size_t> item(lookups_of(pos), pos);
+    if (heaviest.size() < max_table_size) {
+      heaviest.push_back(item);
+      std::push_heap(heaviest.begin(), heaviest.end(), lighter);
+    } else if (item > heaviest.front()) {
+      std::pop_heap(heaviest.begin(), heaviest.end(), lighter);
+      heaviest.back() = item;
+      std::push_heap(heaviest.begin(), heaviest.end(), lighter);
+    }
+  }
+  std::sort(heaviest.begin(), heaviest.end(), lighter);
+
+  std::vector<size_t> model_counts;
+  for (size_t num_models : options.model_counts) {
+    model_counts.push_back(
+        std::min(std::max<size_t>(num_models, 1), num_records));
+  }
+  if (model_counts.empty()) {
+    model_counts.push_back(1);
+  }
+  std::sort(model_counts.begin(), model_counts.end());
+  model_counts.erase(std::unique(model_counts.begin(), model_counts.end()),
+                     model_counts.end());
+  std::vector<size_t> table_sizes;
+  for (size_t table_size : options.table_sizes) {
+    if (table_size <= max_table_size && (table_size == 0 || weighted)) {
+      table_sizes.push_back(table_size);
+    }
+  }
+  if (table_sizes.empty()) {
+    table_sizes.push_back(0);
+  }
+  double total_lookups = 0;
+  for (double lookups : block_lookups) {
+    total_lookups += lookups;
+  }
+
+  LinearModel<K> root;
+  root.train([&](auto&& add) {
+    for (size_t i = 0; i < num_samples; i++) {
+      add(sample_keys[i], i * stride);
+    }
+  });
+
+  std::vector<TunerCandidate> candidates;
+  for (size_t num_models : model_counts) {
+    // Runs of samples per second-level model, with the estimated
+    // log2(window + 1) of each.
+    LinearModel<K> scaled_root = root;
+    scaled_root.rescale(static_cast<double>(num_models) / num_records);
+    auto model_of = [&](K key) {
+      return std::min<int64_t>(std::max<int64_t>(scaled_root.predict(key), 0),
+                               num_models - 1);
+    };
+    std::vector<size_t> run_starts;
+    std::vector<double> run_log2_windows;
+    for (size_t begin = 0; begin < num_samples;) {
+      int64_t model = model_of(sample_keys[begin]);
+      size_t end = begin + 1;
+      while (end < num_samples && model_of(sample_keys[end]) == model) {
+        end++;
+      }
+      double n = end - begin;
+      double sx = sum_x[end] - sum_x[begin];
+      double sy = sum_y[end] - sum_y[begin];
+      double sxx = sum_xx[end] - sum_xx[begin];
+      double sxy = sum_xy[end] - sum_xy[begin];
+      double denominator = n * sxx - sx * sx;
+      double slope = denominator > 0 ? (n * sxy - sx * sy) / denominator : 0;
+      double intercept = (sy - slope * sx) / n;
+      int64_t min_error = 0;
+      int64_t max_error = 0;
+      for (size_t i = begin; i < end; i++) {
+        int64_t predicted = static_cast<int64_t>(
+            slope * key_offset(sample_keys[i], origin) + intercept);
+        predicted = std::min<int64_t>(std::max<int64_t>(predicted, 0),
+                                      num_records - 1);
+        int64_t error = static_cast<int64_t>(i * stride) - predicted;
+        min_error = i == begin ? error : std::min(min_error, error);
+        max_error = i == begin ? error : std::max(max_error, error);
+      }
+      run_starts.push_back(begin);
+      run_log2_windows.push_back(
+          std::log2(static_cast<double>(max_error - min_error + stride)));
+      begin = end;
+    }
+    run_starts.push_back(num_samples);
+
+    for (size_t table_size : table_sizes) {
+      // Lookups that miss the table, per sample block.
+      std::vector<double> cold_lookups = block_lookups;
+      double hot_lookups = 0;
+      for (size_t t = 0; t < table_size; t++) {
+        cold_lookups[heaviest[t].second / stride] -= heaviest[t].first;
+        hot_lookups += heaviest[t].first;
+      }
+      double expected_log2_window = 0;
+      double total_cold = 0;
+      for (size_t run = 0; run + 1 < run_starts.size(); run++) {
+        double run_lookups = 0;
+        for (size_t i = run_starts[run]; i < run_starts[run + 1]; i++) {
+          run_lookups += std::max(cold_lookups[i], 0.0);
+        }
+        expected_log2_window += run_lookups * run_log2_windows[run];
+        total_cold += run_lookups;
+      }
+
+      TunerCandidate candidate;
+      candidate.num_models = num_models;
+      candidate.table_size = table_size;
+      size_t models_bytes = num_models * model_bytes;
+      size_t hot_table_bytes = table_size > 0 ? table_bytes(table_size) : 0;
+      candidate.memory_bytes = models_bytes + hot_table_bytes;
+      candidate.hot_share = total_lookups > 0 ? hot_lookups / total_lookups : 0;
+      candidate.log2_window =
+          total_cold > 0 ? expected_log2_window / total_cold : 0;
+      candidate.cost_ns =
+          (table_size > 0 ? cache.access_ns(hot_table_bytes) : 0) +
+          (1 - candidate.hot_share) *
+              (cache.l1_ns + cache.access_ns(models_bytes) +
+               cache.access_ns(num_records * record_bytes) +
+               cache.probe_ns * candidate.log2_window);
+      candidates.push_back(candidate);
+    }
+  }
+  result.num_candidates = candidates.size();
+  if (candidates.empty()) {
+    return result;
+  }
+
+  // Pareto frontier: by increasing memory, keep every candidate that is
+  // cheaper than all smaller ones.
+  std::sort(candidates.begin(), candidates.end(),
+            [](const TunerCandidate& a, const TunerCandidate& b) {
+              return a.memory_bytes != b.memory_bytes
+                         ? a.memory_bytes < b.memory_bytes
+                         : a.cost_ns < b.cost_ns;
+            });
+  for (const TunerCandidate& candidate : candidates) {
+    if (result.frontier.empty() ||
+        candidate.cost_ns < result.frontier.back().cost_ns) {
+      result.frontier.push_back(candidate);
+    }
+  }
+  for (size_t i = 0; i < result.frontier.size(); i++) {
+    if (result.frontier[i].memory_bytes <= options.memory_budget_bytes) {
+      result.chosen = i;
+    }
+  }
+  return result;
+}
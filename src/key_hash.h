@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Hash the bits of a numeric key with the 64-bit MurmurHash3 finalizer. Every
+// output bit depends on every key bit, so callers may use any bit range of
+// the result. Shared by the hash tables and filters over index keys.
+template <class K>
+uint64_t hash_key_bits(K key) {
+  static_assert(std::is_arithmetic<K>::value && sizeof(K) <= 8,
+                "Keys must be numbers of at most 8 bytes.");
+  // +0.0 and -0.0 compare equal, so they must hash alike.
+  if (key == K(0)) {
+    key = K(0);
+  }
+  uint64_t bits = 0;
+  std::memcpy(&bits, &key, sizeof(K));
+  bits ^= bits >> 33;
+  bits *= 0xff51afd7ed558ccdULL;
+  bits ^= bits >> 33;
+  bits *= 0xc4ceb9fe1a85ec53ULL;
+  bits ^= bits >> 33;
+  return bits;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/* Per-segment error bounds and last-mile search strategies shared by the
+ * learned indexes.
+ *
+ * For every second-level model we record the signed prediction errors
+ * (true position - predicted position) as a [min_error, max_error] range, so
+ * the last-mile window is [predicted + min_error, predicted + max_error] and
+ * is no wider than the errors actually observed on each side.
+ *
+ * The window is then searched with one of two strategies:
+ *  - binary search over the whole window, which costs ~log2(window) probes no
+ *    matter how good the prediction was;
+ *  - exponential (galloping) search outward from the prediction, which costs
+ *    ~2 * log2(|error| + 1) probes and wins when most errors are small even
+ *    though a few outliers make the window wide.
+ * The strategy is picked per segment at build time from the error
+ * distribution of its keys.
+ */
+
+enum class SearchStrategy : uint8_t { kBinary, kExponential };
+
+struct ErrorBound {
+  int64_t min_error = 0;
+  int64_t max_error = 0;
+  SearchStrategy strategy = SearchStrategy::kBinary;
+};
+
+// Accumulates the signed errors of one second-level model during build() and
+// turns them into an ErrorBound.
+class ErrorBoundTracker {
+ public:
+  void add(int64_t error) {
+    if (count_ == 0) {
+      min_error_ = error;
+      max_error_ = error;
+    } else {
+      min_error_ = std::min(min_error_, error);
+      max_error_ = std::max(max_error_, error);
+    }
+    count_++;
+    uint64_t magnitude = static_cast<uint64_t>(error < 0 ? -error : error);
+    galloping_probes_ += 2 * bit_width(magnitude) + 1;
+  }
+
+  // Add the errors that `other` accumulated, e.g., on another build thread.
+  void merge(const ErrorBoundTracker& other) {
+    if (other.count_ == 0) {
+      return;
+    }
+    if (count_ == 0) {
+      min_error_ = other.min_error_;
+      max_error_ = other.max_error_;
+    } else {
+      min_error_ = std::min(min_error_, other.min_error_);
+      max_error_ = std::max(max_error_, other.max_error_);
+    }
+    count_ += other.count_;
+    galloping_probes_ += other.galloping_probes_;
+  }
+
+  ErrorBound finish() const {
+    ErrorBound bound;
+    if (count_ == 0) {
+      return bound;
+    }
+    bound.min_error = min_error_;
+    bound.max_error = max_error_;
+    // Compare the expected probe count of galloping from the prediction with
+    // the probe count of a binary search over the full window.
+    double binary_probes =
+        bit_width(static_cast<uint64_t>(max_error_ - min_error_ + 1));
+    double expected_galloping_probes =
+        static_cast<double>(galloping_probes_) / count_;
+    if (expected_galloping_probes < binary_probes) {
+      bound.strategy = SearchStrategy::kExponential;
+    }
+    return bound;
+  }
+
+ private:
+  static unsigned bit_width(uint64_t x) {
+    return x == 0 ? 0 : 64 - __builtin_clzll(x);
+  }
+
+  int64_t min_error_ = 0;
+  int64_t max_error_ = 0;
+  size_t count_ = 0;
+  uint64_t galloping_probes_ = 0;
+};
+
+// Return the first position in [start_pos, end_pos) whose key is not less than
+// `key` (or end_pos), galloping outward from `pos`, which must lie in
+// [start_pos, end_pos).
+template <class Storage, class K>
+size_t exponential_search(const Storage& data, K key, size_t pos,
+                          size_t start_pos, size_t end_pos) {
+  if (data.key(pos) < key) {
+    // Gallop right until a key that is not less than `key` bounds the result.
+    size_t lo = pos + 1;
+    size_t step = 1;
+    size_t hi = pos + step;
+    while (hi < end_pos && data.key(hi) < key) {
+      lo = hi + 1;
+      step <<= 1;
+      hi = pos + step;
+    }
+    return data.lower_bound(key, lo, std::min(hi, end_pos));
+  }
+  // Gallop left until a key that is less than `key` bounds the result.
+  size_t hi = pos;
+  size_t step = 1;
+  while (step <= pos - start_pos && !(data.key(pos - step) < key)) {
+    hi = pos - step;
+    step <<= 1;
+  }
+  size_t lo = step <= pos - start_pos ? pos - step + 1 : start_pos;
+  return data.lower_bound(key, lo, hi);
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* Per-lookup latency measurement for the benchmark drivers.
+ *
+ * Timing every lookup with two std::chrono::high_resolution_clock calls (as
+ * SOSD's measure_each does) costs more than a learned-index lookup itself and
+ * writing every sample to a file makes long workloads unwieldy. Instead, a
+ * LatencyRecorder times one lookup out of every `sample_period` with the
+ * time-stamp counter and adds it to a log-bucketed histogram in memory, from
+ * which the tail percentiles are read at the end of the run.
+ */
+
+// Time-stamp counter reads, fenced so that the timed lookup cannot be
+// reordered around them. Without a time-stamp counter, they return
+// nanoseconds of a steady clock.
+inline uint64_t latency_timer_begin() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_lfence();
+  uint64_t time = __rdtsc();
+  _mm_lfence();
+  return time;
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+inline uint64_t latency_timer_end() {
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int aux;
+  uint64_t time = __rdtscp(&aux);
+  _mm_lfence();
+  return time;
+#else
+  return latency_timer_begin();
+#endif
+}
+
+// Timer ticks per nanosecond and the smallest tick count of an empty
+// measurement, measured once per process (about 20 ms).
+struct LatencyTimerCalibration {
+  double ticks_per_ns;
+  uint64_t overhead_ticks;
+};
+
+inline const LatencyTimerCalibration& latency_timer_calibration() {
+  static const LatencyTimerCalibration calibration = []() {
+    LatencyTimerCalibration result;
+    auto start_time = std::chrono::steady_clock::now();
+    uint64_t start_ticks = latency_timer_begin();
+    while (std::chrono::steady_clock::now() - start_time <
+           std::chrono::milliseconds(20)) {
+    }
+    uint64_t end_ticks = latency_timer_end();
+    double elapsed_ns = std::chrono::duration<double, std::nano>(
+                            std::chrono::steady_clock::now() - start_time)
+                            .count();
+    result.ticks_per_ns = (end_ticks - start_ticks) / elapsed_ns;
+    result.overhead_ticks = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+      uint64_t begin = latency_timer_begin();
+      result.overhead_ticks =
+          std::min(result.overhead_ticks, latency_timer_end() - begin);
+    }
+    return result;
+  }();
+  return calibration;
+}
+
+// HDR-style histogram of 64-bit values: values below 2^kSubBucketBits have
+// their own bucket, larger values fall in buckets whose width is at most
+// 1/64 of their lower bound, so percentiles are within 1.6% of the exact
+// ones. The maximum is tracked exactly.
+class LatencyHistogram {
+ public:
+  static constexpr int kSubBucketBits = 7;
+
+  LatencyHistogram() : counts_(kNumBuckets, 0) {}
+
+  void record(uint64_t value) {
+    counts_[bucket_index(value)]++;
+    count_++;
+    max_ = std::max(max_, value);
+  }
+
+  void merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < kNumBuckets; i++) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t max() const { return max_; }
+
+  // The value below which a fraction q of the recorded values fall (the
+  // midpoint of its bucket), or 0 if nothing was recorded.
+  uint64_t percentile(double q) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(
+        static_cast<uint64_t>(std::ceil(q * count_)), 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        int shift = bucket_shift(i);
+        uint64_t low = (i - (static_cast<uint64_t>(shift) << kHalfBits))
+                       << shift;
+        uint64_t mid = low + ((uint64_t(1) << shift) - 1) / 2;
+        return std::min(mid, max_);
+      }
+    }
+    return max_;
+  }
+
+ private:
+  static constexpr int kHalfBits = kSubBucketBits - 1;
+  static constexpr size_t kNumBuckets = (64 - kSubBucketBits + 2)
+                                        << kHalfBits;
+
+  // A value v >= 2^kSubBucketBits is shifted right until it has
+  // kSubBucketBits significant bits; the shift selects a group of
+  // 2^kHalfBits buckets and the remaining bits the bucket within it.
+  static size_t bucket_index(uint64_t value) {
+    int bits = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    int shift = std::max(bits - kSubBucketBits, 0);
+    return (static_cast<size_t>(shift) << kHalfBits) + (value >> shift);
+  }
+
+  static int bucket_shift(size_t index) {
+    return std::max<int>(static_cast<int>(index >> kHalfBits) - 1, 0);
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  uint64_t max_ = 0;
+};
+
+// A fenced timer pair costs as much as a fast lookup and stops consecutive
+// lookups from overlapping, so only a small fraction of lookups is timed;
+// at this period the workload time grows by a few percent.
+constexpr uint32_t kDefaultLatencySamplePeriod = 64;
+
+class LatencyRecorder {
+ public:
+  // Time one call out of every `sample_period` calls of measure().
+  explicit LatencyRecorder(
+      uint32_t sample_period = kDefaultLatencySamplePeriod)
+      : sample_period_(std::max<uint32_t>(sample_period, 1)),
+        countdown_(sample_period_),
+        calibration_(latency_timer_calibration()) {}
+
+  // Return fn(), timing it if this call is sampled. fn is called from a
+  // single place so that it is inlined once into the caller's loop.
+  template <class Fn>
+  auto measure(Fn&& fn) {
+    bool sampled = --countdown_ == 0;
+    uint64_t begin = 0;
+    if (sampled) {
+      begin = latency_timer_begin();
+    }
+    auto result = fn();
+    if (sampled) {
+      uint64_t ticks = latency_timer_end() - begin;
+      histogram_.record(ticks > calibration_.overhead_ticks
+                            ? ticks - calibration_.overhead_ticks
+                            : 0);
+      countdown_ = sample_period_;
+    }
+    return result;
+  }
+
+  const LatencyHistogram& histogram() const { return histogram_; }
+
+  double percentile_ns(double q) const {
+    return histogram_.percentile(q) / calibration_.ticks_per_ns;
+  }
+  double max_ns() const { return histogram_.max() / calibration_.ticks_per_ns; }
+
+ private:
+  uint32_t sample_period_;
+  uint32_t countdown_;
+  LatencyTimerCalibration calibration_;
+  LatencyHistogram histogram_;
+};
+
+// Append the p50, p90, p99, p99.9 and maximum sampled latency in nanoseconds
+// as tab-separated columns.
+inline void write_latency_columns(std::ostream& os,
+                                  const LatencyRecorder& recorder) {
+  for (double q : {0.5, 0.9, 0.99, 0.999}) {
+    os << "\t" << recorder.percentile_ns(q);
+  }
+  os << "\t" << recorder.max_ns();
+}
@@ -1,12 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <vector>
 
+#include "blocked_bloom_filter.h"
+#include "index_file.h"
+#include "index_tuner.h"
+#include "last_mile_search.h"
 #include "linear_model.h"
+#include "parallel_build.h"
+#include "radix_root.h"
+#include "range_scan.h"
+#include "record_storage.h"
+#include "simd_predict.h"
+#include "sharded_counter.h"
+#include "span.h"
 
-template <class K, class V>
+template <class K, class V, class Storage = PairStorage<K, V>>
 class LearnedIndex {
   static_assert(std::is_arithmetic<K>::value,
                 "Learned index key type must be numeric.");
@@ -14,85 +28,103 @@ class LearnedIndex {
  public:
   typedef std::pair<K, V> record;
 
-  LearnedIndex(std::vector<record> data) : data_(data) {
-    std::sort(data_.begin(), data_.end());
-  }
+  // Takes ownership of the records; pass them with std::move to avoid a copy.
+  LearnedIndex(std::vector<record> data) : data_(std::move(data)) {}
+
+  // Index keys[i] with payload values[i] without first building a record
+  // vector. With SplitStorage, sorted keys are used in place (see
+  // record_storage.h), so they must outlive the index.
+  LearnedIndex(Span<K> keys, std::vector<V> values)
+      : data_(keys, std::move(values)) {}
 
   // Build a two-level RMI that only uses linear regression models, with the
-  // specified number of second-level models.
-  void build(int num_second_level_models) {
+  // specified number of second-level models, using `num_threads` threads.
+  void build(int num_second_level_models, int num_threads = 1) {
     assert(num_second_level_models > 0);
-    second_level_models_.clear();
+    assert(num_threads > 0);
 
-    // Construct the root model over the entire data.
-    // Extract keys from key-value records. In practice, you would want to avoid
-    // this because it requires making a redundant temporary copy of all the
-    // keys, but for simplicity in this lab we will make some redundant copies.
-    std::vector<K> keys;
-    std::transform(std::begin(data_), std::end(data_), std::back_inserter(keys),
-                   [](auto const& pair) { return pair.first; });
-    // Build a vector of positions (i.e., indexes) for each key.
-    // For the root node over n records, these are simply the integers 0 through
-    // n-1.
-    std::vector<int> positions(keys.size());
-    std::iota(std::begin(positions), std::end(positions), 0);
-    root_model_.train(keys, positions);
+    // Construct the root model over the entire data. The model is trained by
+    // streaming over the sorted records; the position of each key is simply
+    // its index (0 through n-1), so no key or position vectors are needed.
+    root_model_.train([this](auto&& add) {
+      for (size_t pos = 0; pos < data_.size(); pos++) {
+        add(data_.key(pos), pos);
+      }
+    });
     // Rescale the root model so that instead of predicting a position, it
     // predicts the index for the second-level model. Feeding a key through
     // the root model will output the index of the second-level model to which
     // the key should be assigned (root model outputs may need to be manually
     // bounded between 0 and num_second_level_models-1).
     root_model_.rescale(static_cast<double>(num_second_level_models) /
-                        keys.size());
+                        data_.size());
 
-    // Use the trained root model to assign records to each of the second-level
-    // models. Then train the second-level models to predict the positions for
-    // each of their assigned records and compute the maximum prediction error
-    // for each second-level model. Unlike the paper, in which each model
-    // stores both a min-error (i.e., a left-error) and a max-error (i.e., a
-    // right error), here we will only store a single maximum bi-directional
-    // error for each second-level model.
-      
-    int start_pos;
-    int end_pos = 0;  // exclusive
+    radix_root_ = RadixRoot<K>();
+    build_second_level(num_second_level_models, num_threads);
+  }
+
+  // Build with a radix-table root (see radix_root.h) instead of a linear
+  // one: the records are split into `num_second_level_models` runs of equal
+  // size, so that skewed keys no longer crowd into a few second-level models.
+  // Runs of duplicate keys are not split, which can leave some models
+  // empty.
+  void build_radix_root(int num_second_level_models, int num_threads = 1) {
+    assert(num_second_level_models > 0);
+    assert(num_threads > 0);
+    std::vector<K> pivots(num_second_level_models);
     for (int i = 0; i < num_second_level_models; i++) {
-      start_pos = end_pos;
-      while (end_pos < static_cast<int>(data_.size()) &&
-             root_model_.predict(data_[end_pos].first) <= i) {
-        end_pos++;
-      }
-      // Edge case
-      if (i == num_second_level_models - 1) {
-        end_pos = static_cast<int>(data_.size());
-      }
-      keys.clear();
-      std::transform(std::begin(data_) + start_pos, std::begin(data_) + end_pos,
-                     std::back_inserter(keys),
-                     [](auto const& pair) { return pair.first; });
-      positions.clear();
-      positions.resize(end_pos - start_pos);
-      std::iota(std::begin(positions), std::end(positions), start_pos);
-      LinearModel<K> model;
-      model.train(keys, positions);
-      second_level_models_.push_back(model);
-
-      // Compute error bound
-      int max_error = 0;
-      for (int pos = start_pos; pos < end_pos; pos++) {
-        int predicted_pos = model.predict(data_[pos].first);
-        max_error = std::max(max_error, std::abs(pos - predicted_pos));
-      }
-      second_level_error_bounds_.push_back(max_error);
+      pivots[i] = data_.key(data_.size() * i / num_second_level_models);
+    }
+    radix_root_.build(std::move(pivots));
+    // The pivots replace the linear root; do not keep (or save) the root
+    // model of an earlier build().
+    root_model_ = LinearModel<K>();
+    build_second_level(num_second_level_models, num_threads);
+  }
+
+  // Pick the number of second-level models among options.model_counts with
+  // the cost model of index_tuner.h, within options.memory_budget_bytes, and
+  // build with it. `weights` (the lookup weight of every record in key
+  // order, or empty for uniform lookups) is only read by the tuner. Return
+  // the Pareto frontier of the candidates.
+  TunerResult build_tuned(TunerOptions options,
+                          Span<double> weights = Span<double>(),
+                          int num_threads = 1) {
+    options.table_sizes = {0};
+    TunerResult result = tune_index<K>(
+        data_.size(), [this](size_t pos) { return data_.key(pos); }, weights,
+        sizeof(record),
+        sizeof(LinearModel<K>) + sizeof(ErrorBound) + sizeof(SegmentFence),
+        [](size_t) { return size_t(0); }, options);
+    // Without records the frontier is empty; build a single model.
+    build(result.frontier.empty() ? 1 : result.chosen_candidate().num_models,
+          num_threads);
+    return result;
+  }
+
+  // Build a blocked Bloom filter (see blocked_bloom_filter.h) over all keys,
+  // with `bits_per_key` bits per key, that get_value and get_values consult
+  // before reading the records. More bits lower the false-positive rate: one
+  // in about 20 absent keys passes at 6 bits per key, one in 100 at 10 bits.
+  // 0 drops the filter, leaving only the segment fences.
+  void build_negative_lookup_filter(double bits_per_key) {
+    assert(bits_per_key >= 0);
+    negative_lookup_filter_.reset(data_.size(), bits_per_key);
+    if (negative_lookup_filter_.empty()) {
+      return;
+    }
+    for (size_t pos = 0; pos < data_.size(); pos++) {
+      negative_lookup_filter_.insert(data_.key(pos));
     }
   }
 
   // If the key exists, return a pointer to the corresponding value in data_.
-  // If the key does not exist, return a nullptr.
+  // If the key does not exist, return a nullptr. Absent keys outside the
+  // fences of their second-level model, or rejected by the negative-lookup
+  // filter, are turned away before the records are read.
   V* get_value(K key) {
     assert(second_level_models_.size() > 0);
-    int root_model_output = root_model_.predict(key);
-
-    // Use the root model's output to select a second-level model, then use
+    // Use the root stage to select a second-level model, then use
     // the second-level model to predict the key's position, then do a
     // last-mile search using the model's error bound to find the true position
     // of the key. If the key exists, return a pointer to the value. If the
@@ -100,66 +132,497 @@ class LearnedIndex {
     // NOTE: to receive full credit, the last-mile search should use the
     // `last_mile_search` method provided below.
       
-    int num_second_level_models = second_level_models_.size();
-    int second_level_index = std::max<int>(root_model_output, 0);
-    second_level_index = std::min<int>(second_level_index, num_second_level_models - 1);
+    int64_t second_level_index = route(key);
+    if (!may_contain(key, second_level_index)) {
+      return nullptr;
+    }
     
-    int data_size = data_.size();
-    int predicted_index = second_level_models_[second_level_index].predict(key);
-    predicted_index = std::max<int>(predicted_index, 0);
-    predicted_index = std::min<int>(predicted_index, data_size - 1);
+    int64_t data_size = data_.size();
+    int64_t predicted_index = second_level_models_[second_level_index].predict(key);
+    predicted_index = std::max<int64_t>(predicted_index, 0);
+    predicted_index = std::min<int64_t>(predicted_index, data_size - 1);
 
-    if (data_[predicted_index].first == key) {
-      return &data_[predicted_index].second;
+    if (data_.key(predicted_index) == key) {
+      return data_.value(predicted_index);
     } else {
-      last_mile_search_count_ = last_mile_search_count_ + 1;
+      last_mile_search_count_.add(1);
     }
       
-    int error_bound = second_level_error_bounds_[second_level_index];
-    int start_search = predicted_index - error_bound;
-    int end_search = predicted_index + error_bound;
+    const ErrorBound& error_bound = second_level_error_bounds_[second_level_index];
+    int64_t start_search = predicted_index + error_bound.min_error;
+    int64_t end_search = predicted_index + error_bound.max_error + 1;
     //clip
-    start_search = std::max<int>(start_search, 0);
-    end_search = std::max<int>(end_search, 0);
-    start_search = std::min<int>(start_search, data_size);
-    end_search = std::min<int>(end_search, data_size);
+    start_search = std::max<int64_t>(start_search, 0);
+    end_search = std::max<int64_t>(end_search, 0);
+    start_search = std::min<int64_t>(start_search, data_size);
+    end_search = std::min<int64_t>(end_search, data_size);
       
-    int pos = last_mile_search(key, start_search, end_search);
+    int64_t pos = last_mile_search(key, predicted_index, start_search,
+                                   end_search, error_bound.strategy);
     if (pos == -1) {
+        data_miss_count_.add(1);
         return nullptr;
     }
-    return &data_[pos].second;
+    return data_.value(pos);
+  }
+
+  // Batched version of get_value: out[i] is set to the value of keys[i], or to
+  // nullptr if keys[i] does not exist.
+  // Lookups are processed in groups of kLookupGroupSize. Each group runs in
+  // stages (root predict, leaf model fetch, last-mile window) and every stage
+  // first issues prefetches for all keys in the group before it touches any
+  // of them, so the DRAM misses of the whole group overlap instead of being
+  // paid one lookup at a time. The last-mile search runs in lockstep over the
+  // group as a branchless binary search, prefetching the next probe of every
+  // key before comparing.
+  void get_values(const K* keys, size_t n, V** out) {
+    assert(second_level_models_.size() > 0);
+    for (size_t first = 0; first < n; first += kLookupGroupSize) {
+      size_t group_size = std::min(kLookupGroupSize, n - first);
+      lookup_group(keys + first, group_size, out + first);
+    }
+  }
+
+  // Return the position of the first record whose key is not less than
+  // `key`, or the number of records if there is none. Unlike get_value this
+  // also holds for keys that are not in the data, including keys outside the
+  // trained key range (see range_scan.h).
+  size_t lower_bound(K key) const {
+    assert(second_level_models_.size() > 0);
+    int64_t second_level_index = route(key);
+    int64_t data_size = data_.size();
+    int64_t predicted_index = std::min<int64_t>(
+        std::max<int64_t>(second_level_models_[second_level_index].predict(key),
+                          0),
+        data_size - 1);
+    const ErrorBound& error_bound = second_level_error_bounds_[second_level_index];
+    int64_t start_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.min_error, 0), data_size);
+    int64_t end_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.max_error + 1, 0),
+        data_size);
+    return window_lower_bound(data_, key, predicted_index, start_search,
+                              end_search, error_bound.strategy);
+  }
+
+  // The records whose keys lie in [lo, hi), in key order.
+  RecordRange<Storage> range(K lo, K hi) const {
+    return RecordRange<Storage>::until(data_, lower_bound(lo), hi);
+  }
+
+  // Call fn(key, value) for every record whose key lies in [lo, hi), in key
+  // order, and return the number of records visited.
+  template <class Fn>
+  size_t scan(K lo, K hi, Fn fn) const {
+    RecordRange<Storage> records = range(lo, hi);
+    records.for_each(fn);
+    return records.size();
+  }
+
+  // Write the trained models and error bounds to `path` (see index_file.h).
+  // The records are not written. Return false if the file could not be
+  // written.
+  bool save(const std::string& path) const {
+    assert(second_level_models_.size() > 0);
+    IndexFileWriter writer(IndexKind::kLearnedIndex, sizeof(K), data_.size(),
+                           data_fingerprint(data_));
+    writer.add_section(SectionId::kRootModel,
+                       store_models(std::vector<LinearModel<K>>{root_model_}));
+    writer.add_section(SectionId::kLeafModels,
+                       store_models(second_level_models_));
+    writer.add_section(SectionId::kErrorBounds,
+                       store_error_bounds(second_level_error_bounds_));
+    if (!radix_root_.empty()) {
+      writer.add_section(SectionId::kRootPivots, radix_root_.pivots());
+    }
+    return writer.write(path);
   }
 
-  int get_last_mile_search_count() {
-    return last_mile_search_count_;
+  // Replace build() by loading the models that save() wrote for the same
+  // keys. Return false, leaving the index unchanged, if the file is missing,
+  // corrupted, or was built over other keys.
+  bool load(const std::string& path) {
+    IndexFileReader reader;
+    if (!reader.open(path, IndexKind::kLearnedIndex, sizeof(K), data_.size(),
+                     data_fingerprint(data_))) {
+      return false;
+    }
+    Span<StoredModel> root = reader.section<StoredModel>(SectionId::kRootModel);
+    Span<StoredModel> leaves =
+        reader.section<StoredModel>(SectionId::kLeafModels);
+    // Only an index built with a radix root has pivots, one per leaf.
+    Span<K> pivots = reader.section<K>(SectionId::kRootPivots);
+    std::vector<ErrorBound> error_bounds;
+    if (root.size() != 1 || leaves.empty() ||
+        !restore_error_bounds(
+            reader.section<StoredErrorBound>(SectionId::kErrorBounds),
+            &error_bounds) ||
+        error_bounds.size() != leaves.size() ||
+        (reader.has_section(SectionId::kRootPivots) &&
+         (pivots.size() != leaves.size() ||
+          !std::is_sorted(pivots.begin(), pivots.end())))) {
+      return false;
+    }
+    root_model_ = restore_models<LinearModel<K>>(root)[0];
+    second_level_models_ = restore_models<LinearModel<K>>(leaves);
+    second_level_error_bounds_ = std::move(error_bounds);
+    radix_root_ = RadixRoot<K>();
+    if (!pivots.empty()) {
+      radix_root_.build(std::vector<K>(pivots.begin(), pivots.end()));
+    }
+    // The fences are not saved; recompute them from the root stage.
+    std::vector<size_t> segment_ends =
+        compute_root_segment_ends(second_level_models_.size(), 1);
+    set_segment_fences(segment_ends);
+    segment_size_stats_ = compute_segment_size_stats(segment_ends);
+    return true;
+  }
+
+  // Trained models, e.g., for exporting them (see rmi_codegen.h).
+  const LinearModel<K>& root_model() const { return root_model_; }
+  const std::vector<LinearModel<K>>& second_level_models() const {
+    return second_level_models_;
+  }
+  const std::vector<ErrorBound>& second_level_error_bounds() const {
+    return second_level_error_bounds_;
+  }
+  const Storage& data() const { return data_; }
+
+  int64_t get_last_mile_search_count() {
+    return last_mile_search_count_.load();
   }
 
   void reset_last_mile_search_count() {
-    last_mile_search_count_ = 0;
+    last_mile_search_count_.reset();
+  }
+
+  // Outcomes of the lookups of absent keys since the last reset.
+  struct NegativeLookupStats {
+    // Rejected by the fences of the selected second-level model.
+    int64_t fence_rejections = 0;
+    // Inside the fences but rejected by the filter.
+    int64_t filter_rejections = 0;
+    // Passed the fences and the filter, so the records were searched.
+    int64_t data_misses = 0;
+
+    // Share of the absent keys inside the fences that the filter let
+    // through (all of them without a filter).
+    double filter_false_positive_rate() const {
+      int64_t inside_fences = filter_rejections + data_misses;
+      return inside_fences > 0
+                 ? static_cast<double>(data_misses) / inside_fences
+                 : 0;
+    }
+  };
+
+  NegativeLookupStats get_negative_lookup_stats() const {
+    NegativeLookupStats stats;
+    stats.fence_rejections = fence_rejection_count_.load();
+    stats.filter_rejections = filter_rejection_count_.load();
+    stats.data_misses = data_miss_count_.load();
+    return stats;
+  }
+
+  void reset_negative_lookup_stats() {
+    fence_rejection_count_.reset();
+    filter_rejection_count_.reset();
+    data_miss_count_.reset();
+  }
+
+  // Bytes of the models, error bounds and radix root.
+  size_t model_bytes() const {
+    return sizeof(root_model_) + radix_root_.size_bytes() +
+           second_level_models_.size() * sizeof(LinearModel<K>) +
+           second_level_error_bounds_.size() * sizeof(ErrorBound);
+  }
+
+  // Whether build_radix_root() (or load() of its file) made the root stage.
+  bool has_radix_root() const { return !radix_root_.empty(); }
+
+  // Spread of the number of records per second-level model in the last
+  // build() or load().
+  const SegmentSizeStats& segment_size_stats() const {
+    return segment_size_stats_;
+  }
+
+  // Memory used to reject absent keys: the segment fences and the filter.
+  size_t fence_bytes() const {
+    return segment_fences_.size() * sizeof(SegmentFence);
+  }
+  size_t negative_lookup_filter_bytes() const {
+    return negative_lookup_filter_.size_bytes();
   }
 
  private:
-  // Do a binary search for the position of a key in the data.
+  // The smallest and largest key the root stage sends to a second-level
+  // model. A key outside them is not in the data.
+  struct SegmentFence {
+    K min_key;
+    K max_key;
+  };
+
+  static constexpr size_t kLookupGroupSize = 16;
+  // Number of second-level models a build worker trains per task.
+  static constexpr size_t kModelsPerBuildTask = 64;
+
+  // Train the second-level models and their error bounds on the records
+  // the root stage (the root model or the radix root) assigns to them.
+  void build_second_level(int num_second_level_models, int num_threads) {
+    second_level_models_.clear();
+    second_level_error_bounds_.clear();
+
+    // Use the root stage to assign records to each of the second-level
+    // models. Then train the second-level models to predict the positions for
+    // each of their assigned records and compute the prediction errors for
+    // each second-level model. As in the paper, each model stores both a
+    // min-error (i.e., a left-error) and a max-error (i.e., a right error),
+    // together with the last-mile search strategy that suits its errors.
+    //
+    // The record-to-model assignment comes from a parallel scan of the root
+    // stage's outputs, and the second-level models are trained by a pool
+    // of `num_threads` workers. Each model and error bound only depends on its
+    // own records, so the result is the same for any number of threads. Root
+    // and leaf predictions are evaluated a block of records at a time with
+    // the batched kernels of simd_predict.h.
+    std::vector<size_t> segment_ends =
+        compute_root_segment_ends(num_second_level_models, num_threads);
+
+    second_level_models_.resize(num_second_level_models);
+    second_level_error_bounds_.resize(num_second_level_models);
+    parallel_for(num_second_level_models, num_threads, kModelsPerBuildTask,
+                 [&](size_t first_model, size_t last_model) {
+      for (size_t i = first_model; i < last_model; i++) {
+        int64_t start_pos = i == 0 ? 0 : segment_ends[i - 1];
+        int64_t end_pos = segment_ends[i];  // exclusive
+        LinearModel<K> model;
+        model.train([&](auto&& add) {
+          for (int64_t pos = start_pos; pos < end_pos; pos++) {
+            add(data_.key(pos), pos);
+          }
+        });
+        second_level_models_[i] = model;
+
+        // Compute error bound. Errors are measured against the clamped
+        // prediction, which is what get_value searches around.
+        ErrorBoundTracker error_tracker;
+        K keys[kPredictBlockSize];
+        int64_t predicted_pos[kPredictBlockSize];
+        for (int64_t block = start_pos; block < end_pos;
+             block += kPredictBlockSize) {
+          size_t count = std::min<int64_t>(kPredictBlockSize, end_pos - block);
+          data_.copy_keys(block, count, keys);
+          predict_clamped(model, keys, count, 0, data_.size() - 1,
+                          predicted_pos);
+          for (size_t j = 0; j < count; j++) {
+            error_tracker.add(block + j - predicted_pos[j]);
+          }
+        }
+        second_level_error_bounds_[i] = error_tracker.finish();
+      }
+    });
+    set_segment_fences(segment_ends);
+    segment_size_stats_ = compute_segment_size_stats(segment_ends);
+  }
+
+  // The end position of the records of every second-level model, from the
+  // root stage's outputs (see compute_segment_ends).
+  std::vector<size_t> compute_root_segment_ends(int64_t num_second_level_models,
+                                                int num_threads) const {
+    return compute_segment_ends(
+        data_.size(), num_second_level_models, num_threads,
+        [&](size_t begin, size_t count, int64_t* out) {
+          K keys[kPredictBlockSize];
+          data_.copy_keys(begin, count, keys);
+          route_block(keys, count, num_second_level_models, out);
+        });
+  }
+
+  // The second-level model of `key`.
+  int64_t route(K key) const {
+    if (!radix_root_.empty()) {
+      return radix_root_.route(key);
+    }
+    int64_t num_second_level_models = second_level_models_.size();
+    return std::min<int64_t>(std::max<int64_t>(root_model_.predict(key), 0),
+                             num_second_level_models - 1);
+  }
+
+  // The second-level models of keys[0, n) among `num_second_level_models`,
+  // written to out[0, n).
+  void route_block(const K* keys, size_t n, int64_t num_second_level_models,
+                   int64_t* out) const {
+    if (!radix_root_.empty()) {
+      for (size_t i = 0; i < n; i++) {
+        out[i] = radix_root_.route(keys[i]);
+      }
+      return;
+    }
+    predict_clamped(root_model_, keys, n, 0, num_second_level_models - 1, out);
+  }
+
+  // Set the fences of every second-level model from the end positions of
+  // their records. The root stage is monotone, so the records of model i are
+  // exactly the keys it is selected for; a model without records gets empty
+  // fences that reject every key.
+  void set_segment_fences(const std::vector<size_t>& segment_ends) {
+    segment_fences_.resize(segment_ends.size());
+    for (size_t i = 0; i < segment_ends.size(); i++) {
+      size_t start_pos = i == 0 ? 0 : segment_ends[i - 1];
+      if (start_pos < segment_ends[i]) {
+        segment_fences_[i] = {data_.key(start_pos),
+                              data_.key(segment_ends[i] - 1)};
+      } else {
+        segment_fences_[i] = {std::numeric_limits<K>::max(),
+                              std::numeric_limits<K>::lowest()};
+      }
+    }
+  }
+
+  // False if `key`, for which the root model selected second-level model
+  // `second_level_index`, is certainly not in the data: it lies outside the
+  // model's fences or the filter rejects it. Rejections are counted.
+  bool may_contain(K key, int64_t second_level_index) {
+    const SegmentFence& fence = segment_fences_[second_level_index];
+    if (key < fence.min_key || key > fence.max_key) {
+      fence_rejection_count_.add(1);
+      return false;
+    }
+    if (!negative_lookup_filter_.empty() &&
+        !negative_lookup_filter_.may_contain(key)) {
+      filter_rejection_count_.add(1);
+      return false;
+    }
+    return true;
+  }
+
+  // Run one group of at most kLookupGroupSize lookups for get_values.
+  void lookup_group(const K* keys, size_t group_size, V** out) {
+    int64_t num_second_level_models = second_level_models_.size();
+    int64_t data_size = data_.size();
+    int64_t model_index[kLookupGroupSize];
+    int64_t predicted_index[kLookupGroupSize];
+    int64_t search_start[kLookupGroupSize];
+    int64_t search_size[kLookupGroupSize];
+
+    // Stage 1: root predict, then prefetch the selected leaf models.
+    route_block(keys, group_size, num_second_level_models, model_index);
+    for (size_t i = 0; i < group_size; i++) {
+      __builtin_prefetch(&second_level_models_[model_index[i]]);
+      __builtin_prefetch(&second_level_error_bounds_[model_index[i]]);
+    }
+
+    // Stage 2: leaf predict, then prefetch the predicted slot of every key
+    // that passes the fences and the filter.
+    predict_clamped_gather(second_level_models_.data(), model_index, keys,
+                           group_size, 0, data_size - 1, predicted_index);
+    bool admitted[kLookupGroupSize];
+    for (size_t i = 0; i < group_size; i++) {
+      admitted[i] = may_contain(keys[i], model_index[i]);
+      if (admitted[i]) {
+        data_.prefetch(predicted_index[i]);
+      }
+    }
+
+    // Stage 3: probe the predicted slot and set up the last-mile window of
+    // every key that missed it.
+    for (size_t i = 0; i < group_size; i++) {
+      if (!admitted[i]) {
+        out[i] = nullptr;
+        search_size[i] = -1;
+        continue;
+      }
+      int64_t predicted = predicted_index[i];
+      if (data_.key(predicted) == keys[i]) {
+        out[i] = data_.value(predicted);
+        search_size[i] = -1;
+        continue;
+      }
+      last_mile_search_count_.add(1);
+      // The lockstep search is always a binary search; the exponential
+      // strategy only pays off for lookups that are not interleaved.
+      const ErrorBound& error_bound = second_level_error_bounds_[model_index[i]];
+      int64_t start_search = std::min<int64_t>(
+          std::max<int64_t>(predicted + error_bound.min_error, 0), data_size);
+      int64_t end_search = std::min<int64_t>(
+          std::max<int64_t>(predicted + error_bound.max_error + 1, 0), data_size);
+      search_start[i] = start_search;
+      search_size[i] = end_search - start_search;
+    }
+
+    // Stage 4: lockstep binary search over all open windows. Each round halves
+    // every window; the probes of the next round are prefetched first.
+    bool searching = true;
+    while (searching) {
+      searching = false;
+      for (size_t i = 0; i < group_size; i++) {
+        if (search_size[i] > 1) {
+          data_.prefetch(search_start[i] + search_size[i] / 2);
+        }
+      }
+      for (size_t i = 0; i < group_size; i++) {
+        if (search_size[i] > 1) {
+          int64_t half = search_size[i] / 2;
+          if (data_.key(search_start[i] + half) < keys[i]) {
+            search_start[i] += half;
+          }
+          search_size[i] -= half;
+          searching = true;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < group_size; i++) {
+      if (search_size[i] < 0) {
+        continue;
+      }
+      int64_t pos = search_start[i];
+      if (search_size[i] == 1 && data_.key(pos) < keys[i]) {
+        pos++;
+      }
+      if (pos >= data_size || data_.key(pos) != keys[i]) {
+        data_miss_count_.add(1);
+        out[i] = nullptr;
+      } else {
+        out[i] = data_.value(pos);
+      }
+    }
+  }
+
+  // Search for the position of a key in the data, either with a binary search
+  // or by galloping outward from the predicted position (see
+  // last_mile_search.h).
   // Only search in the range between the given start position (inclusive)
   // and end position (exclusive).
   // If the key is not found in the data, return -1.
-  int last_mile_search(K key, int start_pos, int end_pos) const {
-    int pos = std::lower_bound(
-                  data_.begin() + start_pos, data_.begin() + end_pos, key,
-                  [](auto const& pair, K key) { return pair.first < key; }) -
-              data_.begin();
-    if (pos > static_cast<int>(data_.size()) || data_[pos].first != key) {
+  int64_t last_mile_search(K key, int64_t predicted_pos, int64_t start_pos,
+                           int64_t end_pos, SearchStrategy strategy) const {
+    int64_t pos;
+    if (strategy == SearchStrategy::kExponential && start_pos < end_pos) {
+      predicted_pos = std::min(std::max(predicted_pos, start_pos), end_pos - 1);
+      pos = exponential_search(data_, key, predicted_pos, start_pos, end_pos);
+    } else {
+      pos = data_.lower_bound(key, start_pos, end_pos);
+    }
+    if (pos >= static_cast<int64_t>(data_.size()) || data_.key(pos) != key) {
       return -1;
     } else {
       return pos;
     }
   }
 
-  std::vector<record> data_;
+  Storage data_;
   LinearModel<K> root_model_;
+  // Replaces root_model_ as the root stage unless it is empty.
+  RadixRoot<K> radix_root_;
   std::vector<LinearModel<K>> second_level_models_;
-  // The maximum prediction error for each second-level model.
-  std::vector<int> second_level_error_bounds_;
-  int last_mile_search_count_;
+  // The signed prediction error range and last-mile search strategy for each
+  // second-level model.
+  std::vector<ErrorBound> second_level_error_bounds_;
+  std::vector<SegmentFence> segment_fences_;
+  SegmentSizeStats segment_size_stats_;
+  BlockedBloomFilter<K> negative_lookup_filter_;
+  ShardedCounter last_mile_search_count_;
+  ShardedCounter fence_rejection_count_;
+  ShardedCounter filter_rejection_count_;
+  ShardedCounter data_miss_count_;
 };
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
 #include <vector>
 
 /* A simple linear regression model for predicting the location of a given key
@@ -22,40 +26,52 @@ class LinearModel {
   // of scalar model inputs, and `positions` is the vector of the corresponding
   // desired model outputs (e.g., for input `keys[0]`, the desired output is
   // `positions[0]`).
-  void train(const std::vector<K>& keys, const std::vector<int>& positions) {
+  void train(const std::vector<K>& keys, const std::vector<int64_t>& positions) {
     assert(keys.size() == positions.size());
+    train([&](auto&& add) {
+      for (size_t i = 0; i < keys.size(); i++) {
+        add(keys[i], positions[i]);
+      }
+    });
+  }
 
-    // Train the model (i.e., set values for m_ and b_) to predict the
-    // positions from the keys.
-    // We suggest that you train the model using the closed-form formula
-    // for minimizing mean squared error:
+  // Train the model on points streamed by `for_each_point`, which must call
+  // add(key, position) once per training point. This lets the indexes train
+  // directly over their sorted records without copying keys and positions
+  // into temporary vectors.
+  template <class PointSource>
+  void train(const PointSource& for_each_point) {
+    // We train the model using the closed-form formula for minimizing mean
+    // squared error:
     // https://en.wikipedia.org/wiki/Ordinary_least_squares#Simple_linear_regression_model
-    // You may need to be careful of cases where the denominators in the above
-    // closed-form formulas are zero.
-      
-    double n = keys.size(); // number elements
+    // The sums are accumulated in double precision: products of 64-bit keys
+    // overflow integer arithmetic.
+    double n = 0;  // number elements
 
     // keys to search for in the index (x)
     // positions to retrieve (y)
-      
+
     double x_sum = 0;
     double y_sum = 0;
     double xx_sum = 0;
     double xy_sum = 0;
-      
-    for (int i = 0; i < n; i++) {
-        x_sum += keys[i];
-        y_sum += positions[i];
-        xx_sum += keys[i] * keys[i];
-        xy_sum += keys[i] * positions[i];
-    }
-      
+
+    for_each_point([&](K key, int64_t position) {
+      double x = static_cast<double>(key);
+      double y = static_cast<double>(position);
+      n += 1;
+      x_sum += x;
+      y_sum += y;
+      xx_sum += x * x;
+      xy_sum += x * y;
+    });
+
     if (n <= 1) {
         m_ = 0;
         b_ = y_sum;
         return;
     }
-      
+
     double numerator = n * xy_sum - x_sum * y_sum;
     double denominator = n * xx_sum - x_sum * x_sum;
 
@@ -64,17 +80,18 @@ class LinearModel {
         b_ = y_sum / n;
         return;
     }
-    
+
     m_ =  numerator / denominator;
     b_ = (y_sum - m_ * x_sum) / n;
-      
   }
 
-  int predict(K key) const {
-    return static_cast<int>(m_ * static_cast<double>(key) + b_);
+  // Evaluated as a fused multiply-add, the same rounding as the batched
+  // kernels in simd_predict.h.
+  int64_t predict(K key) const {
+    return static_cast<int64_t>(std::fma(m_, static_cast<double>(key), b_));
   }
 
-  K inverse_predict(int position) const {
+  K inverse_predict(int64_t position) const {
     return static_cast<K>((static_cast<double>(position) - b_) / m_);
   }
 
@@ -83,7 +100,15 @@ class LinearModel {
     b_ *= scaling_factor;
   }
 
- private:
-  double x_ = 0;  // slope
-  double y_ = 0;  // intercept
+  // Parameters as stored by RecursiveModelIndex::save (see rmi_models.h).
+  static constexpr uint32_t kModelId = 1;
+  static constexpr size_t kNumParameters = 2;
+  void store(double* parameters) const {
+    parameters[0] = m_;
+    parameters[1] = b_;
+  }
+  void restore(const double* parameters) {
+    m_ = parameters[0];
+    b_ = parameters[1];
+  }
 };
@@ -4,12 +4,29 @@
 #include <numeric>
 #include <vector>
 #include <unordered_set>
-#include <unordered_map>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <memory>
+#include <mutex>
 
+#include "hot_key_table.h"
+#include "hot_tier.h"
+#include "index_file.h"
+#include "index_tuner.h"
+#include "last_mile_search.h"
 #include "linear_model.h"
+#include "parallel_build.h"
+#include "range_scan.h"
+#include "record_storage.h"
+#include "simd_predict.h"
+#include "sharded_counter.h"
+#include "space_saving_sketch.h"
+#include "span.h"
 
-template <class K, class V>
+template <class K, class V, class Storage = PairStorage<K, V>>
 class LookUpTableLearnedIndex {
   static_assert(std::is_arithmetic<K>::value,
                 "Learned index key type must be numeric.");
@@ -17,207 +34,694 @@ class LookUpTableLearnedIndex {
  public:
   typedef std::pair<K, V> record;
 
-  LookUpTableLearnedIndex(std::vector<record> data, std::vector<double> weights) : data_(data), weights_(weights) {
-    std::sort(data_.begin(), data_.end());
+  // Takes ownership of the records and of their weights (weights[i] is the
+  // weight of the i-th record in key order).
+  LookUpTableLearnedIndex(std::vector<record> data, std::vector<double> weights) : data_(std::move(data)), weights_(std::move(weights)) {}
+
+  // Index keys[i] with payload values[i] and weight weights[i]; the keys must
+  // be sorted for the weights to line up. With SplitStorage the keys are used
+  // in place, so they must outlive the index.
+  LookUpTableLearnedIndex(Span<K> keys, std::vector<V> values,
+                          Span<double> weights)
+      : data_(keys, std::move(values)),
+        weights_(weights.begin(), weights.end()) {
+    assert(weights_.size() == data_.size());
   }
 
-  // borrowed from https://stackoverflow.com/questions/1577475/c-sorting-and-keeping-track-of-indexes
-  std::vector<int> sort_indexes(std::vector<double> &v) {
+  // Index keys[i] with payload values[i] without weights, for build_adaptive().
+  LookUpTableLearnedIndex(Span<K> keys, std::vector<V> values)
+      : data_(keys, std::move(values)) {}
 
-    // initialize original index locations
-    std::vector<int> idx(v.size());
-    std::iota(idx.begin(), idx.end(), 0);
+  // Settings of the adaptive hot-key mode (see build_adaptive()).
+  struct AdaptiveOptions {
+    // Number of keys in the published hot-key table.
+    size_t table_size = 1000;
+    // One lookup in `sample_period` (per thread) is fed to the sketch.
+    uint32_t sample_period = 64;
+    // The table is republished after this many samples.
+    uint64_t refresh_samples = 1 << 16;
+    // Keys monitored by the sketch; 0 means four times the table size.
+    size_t sketch_capacity = 0;
+  };
 
-    // sort indexes based on comparing values in v
-    // using std::stable_sort instead of std::sort
-    // to avoid unnecessary index re-orderings
-    // when v contains elements of equal values 
-    std::stable_sort(idx.begin(), idx.end(),
-        [&v](int i1, int i2) {return v[i1] < v[i2];});
+  // Counters of the adaptive hot-key mode since build_adaptive().
+  struct AdaptiveStats {
+    int64_t sampled_lookups = 0;
+    // Sampled lookups that were served by the hot-key table.
+    int64_t sampled_hits = 0;
+    int64_t refreshes = 0;
+    // Refreshes put off because every replaced table was still being read.
+    int64_t deferred_refreshes = 0;
+    double total_refresh_ns = 0;
+    double max_refresh_ns = 0;
 
-    return idx;
-  }
+    double hit_ratio() const {
+      return sampled_lookups > 0
+                 ? static_cast<double>(sampled_hits) / sampled_lookups
+                 : 0;
+    }
+    double mean_refresh_ns() const {
+      return refreshes > 0 ? total_refresh_ns / refreshes : 0;
+    }
+  };
 
   // Build a two-level RMI that only uses linear regression models, with the
-  // specified number of second-level models.
-  void build(int num_second_level_models, int tableSize) {
+  // specified number of second-level models, using `num_threads` threads.
+  // The `tableSize` keys with the largest weights are served from a look-up
+  // table, and the models are trained over the remaining keys only.
+  void build(int num_second_level_models, int tableSize, int num_threads = 1) {
     assert(num_second_level_models > 0);
+    assert(num_threads > 0);
     second_level_models_.clear();
-    // Construct the root model over the entire data.
-    // Extract keys from key-value records. In practice, you would want to avoid
-    // this because it requires making a redundant temporary copy of all the
-    // keys, but for simplicity in this lab we will make some redundant copies.
-    std::vector<K> keys;
-    std::transform(std::begin(data_), std::end(data_), std::back_inserter(keys),
-                   [](auto const& pair) { return pair.first; });
-      
-    // Build a vector of positions (i.e., indexes) for each key.
-    std::vector<int> positions(keys.size());
-    std::iota(std::begin(positions), std::end(positions), 0);
+    second_level_error_bounds_.clear();
+    adaptive_.reset();
+    hot_tier_.clear();
 
-    // Create a look-up table for the top most frequent keys
-    std::vector<int> sorted_idx = sort_indexes(weights_);
-    look_up_table_.clear();
-    int curr_idx = sorted_idx.size() - 1;
-    size_t table_size_t = static_cast<size_t>(tableSize);
-    while (look_up_table_.size() < table_size_t && curr_idx >= 0) {
-      if (look_up_table_.find(keys[sorted_idx[curr_idx]]) == look_up_table_.end()) {
-        look_up_table_[keys[sorted_idx[curr_idx]]] = positions[sorted_idx[curr_idx]];
-      }
-      curr_idx -= 1;
+    // Create a look-up table for the top most frequent keys, and mark every
+    // record whose key is in the table so that training can skip it.
+    std::vector<bool> is_hot = build_look_up_table(tableSize);
+    size_t num_keys_to_train = 0;
+    for (size_t pos = 0; pos < data_.size(); pos++) {
+      num_keys_to_train += !is_hot[pos];
     }
-
-    std::vector<K> keys_to_train;
-    std::vector<int> positions_to_train;
-    int all_keys_size = keys.size();
-    for (int i = 0; i < all_keys_size; i ++) {
-      if (look_up_table_.find(keys[i]) == look_up_table_.end())  {
-        keys_to_train.push_back(keys[i]);
-        positions_to_train.push_back(positions[i]);
-      }
-    }
-
-    if (keys_to_train.size() == 0) {
-      return;
+    if (num_keys_to_train == 0) {
+      // The table holds every key, but absent keys, lower_bound(), range()
+      // and scan() still search the records: train one model over all of
+      // them.
+      is_hot.assign(data_.size(), false);
+      num_keys_to_train = data_.size();
+      num_second_level_models = 1;
     }
 
-    
-    // For the root node over n records, these are simply the integers 0 through
-    // n-1.
-    root_model_.train(keys_to_train, positions_to_train);
+    // Construct the root model over the remaining keys. The records are
+    // streamed in sorted order with their positions in data_, so no copies of
+    // the keys or positions are made.
+    root_model_.train([&](auto&& add) {
+      for (size_t pos = 0; pos < data_.size(); pos++) {
+        if (!is_hot[pos]) {
+          add(data_.key(pos), pos);
+        }
+      }
+    });
     // Rescale the root model so that instead of predicting a position, it
     // predicts the index for the second-level model. Feeding a key through
     // the root model will output the index of the second-level model to which
     // the key should be assigned (root model outputs may need to be manually
     // bounded between 0 and num_second_level_models-1).
     root_model_.rescale(static_cast<double>(num_second_level_models) /
-                        keys_to_train.size());
+                        num_keys_to_train);
 
     // Use the trained root model to assign records to each of the second-level
     // models. Then train the second-level models to predict the positions for
-    // each of their assigned records and compute the maximum prediction error
-    // for each second-level model. Unlike the paper, in which each model
-    // stores both a min-error (i.e., a left-error) and a max-error (i.e., a
-    // right error), here we will only store a single maximum bi-directional
-    // error for each second-level model.
-      
-    std::vector<K> bucket_keys;
-    std::vector<int> bucket_positions;
-      
-    int start_pos;
-    int end_pos = 0;  // exclusive
-    for (int i = 0; i < num_second_level_models; i++) {
-      start_pos = end_pos;
-      while (end_pos < static_cast<int>(keys_to_train.size()) &&
-             root_model_.predict(keys_to_train[end_pos]) <= i) {
-        end_pos++;
+    // each of their assigned records and compute the prediction errors for
+    // each second-level model. As in the paper, each model stores both a
+    // min-error (i.e., a left-error) and a max-error (i.e., a right error),
+    // together with the last-mile search strategy that suits its errors.
+    //
+    // The record-to-model assignment comes from a parallel scan of the root
+    // model's predictions, and the second-level models are trained by a pool
+    // of `num_threads` workers. Each model and error bound only depends on its
+    // own records, so the result is the same for any number of threads.
+    //
+    // Hot records report segment 0, which never moves the assignment to a
+    // later segment, so the segments hold the same trained keys as if the hot
+    // records had been removed first.
+    std::vector<size_t> segment_ends = compute_segment_ends(
+        data_.size(), num_second_level_models, num_threads,
+        [&](size_t begin, size_t count, int64_t* out) {
+          K keys[kPredictBlockSize];
+          data_.copy_keys(begin, count, keys);
+          predict_clamped(root_model_, keys, count, 0,
+                          num_second_level_models - 1, out);
+          for (size_t i = 0; i < count; i++) {
+            if (is_hot[begin + i]) {
+              out[i] = 0;
+            }
+          }
+        });
+
+    second_level_models_.resize(num_second_level_models);
+    second_level_error_bounds_.resize(num_second_level_models);
+    parallel_for(num_second_level_models, num_threads, kModelsPerBuildTask,
+                 [&](size_t first_model, size_t last_model) {
+      for (size_t i = first_model; i < last_model; i++) {
+        int64_t start_pos = i == 0 ? 0 : segment_ends[i - 1];
+        int64_t end_pos = segment_ends[i];  // exclusive
+        LinearModel<K> model;
+        model.train([&](auto&& add) {
+          for (int64_t pos = start_pos; pos < end_pos; pos++) {
+            if (!is_hot[pos]) {
+              add(data_.key(pos), pos);
+            }
+          }
+        });
+        second_level_models_[i] = model;
+
+        // Compute error bound. Errors are measured against the clamped
+        // prediction, which is what get_value searches around.
+        ErrorBoundTracker error_tracker;
+        K keys[kPredictBlockSize];
+        int64_t predicted_pos[kPredictBlockSize];
+        for (int64_t block = start_pos; block < end_pos;
+             block += kPredictBlockSize) {
+          size_t count = std::min<int64_t>(kPredictBlockSize, end_pos - block);
+          data_.copy_keys(block, count, keys);
+          predict_clamped(model, keys, count, 0, data_.size() - 1,
+                          predicted_pos);
+          for (size_t j = 0; j < count; j++) {
+            if (is_hot[block + j]) {
+              continue;
+            }
+            error_tracker.add(block + j - predicted_pos[j]);
+          }
+        }
+        second_level_error_bounds_[i] = error_tracker.finish();
       }
-      // Edge case
-      if (i == num_second_level_models - 1) {
-        end_pos = static_cast<int>(keys_to_train.size());
+    });
+  }
+
+  // Build with the hot keys in a sorted tier (see hot_tier.h) instead of the
+  // hash table. The tier holds the fewest heaviest keys that carry `coverage`
+  // of the weight, up to `cache_budget_bytes` of keys and payloads, and the
+  // models are trained over the other keys.
+  void build_tiered(int num_second_level_models, size_t cache_budget_bytes,
+                    double coverage = 0.99, int num_threads = 1) {
+    size_t tier_size =
+        choose_hot_tier_size(Span<double>(weights_), cache_budget_bytes,
+                             HotTier<K, V>::kEntryBytes, coverage);
+    build(num_second_level_models, tier_size, num_threads);
+    std::vector<typename HotTier<K, V>::Entry> entries;
+    entries.reserve(look_up_table_.size());
+    look_up_table_.for_each([&](K key, int64_t position) {
+      entries.push_back({key, *data_.value(position), position});
+    });
+    hot_tier_.build(std::move(entries));
+    look_up_table_.clear();
+  }
+
+  // Pick the number of second-level models and the table size among
+  // options.model_counts and options.table_sizes with the cost model of
+  // index_tuner.h, within options.memory_budget_bytes, and build that
+  // configuration. Return the Pareto frontier of the candidates.
+  TunerResult build_tuned(const TunerOptions& options, int num_threads = 1) {
+    TunerResult result = tune_index<K>(
+        data_.size(), [this](size_t pos) { return data_.key(pos); },
+        Span<double>(weights_), sizeof(record),
+        sizeof(LinearModel<K>) + sizeof(ErrorBound),
+        HotKeyTable<K, V>::table_bytes_for, options);
+    // Without records the frontier is empty; build a single model.
+    if (result.frontier.empty()) {
+      build(1, 0, num_threads);
+      return result;
+    }
+    const TunerCandidate& chosen = result.chosen_candidate();
+    build(chosen.num_models, chosen.table_size, num_threads);
+    return result;
+  }
+
+  // Build the models over all keys, without weights, and serve hot keys from
+  // a table that follows the lookups instead: a space-saving sketch counts a
+  // sample of the looked-up keys, and once `options.refresh_samples` samples
+  // were taken, maybe_refresh() publishes a new table of the
+  // `options.table_size` most frequent keys with an atomic index swap. The
+  // models are not rebuilt. Lookups may run concurrently and only record
+  // samples; the caller decides which thread refreshes (e.g., a background
+  // thread, or the lookup loop every so many lookups).
+  void build_adaptive(int num_second_level_models, AdaptiveOptions options,
+                      int num_threads = 1) {
+    assert(options.sample_period > 0 && options.refresh_samples > 0);
+    build(num_second_level_models, 0, num_threads);
+    if (options.sketch_capacity == 0) {
+      options.sketch_capacity = 4 * options.table_size;
+    }
+    adaptive_ = std::make_unique<AdaptiveState>(options);
+  }
+
+  // If the key exists, return a pointer to the corresponding value: the copy
+  // held by the look-up table for a hot key, the one in data_ otherwise.
+  // If the key does not exist, return a nullptr. In adaptive mode the tables
+  // are rewritten, so the value is always the one in data_.
+  V* get_value(K key) {
+    assert(second_level_models_.size() > 0);
+
+    if (adaptive_ != nullptr) {
+      int64_t hot_pos = with_adaptive_table(
+          [key](const HotKeyTable<K, V>& table) {
+            return table.position_of(key);
+          });
+      sample_lookup(key, hot_pos != -1);
+      if (hot_pos != -1) {
+        return data_.value(hot_pos);
       }
-      bucket_keys.clear();
-      bucket_positions.clear();
-      for (int i = start_pos; i < end_pos; i++) {
-        bucket_keys.push_back(keys_to_train[i]);
-        bucket_positions.push_back(positions_to_train[i]);
+    } else {
+      // check if the key is inside the look-up table
+      V* hot_value = hot_tier_.empty() ? look_up_table_.find(key)
+                                       : hot_tier_.find(key);
+      if (hot_value != nullptr) {
+        return hot_value;
       }
-      LinearModel<K> model;
-      model.train(bucket_keys, bucket_positions);
-      second_level_models_.push_back(model);
+    }
 
-      // Compute error bound
-      int max_error = 0;
-      for (int pos = start_pos; pos < end_pos; pos++) {
-        int predicted_pos = model.predict(keys_to_train[pos]);
-        max_error = std::max(max_error, std::abs(pos - predicted_pos));
-      }
-      second_level_error_bounds_.push_back(max_error);
+    int64_t pos = find_position<true>(key);
+    if (pos == -1) {
+        return nullptr;
     }
+    return data_.value(pos);
   }
 
-  // If the key exists, return a pointer to the corresponding value in data_.
-  // If the key does not exist, return a nullptr.
-  V* get_value(K key) {
+  // Return the position of the first record whose key is not less than
+  // `key`, or the number of records if there is none. The hot keys are not
+  // consulted: they are also in data_, and a lower bound next to a hot key
+  // (or outside the trained key range) is found past the edge of the
+  // last-mile window (see range_scan.h).
+  size_t lower_bound(K key) const {
     assert(second_level_models_.size() > 0);
+    int64_t num_second_level_models = second_level_models_.size();
+    int64_t second_level_index = std::min<int64_t>(
+        std::max<int64_t>(root_model_.predict(key), 0),
+        num_second_level_models - 1);
+    int64_t data_size = data_.size();
+    int64_t predicted_index = std::min<int64_t>(
+        std::max<int64_t>(second_level_models_[second_level_index].predict(key),
+                          0),
+        data_size - 1);
+    const ErrorBound& error_bound = second_level_error_bounds_[second_level_index];
+    int64_t start_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.min_error, 0), data_size);
+    int64_t end_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.max_error + 1, 0),
+        data_size);
+    return window_lower_bound(data_, key, predicted_index, start_search,
+                              end_search, error_bound.strategy);
+  }
+
+  // The records whose keys lie in [lo, hi), in key order.
+  RecordRange<Storage> range(K lo, K hi) const {
+    return RecordRange<Storage>::until(data_, lower_bound(lo), hi);
+  }
 
-    // check if the key is inside the look-up table
-    if (look_up_table_.find(key) != look_up_table_.end()) {
-      return &data_[look_up_table_.at(key)].second;
+  // Call fn(key, value) for every record whose key lies in [lo, hi), in key
+  // order, and return the number of records visited.
+  template <class Fn>
+  size_t scan(K lo, K hi, Fn fn) const {
+    RecordRange<Storage> records = range(lo, hi);
+    records.for_each(fn);
+    return records.size();
+  }
+
+  // Write the trained models, error bounds and hot keys to `path` (see
+  // index_file.h). The records and weights are not written, and load()
+  // serves the hot keys of a tiered index from the hash table. Return false
+  // if the file could not be written.
+  bool save(const std::string& path) const {
+    IndexFileWriter writer(IndexKind::kLookUpTableLearnedIndex, sizeof(K),
+                           data_.size(), data_fingerprint(data_));
+    writer.add_section(SectionId::kRootModel,
+                       store_models(std::vector<LinearModel<K>>{root_model_}));
+    writer.add_section(SectionId::kLeafModels,
+                       store_models(second_level_models_));
+    writer.add_section(SectionId::kErrorBounds,
+                       store_error_bounds(second_level_error_bounds_));
+    std::vector<StoredHotKey<K>> hot_keys;
+    auto add_hot_key = [&](K key, int64_t position) {
+      hot_keys.push_back({key, position});
+    };
+    if (adaptive_ != nullptr) {
+      with_adaptive_table([&](const HotKeyTable<K, V>& table) {
+        table.for_each(add_hot_key);
+        return true;
+      });
+    } else {
+      look_up_table_.for_each(add_hot_key);
     }
+    hot_tier_.for_each(add_hot_key);
+    writer.add_section(SectionId::kHotTable, hot_keys);
+    return writer.write(path);
+  }
 
-    int root_model_output = root_model_.predict(key);
+  // Replace build() by loading the models and hot-key table that save()
+  // wrote for the same keys. Return false, leaving the index unchanged, if
+  // the file is missing, corrupted, or was built over other keys.
+  bool load(const std::string& path) {
+    IndexFileReader reader;
+    if (!reader.open(path, IndexKind::kLookUpTableLearnedIndex, sizeof(K),
+                     data_.size(), data_fingerprint(data_)) ||
+        !reader.has_section(SectionId::kHotTable)) {
+      return false;
+    }
+    Span<StoredModel> root = reader.section<StoredModel>(SectionId::kRootModel);
+    Span<StoredModel> leaves =
+        reader.section<StoredModel>(SectionId::kLeafModels);
+    std::vector<ErrorBound> error_bounds;
+    if (root.size() != 1 ||
+        !restore_error_bounds(
+            reader.section<StoredErrorBound>(SectionId::kErrorBounds),
+            &error_bounds) ||
+        error_bounds.size() != leaves.size()) {
+      return false;
+    }
+    Span<StoredHotKey<K>> hot_keys =
+        reader.section<StoredHotKey<K>>(SectionId::kHotTable);
+    HotKeyTable<K, V> look_up_table;
+    look_up_table.clear(hot_keys.size());
+    for (const auto& hot_key : hot_keys) {
+      if (hot_key.position < 0 ||
+          hot_key.position >= static_cast<int64_t>(data_.size()) ||
+          data_.key(hot_key.position) != hot_key.key) {
+        return false;
+      }
+      look_up_table.insert(hot_key.key, *data_.value(hot_key.position),
+                           hot_key.position);
+    }
+    root_model_ = restore_models<LinearModel<K>>(root)[0];
+    second_level_models_ = restore_models<LinearModel<K>>(leaves);
+    second_level_error_bounds_ = std::move(error_bounds);
+    look_up_table_ = std::move(look_up_table);
+    hot_tier_.clear();
+    adaptive_.reset();
+    return true;
+  }
+
+  int64_t get_last_mile_search_count() {
+    return last_mile_search_count_.load();
+  }
+
+  void reset_last_mile_search_count() {
+    last_mile_search_count_.reset();
+  }
+
+  // Return whether `key` is served by the hot-key table or tier.
+  bool is_hot_key(K key) {
+    if (adaptive_ != nullptr) {
+      return with_adaptive_table([key](const HotKeyTable<K, V>& table) {
+        return table.find(key) != nullptr;
+      });
+    }
+    return (hot_tier_.empty() ? look_up_table_.find(key)
+                              : hot_tier_.find(key)) != nullptr;
+  }
+
+  size_t hot_key_count() {
+    if (adaptive_ != nullptr) {
+      return with_adaptive_table(
+          [](const HotKeyTable<K, V>& table) { return table.size(); });
+    }
+    return hot_tier_.empty() ? look_up_table_.size() : hot_tier_.size();
+  }
+
+  AdaptiveStats get_adaptive_stats() {
+    if (adaptive_ == nullptr) {
+      return AdaptiveStats();
+    }
+    std::lock_guard<std::mutex> lock(adaptive_->mutex);
+    return adaptive_->stats;
+  }
+
+  // In adaptive mode, publish a table of the most frequent keys in the
+  // sketch and decay the sketch if `options.refresh_samples` samples were
+  // taken since the last refresh. Safe to call while lookups run, from any
+  // thread; concurrent calls refresh once. The tables are a fixed ring of
+  // kNumHotTables, and only a replaced table that no lookup is reading is
+  // rewritten; if there is none, the refresh is put off (returning false).
+  // Return true if a table was published.
+  bool maybe_refresh() {
+    if (adaptive_ == nullptr) {
+      return false;
+    }
+    AdaptiveState& state = *adaptive_;
+    std::unique_lock<std::mutex> refresh_lock(state.refresh_mutex,
+                                              std::try_to_lock);
+    if (!refresh_lock.owns_lock()) {
+      return false;
+    }
+    auto start_time = std::chrono::steady_clock::now();
+    // Lookups that pin a table after this check see that it is no longer
+    // published and let go of it without reading it.
+    size_t published = state.published.load();
+    size_t slot = kNumHotTables;
+    for (size_t i = 1; i < kNumHotTables && slot == kNumHotTables; i++) {
+      size_t candidate = (published + i) % kNumHotTables;
+      if (state.table_readers(candidate) == 0) {
+        slot = candidate;
+      }
+    }
+    std::vector<K> hot_keys;
+    {
+      std::lock_guard<std::mutex> lock(state.mutex);
+      if (state.samples_since_refresh < state.options.refresh_samples) {
+        return false;
+      }
+      if (slot == kNumHotTables) {
+        state.stats.deferred_refreshes++;
+        return false;
+      }
+      hot_keys = state.sketch.top(state.options.table_size);
+      state.sketch.decay();
+      state.samples_since_refresh = 0;
+    }
+
+    // Sampled lookups go on while the table is filled.
+    HotKeyTable<K, V>& table = state.tables[slot];
+    table.clear(state.options.table_size);
+    for (K key : hot_keys) {
+      // Keys that are looked up often but do not exist are left out.
+      int64_t pos = find_position<false>(key);
+      if (pos != -1) {
+        table.insert(key, *data_.value(pos), pos);
+      }
+    }
+    state.published.store(slot);
+
+    double refresh_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start_time)
+                            .count();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    AdaptiveStats& stats = state.stats;
+    stats.refreshes++;
+    stats.total_refresh_ns += refresh_ns;
+    stats.max_refresh_ns = std::max(stats.max_refresh_ns, refresh_ns);
+    return true;
+  }
+
+ private:
+  // Number of second-level models a build worker trains per task.
+  static constexpr size_t kModelsPerBuildTask = 64;
+  // Hot-key tables that adaptive refreshes take turns rewriting.
+  static constexpr size_t kNumHotTables = 4;
+  // Cache lines that spread the reader counts of the hot-key tables.
+  static constexpr size_t kNumReaderShards = 16;
+
+  // Fill look_up_table_ with the `table_size` distinct keys of largest weight
+  // (ties go to the later position) and return a bitmap of the records whose
+  // key is in the table.
+  // The candidates are picked with a bounded heap instead of sorting all n
+  // record indexes. Duplicate keys can make the top `table_size` records hold
+  // fewer distinct keys, in which case the selection is retried with twice as
+  // many candidates.
+  std::vector<bool> build_look_up_table(int table_size) {
+    std::vector<bool> is_hot(data_.size(), false);
+    size_t target = std::min<size_t>(std::max(table_size, 0), data_.size());
+    look_up_table_.clear(target);
+    // A candidate ranks higher if it has a larger weight, or the same weight
+    // and a larger position.
+    auto ranks_higher = [this](int64_t a, int64_t b) {
+      return weights_[a] != weights_[b] ? weights_[a] > weights_[b] : a > b;
+    };
+    size_t num_candidates = target;
+    while (look_up_table_.size() < target) {
+      // Min-heap (by rank) of the best num_candidates records seen so far.
+      std::vector<int64_t> candidates;
+      candidates.reserve(num_candidates);
+      for (size_t pos = 0; pos < data_.size(); pos++) {
+        if (candidates.size() < num_candidates) {
+          candidates.push_back(pos);
+          std::push_heap(candidates.begin(), candidates.end(), ranks_higher);
+        } else if (ranks_higher(pos, candidates.front())) {
+          std::pop_heap(candidates.begin(), candidates.end(), ranks_higher);
+          candidates.back() = pos;
+          std::push_heap(candidates.begin(), candidates.end(), ranks_higher);
+        }
+      }
+      std::sort(candidates.begin(), candidates.end(), ranks_higher);
+
+      look_up_table_.clear(target);
+      for (int64_t pos : candidates) {
+        if (look_up_table_.size() == target) {
+          break;
+        }
+        look_up_table_.insert(data_.key(pos), *data_.value(pos), pos);
+      }
+      if (num_candidates >= data_.size()) {
+        break;
+      }
+      num_candidates = std::min(2 * num_candidates, data_.size());
+    }
+
+    // Duplicates of a hot key sit next to each other in the sorted data.
+    look_up_table_.for_each([&](K key, int64_t position) {
+      int64_t first = position;
+      while (first > 0 && data_.key(first - 1) == key) {
+        first--;
+      }
+      for (size_t pos = first; pos < data_.size() && data_.key(pos) == key;
+           pos++) {
+        is_hot[pos] = true;
+      }
+    });
+    return is_hot;
+  }
+
+  struct AdaptiveState {
+    explicit AdaptiveState(const AdaptiveOptions& options)
+        : options(options), sketch(options.sketch_capacity) {}
+
+    const AdaptiveOptions options;
+    // Guards the sketch, the sample count and the stats. Sampled lookups
+    // that find it taken skip their sample rather than wait.
+    std::mutex mutex;
+    SpaceSavingSketch<K> sketch;
+    uint64_t samples_since_refresh = 0;
+    AdaptiveStats stats;
+    // Held by maybe_refresh(), the only writer of the tables.
+    std::mutex refresh_mutex;
+    // The tables and the index of the published one, which starts empty.
+    std::array<HotKeyTable<K, V>, kNumHotTables> tables;
+    std::atomic<size_t> published{0};
+    // Lookups reading each table, counted in the shard of their thread.
+    struct alignas(64) ReaderShard {
+      std::array<std::atomic<int64_t>, kNumHotTables> readers{};
+    };
+    std::array<ReaderShard, kNumReaderShards> reader_shards;
+
+    int64_t table_readers(size_t table) const {
+      int64_t readers = 0;
+      for (const ReaderShard& shard : reader_shards) {
+        readers += shard.readers[table].load();
+      }
+      return readers;
+    }
+  };
+
+  // Call fn on the published adaptive table and return its result. The
+  // table is pinned by a reader count meanwhile: the count is raised before
+  // checking that the table is still published, and maybe_refresh() only
+  // rewrites tables that are not published and have no readers (all with
+  // sequentially consistent atomics), so either the refresh sees the count
+  // or the lookup sees the new index and tries again.
+  template <class Fn>
+  auto with_adaptive_table(Fn fn) const {
+    static std::atomic<size_t> next_thread(0);
+    static thread_local size_t shard =
+        next_thread.fetch_add(1, std::memory_order_relaxed) %
+        kNumReaderShards;
+    AdaptiveState& state = *adaptive_;
+    auto& readers = state.reader_shards[shard].readers;
+    for (;;) {
+      size_t table = state.published.load();
+      readers[table].fetch_add(1);
+      if (state.published.load() == table) {
+        auto result = fn(state.tables[table]);
+        readers[table].fetch_sub(1, std::memory_order_release);
+        return result;
+      }
+      readers[table].fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Feed one lookup in sample_period to the sketch. The refresh itself is
+  // left to maybe_refresh(), off the lookup path.
+  void sample_lookup(K key, bool hit) {
+    // Shared by all indexes; it only spreads the samples.
+    static thread_local uint32_t lookups_to_next_sample = 1;
+    if (--lookups_to_next_sample != 0) {
+      return;
+    }
+    lookups_to_next_sample = adaptive_->options.sample_period;
+    std::unique_lock<std::mutex> lock(adaptive_->mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return;
+    }
+    adaptive_->sketch.add(key);
+    adaptive_->stats.sampled_lookups++;
+    adaptive_->stats.sampled_hits += hit;
+    adaptive_->samples_since_refresh++;
+  }
+
+  // Return the position of `key` in data_ as found through the models, or -1
+  // if the key does not exist. Last-mile searches are counted if
+  // kCountLastMile is set (lookups), and not for hot-key table refreshes.
+  template <bool kCountLastMile>
+  int64_t find_position(K key) {
+    int64_t root_model_output = root_model_.predict(key);
 
     // Use the root model's output to select a second-level model, then use
     // the second-level model to predict the key's position, then do a
     // last-mile search using the model's error bound to find the true position
-    // of the key. If the key exists, return a pointer to the value. If the
-    // key does not exist, return a nullptr.
+    // of the key.
     // NOTE: to receive full credit, the last-mile search should use the
     // `last_mile_search` method provided below.
       
-    int num_second_level_models = second_level_models_.size();
-    int second_level_index = std::max<int>(root_model_output, 0);
-    second_level_index = std::min<int>(second_level_index, num_second_level_models - 1);
+    int64_t num_second_level_models = second_level_models_.size();
+    int64_t second_level_index = std::max<int64_t>(root_model_output, 0);
+    second_level_index = std::min<int64_t>(second_level_index, num_second_level_models - 1);
     
-    int data_size = data_.size();
-    int predicted_index = second_level_models_[second_level_index].predict(key);
-    predicted_index = std::max<int>(predicted_index, 0);
-    predicted_index = std::min<int>(predicted_index, data_size - 1);
+    int64_t data_size = data_.size();
+    int64_t predicted_index = second_level_models_[second_level_index].predict(key);
+    predicted_index = std::max<int64_t>(predicted_index, 0);
+    predicted_index = std::min<int64_t>(predicted_index, data_size - 1);
 
-    if (data_[predicted_index].first == key) {
-      return &data_[predicted_index].second;
-    } else {
-      last_mile_search_count_ = last_mile_search_count_ + 1;
+    if (data_.key(predicted_index) == key) {
+      return predicted_index;
+    } else if (kCountLastMile) {
+      last_mile_search_count_.add(1);
     }
       
-    int error_bound = second_level_error_bounds_[second_level_index];
-    int start_search = predicted_index - error_bound;
-    int end_search = predicted_index + error_bound;
+    const ErrorBound& error_bound = second_level_error_bounds_[second_level_index];
+    int64_t start_search = predicted_index + error_bound.min_error;
+    int64_t end_search = predicted_index + error_bound.max_error + 1;
     //clip
-    start_search = std::max<int>(start_search, 0);
-    end_search = std::max<int>(end_search, 0);
-    start_search = std::min<int>(start_search, data_size);
-    end_search = std::min<int>(end_search, data_size);
+    start_search = std::max<int64_t>(start_search, 0);
+    end_search = std::max<int64_t>(end_search, 0);
+    start_search = std::min<int64_t>(start_search, data_size);
+    end_search = std::min<int64_t>(end_search, data_size);
       
-    int pos = last_mile_search(key, start_search, end_search);
-    if (pos == -1) {
-        return nullptr;
-    }
-    return &data_[pos].second;
-  }
-
-  int get_last_mile_search_count() {
-    return last_mile_search_count_;
-  }
-
-  void reset_last_mile_search_count() {
-    last_mile_search_count_ = 0;
+    return last_mile_search(key, predicted_index, start_search, end_search,
+                            error_bound.strategy);
   }
 
- private:
-  // Do a binary search for the position of a key in the data.
+  // Search for the position of a key in the data, either with a binary search
+  // or by galloping outward from the predicted position (see
+  // last_mile_search.h).
   // Only search in the range between the given start position (inclusive)
   // and end position (exclusive).
   // If the key is not found in the data, return -1.
-  int last_mile_search(K key, int start_pos, int end_pos) const {
-    int pos = std::lower_bound(
-                  data_.begin() + start_pos, data_.begin() + end_pos, key,
-                  [](auto const& pair, K key) { return pair.first < key; }) -
-              data_.begin();
-    if (pos > static_cast<int>(data_.size()) || data_[pos].first != key) {
+  int64_t last_mile_search(K key, int64_t predicted_pos, int64_t start_pos,
+                           int64_t end_pos, SearchStrategy strategy) const {
+    int64_t pos;
+    if (strategy == SearchStrategy::kExponential && start_pos < end_pos) {
+      predicted_pos = std::min(std::max(predicted_pos, start_pos), end_pos - 1);
+      pos = exponential_search(data_, key, predicted_pos, start_pos, end_pos);
+    } else {
+      pos = data_.lower_bound(key, start_pos, end_pos);
+    }
+    if (pos >= static_cast<int64_t>(data_.size()) || data_.key(pos) != key) {
       return -1;
     } else {
       return pos;
     }
   }
 
-  std::unordered_map<K, int>  look_up_table_;
-  std::vector<record> data_;
+  // Maps each hot key to a copy of its value (and its position in data_).
+  HotKeyTable<K, V> look_up_table_;
+  std::unique_ptr<AdaptiveState> adaptive_;
+  // The hot keys after build_tiered(), which leaves look_up_table_ empty.
+  HotTier<K, V> hot_tier_;
+  Storage data_;
   std::vector<double> weights_;
   LinearModel<K> root_model_;
   std::vector<LinearModel<K>> second_level_models_;
-  // The maximum prediction error for each second-level model.
-  std::vector<int> second_level_error_bounds_;
-  int last_mile_search_count_;
+  // The signed prediction error range and last-mile search strategy for each
+  // second-level model.
+  std::vector<ErrorBound> second_level_error_bounds_;
+  ShardedCounter last_mile_search_count_;
 };
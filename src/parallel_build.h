@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/* Fork-join helpers for building the learned indexes on several threads.
+ * Work is always split the same way for a given input and thread count, and
+ * every task writes only to its own output slots, so a parallel build produces
+ * exactly the same models and error bounds as a sequential one.
+ */
+
+// Split [0, n) into `num_threads` contiguous chunks and run
+// fn(chunk, begin, end) for every chunk, each chunk on its own thread. The
+// chunk boundaries only depend on n and num_threads.
+template <class Fn>
+void parallel_chunks(size_t n, int num_threads, Fn fn) {
+  size_t num_chunks = std::max(num_threads, 1);
+  auto run_chunk = [&](size_t chunk) {
+    fn(chunk, n * chunk / num_chunks, n * (chunk + 1) / num_chunks);
+  };
+  std::vector<std::thread> workers;
+  for (size_t chunk = 1; chunk < num_chunks; chunk++) {
+    workers.emplace_back(run_chunk, chunk);
+  }
+  run_chunk(0);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+// Run fn(begin, end) over [0, n) in blocks of `grain` indexes. A pool of
+// `num_threads` workers pulls blocks from a shared counter, which balances
+// blocks of uneven cost (e.g., second-level models of very different sizes).
+template <class Fn>
+void parallel_for(size_t n, int num_threads, size_t grain, Fn fn) {
+  grain = std::max<size_t>(grain, 1);
+  std::atomic<size_t> next_block(0);
+  auto worker_loop = [&]() {
+    while (true) {
+      size_t begin = next_block.fetch_add(grain);
+      if (begin >= n) {
+        return;
+      }
+      fn(begin, std::min(begin + grain, n));
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int i = 1; i < num_threads; i++) {
+    workers.emplace_back(worker_loop);
+  }
+  worker_loop();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+// Number of records whose root predictions compute_segment_ends requests at
+// once.
+constexpr size_t kPredictBlockSize = 256;
+
+// Compute the (exclusive) end position of every second-level model's records.
+// predict_block(begin, count, out) must write the root model output of the
+// sorted records [begin, begin + count) to out[0, count), clamped to
+// [0, num_segments - 1]; count is at most kPredictBlockSize. Evaluating the
+// root model a block at a time lets it use the batched kernels of
+// simd_predict.h.
+//
+// The sequential assignment loop in build() hands record p to segment
+// max(pred(0), ..., pred(p)): a prefix maximum of the clamped root
+// predictions. This computes that prefix maximum with a two-pass parallel
+// scan (per-chunk maxima, then a sequential carry across chunks) and records
+// every segment boundary it crosses.
+template <class PredictBlockFn>
+std::vector<size_t> compute_segment_ends(size_t n, size_t num_segments,
+                                         int num_threads,
+                                         PredictBlockFn predict_block) {
+  // Run fn(pos, segment) for every record in [begin, end).
+  auto for_each_segment = [&](size_t begin, size_t end, auto&& fn) {
+    int64_t segments[kPredictBlockSize];
+    for (size_t block = begin; block < end; block += kPredictBlockSize) {
+      size_t count = std::min(kPredictBlockSize, end - block);
+      predict_block(block, count, segments);
+      for (size_t i = 0; i < count; i++) {
+        fn(block + i, static_cast<size_t>(segments[i]));
+      }
+    }
+  };
+
+  size_t num_chunks = std::max(num_threads, 1);
+  std::vector<size_t> chunk_max(num_chunks, 0);
+  parallel_chunks(n, num_threads, [&](size_t chunk, size_t begin, size_t end) {
+    size_t segment = 0;
+    for_each_segment(begin, end, [&](size_t, size_t record_segment) {
+      segment = std::max(segment, record_segment);
+    });
+    chunk_max[chunk] = segment;
+  });
+
+  std::vector<size_t> carry(num_chunks);
+  size_t running_max = 0;
+  for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+    carry[chunk] = running_max;
+    running_max = std::max(running_max, chunk_max[chunk]);
+  }
+
+  // Segments past the last record's segment end at n. Every other boundary is
+  // crossed in exactly one chunk, so the chunks write disjoint entries.
+  std::vector<size_t> segment_ends(num_segments, n);
+  parallel_chunks(n, num_threads, [&](size_t chunk, size_t begin, size_t end) {
+    size_t current = carry[chunk];
+    for_each_segment(begin, end, [&](size_t pos, size_t record_segment) {
+      size_t segment = std::max(current, record_segment);
+      for (size_t i = current; i < segment; i++) {
+        segment_ends[i] = pos;
+      }
+      current = segment;
+    });
+  });
+  return segment_ends;
+}
+
+// How evenly a root stage spreads the records over the second-level models,
+// from the end positions that compute_segment_ends returns.
+struct SegmentSizeStats {
+  size_t num_segments = 0;
+  size_t empty_segments = 0;
+  size_t max_size = 0;
+  double mean_size = 0;
+  double size_variance = 0;
+};
+
+inline SegmentSizeStats compute_segment_size_stats(
+    const std::vector<size_t>& segment_ends) {
+  SegmentSizeStats stats;
+  stats.num_segments = segment_ends.size();
+  if (segment_ends.empty()) {
+    return stats;
+  }
+  stats.mean_size =
+      static_cast<double>(segment_ends.back()) / segment_ends.size();
+  size_t start = 0;
+  for (size_t end : segment_ends) {
+    size_t size = end - start;
+    stats.empty_segments += size == 0;
+    stats.max_size = std::max(stats.max_size, size);
+    double deviation = size - stats.mean_size;
+    stats.size_variance += deviation * deviation;
+    start = end;
+  }
+  stats.size_variance /= segment_ends.size();
+  return stats;
+}
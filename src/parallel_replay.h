@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "span.h"
+
+// SOSD's helpers (which need <limits>); only set_cpu_affinity is used here.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "util.h"
+#pragma GCC diagnostic pop
+
+/* Replay a lookup workload on several pinned threads at once.
+ *
+ * The workload is split into contiguous slices, one per thread. Thread i is
+ * pinned to core i (modulo the number of cores) and waits at a barrier until
+ * every thread is pinned and ready, so that all slices start together. Each
+ * thread times its own slice; the aggregate time runs from the first thread
+ * starting until the last one finishing.
+ */
+
+struct ReplayResult {
+  int num_threads = 0;
+  int64_t num_lookups = 0;
+  // Wall time of the whole replay and of every thread's slice, in seconds.
+  double time = 0;
+  std::vector<double> thread_times;
+  std::vector<int64_t> thread_lookups;
+  // False if a lookup reported failure.
+  bool ok = true;
+
+  // Millions of lookups per second over all threads.
+  double aggregate_throughput() const {
+    return time > 0 ? num_lookups / time / 1e6 : 0;
+  }
+  double thread_throughput(int thread) const {
+    return thread_times[thread] > 0
+               ? thread_lookups[thread] / thread_times[thread] / 1e6
+               : 0;
+  }
+};
+
+// Releases all waiting threads once `num_threads` threads have arrived. It
+// yields while waiting, since the threads may share a core.
+class StartBarrier {
+ public:
+  explicit StartBarrier(int num_threads) : remaining_(num_threads) {}
+
+  void arrive_and_wait() {
+    remaining_.fetch_sub(1, std::memory_order_acq_rel);
+    while (remaining_.load(std::memory_order_acquire) > 0) {
+      std::this_thread::yield();
+    }
+  }
+
+ private:
+  std::atomic<int> remaining_;
+};
+
+// Call lookup(key) for every key of the workload on `num_threads` threads.
+// lookup must be safe to call concurrently and return false on failure.
+template <class K, class Lookup>
+ReplayResult replay_parallel(Span<K> workload, int num_threads,
+                             Lookup lookup) {
+  typedef std::chrono::steady_clock clock;
+  num_threads = std::max(num_threads, 1);
+  ReplayResult result;
+  result.num_threads = num_threads;
+  result.num_lookups = workload.size();
+  result.thread_times.resize(num_threads);
+  result.thread_lookups.resize(num_threads);
+
+  StartBarrier barrier(num_threads);
+  std::vector<clock::time_point> start_times(num_threads);
+  std::vector<clock::time_point> end_times(num_threads);
+  std::atomic<bool> ok(true);
+  auto replay_slice = [&](int thread) {
+    util::set_cpu_affinity(thread);
+    size_t begin = workload.size() * thread / num_threads;
+    size_t end = workload.size() * (thread + 1) / num_threads;
+    Span<K> slice = workload.subspan(begin, end - begin);
+    barrier.arrive_and_wait();
+    start_times[thread] = clock::now();
+    bool slice_ok = true;
+    for (K key : slice) {
+      slice_ok &= lookup(key);
+    }
+    end_times[thread] = clock::now();
+    result.thread_times[thread] =
+        std::chrono::duration<double>(end_times[thread] - start_times[thread])
+            .count();
+    result.thread_lookups[thread] = slice.size();
+    if (!slice_ok) {
+      ok.store(false, std::memory_order_relaxed);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int thread = 0; thread < num_threads; thread++) {
+    workers.emplace_back(replay_slice, thread);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  result.time = std::chrono::duration<double>(
+                    *std::max_element(end_times.begin(), end_times.end()) -
+                    *std::min_element(start_times.begin(), start_times.end()))
+                    .count();
+  result.ok = ok.load();
+  return result;
+}
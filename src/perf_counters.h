@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+
+// SOSD's wrapper around perf_event_open (needs <cstdint> and <sstream>).
+#include "utils/perf_event.h"
+
+/* Hardware performance counters for the phases of a benchmark run.
+ *
+ * One PerfCounters object opens the counters once and measures one phase at a
+ * time: start() before the phase and stop() after it, which returns the
+ * counts of that phase divided by its number of operations (records for a
+ * build, lookups for a workload). Without counter access (no Linux, a
+ * restrictive perf_event_paranoid setting or a virtual machine that does not
+ * expose the PMU) every phase reports the counters as unavailable.
+ */
+
+struct PhaseCounters {
+  bool available = false;
+  double cycles = 0;
+  double instructions = 0;
+  double llc_misses = 0;
+  double branch_misses = 0;
+
+  double ipc() const { return cycles > 0 ? instructions / cycles : 0; }
+};
+
+class PerfCounters {
+ public:
+  void start() { event_.startCounters(); }
+
+  PhaseCounters stop(uint64_t num_operations) {
+    event_.stopCounters();
+    PhaseCounters counters;
+#if defined(__linux__)
+    if (!event_.events.empty() && num_operations > 0) {
+      counters.available = true;
+      counters.cycles = event_.getCounter("cycles") / num_operations;
+      counters.instructions =
+          event_.getCounter("instructions") / num_operations;
+      counters.llc_misses = event_.getCounter("LLC-misses") / num_operations;
+      counters.branch_misses =
+          event_.getCounter("branch-misses") / num_operations;
+    }
+#else
+    (void)num_operations;
+#endif
+    return counters;
+  }
+
+ private:
+  PerfEvent event_;
+};
+
+// Append cycles, IPC, LLC misses and branch misses per operation as
+// tab-separated columns ("NA" if the counters are unavailable).
+inline void write_perf_columns(std::ostream& os,
+                               const PhaseCounters& counters) {
+  if (!counters.available) {
+    os << "\tNA\tNA\tNA\tNA";
+    return;
+  }
+  os << "\t" << counters.cycles << "\t" << counters.ipc() << "\t"
+     << counters.llc_misses << "\t" << counters.branch_misses;
+}
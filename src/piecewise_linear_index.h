@@ -0,0 +1,359 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "last_mile_search.h"
+#include "parallel_build.h"
+#include "range_scan.h"
+#include "record_storage.h"
+#include "rmi_models.h"
+#include "sharded_counter.h"
+#include "span.h"
+
+// One piece of PiecewiseLinearIndex: a line through its first point.
+template <class K>
+struct LinearPiece {
+  K first_key;
+  double slope;
+  // Position of first_key.
+  int64_t intercept;
+
+  // The predicted position of `key`, clamped to [0, max_position].
+  int64_t predict(K key, int64_t max_position) const {
+    double position = slope * key_offset(key, first_key) + intercept;
+    return static_cast<int64_t>(std::min(
+        std::max(position, 0.0), static_cast<double>(max_position)));
+  }
+};
+
+// Cuts points streamed to add() in strictly increasing key order into
+// linear pieces that stay within `epsilon` positions of each of their
+// points.
+template <class K>
+class PieceFitter {
+ public:
+  PieceFitter(int64_t epsilon, std::vector<LinearPiece<K>>* pieces)
+      : epsilon_(epsilon), pieces_(pieces) {}
+
+  void add(K key, int64_t position) {
+    if (open_) {
+      // The slopes through the first point that keep this point within
+      // epsilon. The piece can take the point if they still overlap the
+      // slopes that keep all earlier points within epsilon.
+      double dx = key_offset(key, first_key_);
+      double dy = static_cast<double>(position - first_position_);
+      double min_slope = (dy - epsilon_) / dx;
+      double max_slope = (dy + epsilon_) / dx;
+      if (min_slope <= max_slope_ && max_slope >= min_slope_) {
+        min_slope_ = std::max(min_slope_, min_slope);
+        max_slope_ = std::min(max_slope_, max_slope);
+        return;
+      }
+      finish();
+    }
+    open_ = true;
+    first_key_ = key;
+    first_position_ = position;
+    // Slopes stay non-negative, so that predictions never decrease.
+    min_slope_ = 0;
+    max_slope_ = std::numeric_limits<double>::infinity();
+  }
+
+  // Close the last piece.
+  void finish() {
+    if (!open_) {
+      return;
+    }
+    double slope = max_slope_ == std::numeric_limits<double>::infinity()
+                       ? 0
+                       : (min_slope_ + max_slope_) / 2;
+    pieces_->push_back({first_key_, slope, first_position_});
+    open_ = false;
+  }
+
+ private:
+  int64_t epsilon_;
+  std::vector<LinearPiece<K>>* pieces_;
+  bool open_ = false;
+  K first_key_ = K();
+  int64_t first_position_ = 0;
+  double min_slope_ = 0;
+  double max_slope_ = 0;
+};
+
+/* An error-bounded piecewise linear index in the style of the PGM-index.
+ *
+ * Instead of letting a root model decide which keys a second-level model
+ * gets, build(epsilon) cuts the sorted keys into linear pieces that each
+ * predict every one of their keys within `epsilon` positions. The pieces are
+ * cut greedily with the shrinking cone of the FITing-tree: a piece starts at
+ * a key and grows while some line through that first point stays within
+ * epsilon of all its points. A key belongs to the last piece whose first key
+ * is not greater than it.
+ *
+ * The first keys of the pieces are cut into pieces in the same way, with a
+ * smaller `routing_epsilon`, level after level up to a single piece. A
+ * lookup walks down the levels, each time searching a window of a few first
+ * keys of the level below, and finally searches the last-mile window of the
+ * records.
+ *
+ * Every prediction is clamped to the first position of the next piece, and
+ * duplicate keys are fit at their first position. Each level therefore has a
+ * single error bound, measured on its own keys at build time, and no window
+ * is wider than 2 * epsilon + 2 positions, whatever the key distribution.
+ */
+template <class K, class V, class Storage = PairStorage<K, V>>
+class PiecewiseLinearIndex {
+  static_assert(std::is_arithmetic<K>::value,
+                "Learned index key type must be numeric.");
+
+ public:
+  typedef std::pair<K, V> record;
+
+  // Epsilon of the levels above the pieces over the records, as in the
+  // PGM-index: their windows are searched for every lookup.
+  static constexpr size_t kDefaultRoutingEpsilon = 4;
+
+  // Takes ownership of the records; pass them with std::move to avoid a copy.
+  PiecewiseLinearIndex(std::vector<record> data) : data_(std::move(data)) {}
+
+  // Index keys[i] with payload values[i] (see LearnedIndex).
+  PiecewiseLinearIndex(Span<K> keys, std::vector<V> values)
+      : data_(keys, std::move(values)) {}
+
+  // Cut the records into pieces that predict each key within `epsilon`
+  // positions, and the first keys of every level into pieces within
+  // `routing_epsilon`, using `num_threads` threads. Each thread cuts its own
+  // share of the records, so a parallel build may end up with up to
+  // num_threads - 1 more pieces than a sequential one.
+  void build(size_t epsilon, size_t routing_epsilon = kDefaultRoutingEpsilon,
+             int num_threads = 1) {
+    assert(data_.size() > 0);
+    assert(num_threads > 0);
+    levels_.clear();
+    error_bounds_.clear();
+
+    // The pieces over the records. A key is fit at its first position; the
+    // positions of its duplicates are skipped.
+    size_t num_chunks = std::max(num_threads, 1);
+    std::vector<std::vector<LinearPiece<K>>> chunk_pieces(num_chunks);
+    parallel_chunks(data_.size(), num_threads,
+                    [&](size_t chunk, size_t begin, size_t end) {
+      PieceFitter<K> fitter(epsilon, &chunk_pieces[chunk]);
+      for (size_t pos = begin; pos < end; pos++) {
+        if (pos == 0 || data_.key(pos - 1) != data_.key(pos)) {
+          fitter.add(data_.key(pos), pos);
+        }
+      }
+      fitter.finish();
+    });
+    levels_.emplace_back();
+    for (const auto& pieces : chunk_pieces) {
+      levels_[0].insert(levels_[0].end(), pieces.begin(), pieces.end());
+    }
+    error_bounds_.push_back(measure_level(0, num_threads));
+
+    // The routing levels, each over the first keys of the level below. Every
+    // piece takes at least two points, so each level is at most half as
+    // large as the one below.
+    while (levels_.back().size() > 1) {
+      std::vector<LinearPiece<K>> pieces;
+      PieceFitter<K> fitter(routing_epsilon, &pieces);
+      const std::vector<LinearPiece<K>>& below = levels_.back();
+      for (size_t i = 0; i < below.size(); i++) {
+        fitter.add(below[i].first_key, i);
+      }
+      fitter.finish();
+      levels_.push_back(std::move(pieces));
+      error_bounds_.push_back(measure_level(levels_.size() - 1, 1));
+    }
+  }
+
+  // If the key exists, return a pointer to the corresponding value in data_.
+  // If the key does not exist, return a nullptr.
+  V* get_value(K key) {
+    assert(!levels_.empty());
+    int64_t predicted_index = predict(0, find_piece(key), key);
+    if (data_.key(predicted_index) == key) {
+      return data_.value(predicted_index);
+    }
+    last_mile_search_count_.add(1);
+
+    int64_t data_size = data_.size();
+    const ErrorBound& error_bound = error_bounds_[0];
+    int64_t start_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.min_error, 0), data_size);
+    int64_t end_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.max_error + 1, 0),
+        data_size);
+    int64_t pos;
+    if (error_bound.strategy == SearchStrategy::kExponential &&
+        start_search < end_search) {
+      predicted_index = std::min(std::max(predicted_index, start_search),
+                                 end_search - 1);
+      pos = exponential_search(data_, key, predicted_index, start_search,
+                               end_search);
+    } else {
+      pos = data_.lower_bound(key, start_search, end_search);
+    }
+    if (pos >= data_size || data_.key(pos) != key) {
+      return nullptr;
+    }
+    return data_.value(pos);
+  }
+
+  // Return the position of the first record whose key is not less than
+  // `key`, or the number of records if there is none (see range_scan.h).
+  size_t lower_bound(K key) const {
+    assert(!levels_.empty());
+    int64_t predicted_index = predict(0, find_piece(key), key);
+    int64_t data_size = data_.size();
+    const ErrorBound& error_bound = error_bounds_[0];
+    int64_t start_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.min_error, 0), data_size);
+    int64_t end_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.max_error + 1, 0),
+        data_size);
+    return window_lower_bound(data_, key, predicted_index, start_search,
+                              end_search, error_bound.strategy);
+  }
+
+  // The records whose keys lie in [lo, hi), in key order.
+  RecordRange<Storage> range(K lo, K hi) const {
+    return RecordRange<Storage>::until(data_, lower_bound(lo), hi);
+  }
+
+  // Call fn(key, value) for every record whose key lies in [lo, hi), in key
+  // order, and return the number of records visited.
+  template <class Fn>
+  size_t scan(K lo, K hi, Fn fn) const {
+    RecordRange<Storage> records = range(lo, hi);
+    records.for_each(fn);
+    return records.size();
+  }
+
+  // Number of pieces on every level, starting with the single top piece and
+  // ending with the pieces over the records.
+  std::vector<size_t> level_sizes() const {
+    std::vector<size_t> sizes;
+    for (size_t level = levels_.size(); level-- > 0;) {
+      sizes.push_back(levels_[level].size());
+    }
+    return sizes;
+  }
+
+  size_t num_pieces() const { return levels_.empty() ? 0 : levels_[0].size(); }
+
+  // Bytes of all pieces and error bounds.
+  size_t model_bytes() const {
+    size_t bytes = error_bounds_.size() * sizeof(ErrorBound);
+    for (const auto& pieces : levels_) {
+      bytes += pieces.size() * sizeof(LinearPiece<K>);
+    }
+    return bytes;
+  }
+
+  // The error bound of the pieces over the records; the last-mile window of
+  // every lookup is max_error - min_error + 1 positions wide.
+  const ErrorBound& leaf_error_bound() const { return error_bounds_[0]; }
+  const Storage& data() const { return data_; }
+
+  int64_t get_last_mile_search_count() {
+    return last_mile_search_count_.load();
+  }
+
+  void reset_last_mile_search_count() {
+    last_mile_search_count_.reset();
+  }
+
+ private:
+  // Number of pieces over which a build worker measures errors per task.
+  static constexpr size_t kPiecesPerBuildTask = 64;
+
+  // Number of entries of the level below `level`, i.e., of the positions
+  // its pieces predict.
+  int64_t size_below(size_t level) const {
+    return level == 0 ? data_.size() : levels_[level - 1].size();
+  }
+
+  // Prediction of piece `piece` of `level` for `key`, clamped to the first
+  // position of the next piece. That position is also the prediction for
+  // the first key of the next piece, so predictions never decrease across
+  // pieces either.
+  int64_t predict(size_t level, size_t piece, K key) const {
+    const std::vector<LinearPiece<K>>& pieces = levels_[level];
+    int64_t max_position = piece + 1 < pieces.size()
+                               ? pieces[piece + 1].intercept
+                               : size_below(level) - 1;
+    return pieces[piece].predict(key, max_position);
+  }
+
+  // Measure the errors of the pieces of `level` on their own points.
+  ErrorBound measure_level(size_t level, int num_threads) const {
+    const std::vector<LinearPiece<K>>& pieces = levels_[level];
+    size_t num_chunks = std::max(num_threads, 1);
+    std::vector<ErrorBoundTracker> chunk_trackers(num_chunks);
+    parallel_chunks(pieces.size(), num_threads,
+                    [&](size_t chunk, size_t first_piece, size_t last_piece) {
+      ErrorBoundTracker& error_tracker = chunk_trackers[chunk];
+      for (size_t i = first_piece; i < last_piece; i++) {
+        int64_t end = i + 1 < pieces.size() ? pieces[i + 1].intercept
+                                            : size_below(level);
+        for (int64_t pos = pieces[i].intercept; pos < end; pos++) {
+          K key = level == 0 ? data_.key(pos) : levels_[level - 1][pos].first_key;
+          if (level == 0 && pos > pieces[i].intercept &&
+              data_.key(pos - 1) == key) {
+            continue;
+          }
+          error_tracker.add(pos - predict(level, i, key));
+        }
+      }
+    });
+    for (size_t chunk = 1; chunk < num_chunks; chunk++) {
+      chunk_trackers[0].merge(chunk_trackers[chunk]);
+    }
+    return chunk_trackers[0].finish();
+  }
+
+  // The piece over the records for `key`: the last one whose first key is
+  // not greater than `key`, or the first one.
+  //
+  // Let x_i be the last first key of the level below that is not greater
+  // than `key`. The prediction for `key` is at least that for x_i and at most
+  // that for x_{i + 1}, or the clamp when x_{i + 1} is in the next piece.
+  // Hence i lies in [prediction + min_error - 1, prediction + max_error].
+  size_t find_piece(K key) const {
+    size_t piece = 0;
+    for (size_t level = levels_.size() - 1; level > 0; level--) {
+      const std::vector<LinearPiece<K>>& below = levels_[level - 1];
+      int64_t num_below = below.size();
+      int64_t predicted = predict(level, piece, key);
+      const ErrorBound& error_bound = error_bounds_[level];
+      int64_t start = std::min<int64_t>(
+          std::max<int64_t>(predicted + error_bound.min_error - 1, 0),
+          num_below - 1);
+      int64_t end = std::min<int64_t>(
+          std::max<int64_t>(predicted + error_bound.max_error + 1, start + 1),
+          num_below);
+      auto next = std::upper_bound(
+          below.begin() + start, below.begin() + end, key,
+          [](K key, const LinearPiece<K>& p) { return key < p.first_key; });
+      piece = std::max<int64_t>(next - below.begin() - 1, start);
+    }
+    return piece;
+  }
+
+  Storage data_;
+  // levels_[0] holds the pieces over the records and every other level the
+  // pieces over the first keys of the level below; the last level has a
+  // single piece.
+  std::vector<std::vector<LinearPiece<K>>> levels_;
+  // The signed prediction error range and last-mile search strategy of
+  // each level.
+  std::vector<ErrorBound> error_bounds_;
+  ShardedCounter last_mile_search_count_;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+/* A root stage that routes keys to leaves of equal size, after the radix
+ * hint of SOSD's RadixSpline and RadixBinarySearch.
+ *
+ * A linear root over skewed keys (e.g., timestamps that cluster) sends most
+ * keys to a few leaves and leaves the rest empty. RadixRoot instead takes
+ * the first key of every leaf, a pivot, so that each leaf gets the same
+ * number of records, and selects the last pivot that is not greater than a
+ * key. To find it quickly it splits the key range into 2^radix_bits equal
+ * buckets (the top bits of key - min_key for integer keys) and keeps, per
+ * bucket, the first pivot in it. A lookup then only searches the pivots of
+ * its key's bucket, which hold about two pivots on average.
+ *
+ * Any mapping from keys to buckets that never decreases works: a pivot in
+ * an earlier bucket is smaller than the key and one in a later bucket is
+ * larger, so the answer is in the key's bucket or is the pivot just before
+ * it.
+ */
+template <class K>
+class RadixRoot {
+  static_assert(std::is_arithmetic<K>::value,
+                "Radix root key type must be numeric.");
+
+ public:
+  // Route to one leaf per pivot; `pivots` must be sorted and not empty.
+  // About two buckets are used per pivot.
+  void build(std::vector<K> pivots) {
+    assert(!pivots.empty() && pivots.size() < UINT32_MAX);
+    pivots_ = std::move(pivots);
+    min_key_ = pivots_.front();
+    K max_key = pivots_.back();
+    int radix_bits = bit_width(pivots_.size()) + 1;
+    size_t num_buckets;
+    if constexpr (std::is_integral<K>::value) {
+      typedef std::make_unsigned_t<K> U;
+      U range = static_cast<U>(max_key) - static_cast<U>(min_key_);
+      shift_ = std::max(bit_width(range) - radix_bits, 0);
+      num_buckets = static_cast<size_t>(range >> shift_) + 1;
+    } else {
+      num_buckets = size_t(1) << radix_bits;
+      double range = static_cast<double>(max_key) - min_key_;
+      scale_ = range > 0 ? (num_buckets - 1) / range : 0;
+    }
+
+    // first_pivot_[b] is the first pivot in bucket b or later; the extra
+    // entry closes the last bucket.
+    first_pivot_.assign(num_buckets + 1, pivots_.size());
+    for (size_t i = pivots_.size(); i-- > 0;) {
+      first_pivot_[bucket(pivots_[i])] = i;
+    }
+    for (size_t b = num_buckets; b-- > 0;) {
+      first_pivot_[b] = std::min(first_pivot_[b], first_pivot_[b + 1]);
+    }
+  }
+
+  bool empty() const { return pivots_.empty(); }
+
+  // The leaf of the last pivot not greater than `key`, or leaf 0.
+  size_t route(K key) const {
+    size_t b = bucket(key);
+    auto begin = pivots_.begin() + first_pivot_[b];
+    auto end = pivots_.begin() + first_pivot_[b + 1];
+    size_t next = std::upper_bound(begin, end, key) - pivots_.begin();
+    return next > 0 ? next - 1 : 0;
+  }
+
+  const std::vector<K>& pivots() const { return pivots_; }
+  size_t size_bytes() const {
+    return pivots_.size() * sizeof(K) +
+           first_pivot_.size() * sizeof(uint32_t);
+  }
+
+ private:
+  template <class T>
+  static int bit_width(T x) {
+    int width = 0;
+    for (; x != 0; x >>= 1) {
+      width++;
+    }
+    return width;
+  }
+
+  size_t bucket(K key) const {
+    size_t last_bucket = first_pivot_.size() - 2;
+    if (!(key > min_key_)) {
+      return 0;
+    }
+    if constexpr (std::is_integral<K>::value) {
+      typedef std::make_unsigned_t<K> U;
+      U offset = static_cast<U>(key) - static_cast<U>(min_key_);
+      return std::min<size_t>(offset >> shift_, last_bucket);
+    } else {
+      return static_cast<size_t>(
+          std::min((static_cast<double>(key) - min_key_) * scale_,
+                   static_cast<double>(last_bucket)));
+    }
+  }
+
+  std::vector<K> pivots_;
+  std::vector<uint32_t> first_pivot_;
+  K min_key_ = K();
+  // Integer keys: bucket = (key - min_key_) >> shift_.
+  int shift_ = 0;
+  // Floating point keys: bucket = (key - min_key_) * scale_.
+  double scale_ = 0;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "last_mile_search.h"
+
+/* Ordered access shared by the learned indexes: lower_bound(), range() and
+ * scan().
+ *
+ * A second-level error bound only covers the keys its model was trained on.
+ * A key that is not in the data, or that lies outside the keys (where the
+ * root and leaf predictions are clamped), may have its lower bound outside
+ * the last-mile window, and so may a hot key of LookUpTableLearnedIndex,
+ * whose models are trained without them. The window search is therefore
+ * checked against the keys just outside the window and, if the lower bound
+ * lies beyond an edge, finished by galloping away from that edge.
+ */
+
+// Number of records that RecordRange::for_each prefetches ahead.
+constexpr size_t kScanPrefetchDistance = 16;
+
+// Return the first position of `data` whose key is not less than `key`, or
+// data.size(), searching the last-mile window [start_pos, end_pos) around
+// `predicted_pos` with `strategy` first.
+template <class Storage, class K>
+size_t window_lower_bound(const Storage& data, K key, int64_t predicted_pos,
+                          int64_t start_pos, int64_t end_pos,
+                          SearchStrategy strategy) {
+  size_t pos;
+  if (strategy == SearchStrategy::kExponential && start_pos < end_pos) {
+    predicted_pos = std::min(std::max(predicted_pos, start_pos), end_pos - 1);
+    pos = exponential_search(data, key, predicted_pos, start_pos, end_pos);
+  } else {
+    pos = data.lower_bound(key, start_pos, end_pos);
+  }
+  size_t data_size = data.size();
+  if (pos == static_cast<size_t>(start_pos) && pos > 0 &&
+      !(data.key(pos - 1) < key)) {
+    return exponential_search(data, key, pos - 1, 0, pos);
+  }
+  if (pos == static_cast<size_t>(end_pos) && pos < data_size &&
+      data.key(pos) < key) {
+    return exponential_search(data, key, pos, pos, data_size);
+  }
+  return pos;
+}
+
+// The records at positions [begin, end) of a storage, in key order. It is a
+// view: the storage must outlive it.
+template <class Storage>
+class RecordRange {
+ public:
+  typedef typename Storage::record record;
+  typedef typename record::first_type K;
+  typedef typename record::second_type V;
+
+  RecordRange(const Storage& data, size_t begin, size_t end)
+      : data_(&data), begin_(begin), end_(end) {}
+
+  // The range of the records of `data` from `begin` on whose keys are less
+  // than `hi`. The end is found by galloping from `begin`, so it costs
+  // O(log(size())) probes, which a scan reads anyway.
+  static RecordRange until(const Storage& data, size_t begin, K hi) {
+    size_t end = begin < data.size() ? exponential_search(data, hi, begin,
+                                                          begin, data.size())
+                                     : begin;
+    return RecordRange(data, begin, end);
+  }
+
+  size_t begin_position() const { return begin_; }
+  size_t end_position() const { return end_; }
+  size_t size() const { return end_ - begin_; }
+  bool empty() const { return begin_ == end_; }
+
+  // The key and payload of the i-th record of the range.
+  K key(size_t i) const { return data_->key(begin_ + i); }
+  const V* value(size_t i) const { return data_->value(begin_ + i); }
+
+  // Call fn(key, value) for every record in key order, prefetching the
+  // records kScanPrefetchDistance positions ahead.
+  template <class Fn>
+  void for_each(Fn fn) const {
+    for (size_t pos = begin_; pos < end_; pos++) {
+      if (pos + kScanPrefetchDistance < end_) {
+        data_->prefetch_record(pos + kScanPrefetchDistance);
+      }
+      fn(data_->key(pos), *data_->value(pos));
+    }
+  }
+
+ private:
+  const Storage* data_;
+  size_t begin_;
+  size_t end_;
+};
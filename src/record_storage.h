@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "span.h"
+
+/* Layouts for the sorted key-value records behind a learned index. Both
+ * layouts expose the same small interface (size, key, value, lower_bound,
+ * prefetch, prefetch_record, copy_keys) so the indexes can be instantiated on
+ * either one:
+ *
+ *  - PairStorage keeps records as std::pair<K, V> (array of structures). This
+ *    is the original layout; every probe also pulls the payload into cache.
+ *  - SplitStorage keeps the sorted keys in their own cache-line-aligned array
+ *    and the payloads in a parallel array (structure of arrays). The last-mile
+ *    search only touches keys, and the payload is read once after a hit.
+ *
+ * Both can also be built from a key Span plus a payload vector. SplitStorage
+ * then uses already sorted keys in place (e.g., straight from a mapped SOSD
+ * file) instead of copying them.
+ */
+
+constexpr size_t kCacheLineSize = 64;
+
+template <class K, class V>
+class PairStorage {
+ public:
+  typedef std::pair<K, V> record;
+
+  PairStorage() = default;
+
+  // Takes ownership of the records and sorts them by key.
+  explicit PairStorage(std::vector<record> data) : data_(std::move(data)) {
+    if (!std::is_sorted(data_.begin(), data_.end())) {
+      std::sort(data_.begin(), data_.end());
+    }
+  }
+
+  // Pairs keys[i] with values[i], then sorts the records by key.
+  PairStorage(Span<K> keys, std::vector<V> values)
+      : PairStorage(make_records(keys, values)) {}
+
+  size_t size() const { return data_.size(); }
+
+  K key(size_t pos) const { return data_[pos].first; }
+
+  V* value(size_t pos) { return &data_[pos].second; }
+  const V* value(size_t pos) const { return &data_[pos].second; }
+
+  // Return the first position in [start_pos, end_pos) whose key is not less
+  // than `key`, or end_pos if there is none.
+  size_t lower_bound(K key, size_t start_pos, size_t end_pos) const {
+    return std::lower_bound(
+               data_.begin() + start_pos, data_.begin() + end_pos, key,
+               [](auto const& pair, K key) { return pair.first < key; }) -
+           data_.begin();
+  }
+
+  // Hint that the key at `pos` will be read soon.
+  void prefetch(size_t pos) const { __builtin_prefetch(&data_[pos]); }
+
+  // Hint that the key and payload at `pos` will be read soon.
+  void prefetch_record(size_t pos) const { __builtin_prefetch(&data_[pos]); }
+
+  // Copy the keys at positions [pos, pos + count) to `out`.
+  void copy_keys(size_t pos, size_t count, K* out) const {
+    for (size_t i = 0; i < count; i++) {
+      out[i] = data_[pos + i].first;
+    }
+  }
+
+ private:
+  static std::vector<record> make_records(Span<K> keys,
+                                          const std::vector<V>& values) {
+    assert(keys.size() == values.size());
+    std::vector<record> data(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      data[i] = {keys[i], values[i]};
+    }
+    return data;
+  }
+
+  std::vector<record> data_;
+};
+
+template <class K, class V>
+class SplitStorage {
+ public:
+  typedef std::pair<K, V> record;
+
+  SplitStorage() = default;
+
+  // Sorts the records by key and splits them into a key array and a payload
+  // array. The input vector is released once the split is done.
+  explicit SplitStorage(std::vector<record> data) {
+    if (!std::is_sorted(data.begin(), data.end())) {
+      std::sort(data.begin(), data.end());
+    }
+    size_ = data.size();
+    owned_keys_ = allocate_keys(size_);
+    values_.resize(size_);
+    for (size_t i = 0; i < size_; i++) {
+      owned_keys_[i] = data[i].first;
+      values_[i] = data[i].second;
+    }
+    keys_ = owned_keys_.get();
+  }
+
+  // Pairs keys[i] with values[i]. If the keys are already sorted they are
+  // used in place and must outlive the storage; otherwise the records are
+  // copied and sorted as above.
+  SplitStorage(Span<K> keys, std::vector<V> values) {
+    assert(keys.size() == values.size());
+    if (!std::is_sorted(keys.begin(), keys.end())) {
+      std::vector<record> data(keys.size());
+      for (size_t i = 0; i < keys.size(); i++) {
+        data[i] = {keys[i], values[i]};
+      }
+      *this = SplitStorage(std::move(data));
+      return;
+    }
+    size_ = keys.size();
+    keys_ = keys.data();
+    values_ = std::move(values);
+  }
+
+  size_t size() const { return size_; }
+
+  K key(size_t pos) const { return keys_[pos]; }
+
+  V* value(size_t pos) { return &values_[pos]; }
+  const V* value(size_t pos) const { return &values_[pos]; }
+
+  size_t lower_bound(K key, size_t start_pos, size_t end_pos) const {
+    return std::lower_bound(keys_ + start_pos, keys_ + end_pos, key) - keys_;
+  }
+
+  void prefetch(size_t pos) const { __builtin_prefetch(keys_ + pos); }
+
+  void prefetch_record(size_t pos) const {
+    __builtin_prefetch(keys_ + pos);
+    __builtin_prefetch(&values_[pos]);
+  }
+
+  void copy_keys(size_t pos, size_t count, K* out) const {
+    std::copy(keys_ + pos, keys_ + pos + count, out);
+  }
+
+ private:
+  struct AlignedDeleter {
+    void operator()(K* ptr) const { std::free(ptr); }
+  };
+
+  // Allocate the key array on a cache line boundary so that a last-mile
+  // window of w keys spans the minimum number of cache lines.
+  static std::unique_ptr<K[], AlignedDeleter> allocate_keys(size_t n) {
+    size_t bytes = n * sizeof(K);
+    bytes = (bytes + kCacheLineSize - 1) / kCacheLineSize * kCacheLineSize;
+    if (bytes == 0) {
+      bytes = kCacheLineSize;
+    }
+    K* ptr = static_cast<K*>(std::aligned_alloc(kCacheLineSize, bytes));
+    if (ptr == nullptr) {
+      throw std::bad_alloc();
+    }
+    return std::unique_ptr<K[], AlignedDeleter>(ptr);
+  }
+
+  size_t size_ = 0;
+  // The sorted keys: either owned_keys_ or a borrowed, caller-owned array.
+  const K* keys_ = nullptr;
+  std::unique_ptr<K[], AlignedDeleter> owned_keys_;
+  std::vector<V> values_;
+};
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "index_file.h"
+#include "last_mile_search.h"
+#include "parallel_build.h"
+#include "record_storage.h"
+#include "rmi_models.h"
+#include "sharded_counter.h"
+#include "span.h"
+
+/* A recursive model index (RMI) with any number of levels and a model family
+ * per level (see rmi_models.h), e.g.
+ *
+ *   RecursiveModelIndex<K, V, std::tuple<CubicModel<K>, LinearModel<K>>>
+ *
+ * is LearnedIndex with a cubic root, and three model types make a three-level
+ * RMI. The root is a single model; every other level holds the number of
+ * models given to build().
+ *
+ * Each model of a level above the last is trained on the positions of the
+ * records routed to it, then rescaled so that it predicts a model of the
+ * next level instead. The models of the last level predict positions, and as
+ * in LearnedIndex each keeps the error bound and last-mile strategy of its
+ * records. A lookup walks down the levels, clamping each prediction to the
+ * models of the next level, and searches the error window of the last one.
+ *
+ * The records of a model are those its parent's prediction selects, so they
+ * are contiguous when every model above is monotone and are gathered by a
+ * counting sort otherwise (e.g., for a cubic that turns back at an end of the
+ * key range).
+ */
+template <class K, class V, class Levels, class Storage = PairStorage<K, V>>
+class RecursiveModelIndex;
+
+template <class K, class V, class... Models, class Storage>
+class RecursiveModelIndex<K, V, std::tuple<Models...>, Storage> {
+  static_assert(std::is_arithmetic<K>::value,
+                "Learned index key type must be numeric.");
+  static constexpr size_t kNumLevels = sizeof...(Models);
+  static_assert(kNumLevels >= 2, "An RMI needs a root and a last level.");
+
+ public:
+  typedef std::pair<K, V> record;
+
+  // Takes ownership of the records; pass them with std::move to avoid a copy.
+  RecursiveModelIndex(std::vector<record> data) : data_(std::move(data)) {}
+
+  // Index keys[i] with payload values[i] (see LearnedIndex).
+  RecursiveModelIndex(Span<K> keys, std::vector<V> values)
+      : data_(keys, std::move(values)) {}
+
+  // Build the RMI with level_sizes[l] models on level l + 1, i.e., one entry
+  // per level below the root, using `num_threads` threads. Weighted levels
+  // (WLinearModel) are fit with weights[i] as the weight of the i-th record
+  // in key order, or with equal weights if none are given. The weights are
+  // only read during build().
+  void build(const std::vector<size_t>& level_sizes,
+             Span<double> weights = Span<double>(), int num_threads = 1) {
+    assert(level_sizes.size() == kNumLevels - 1);
+    assert(weights.empty() || weights.size() == data_.size());
+    assert(data_.size() > 0);
+    assert(num_threads > 0);
+    for (size_t level_size : level_sizes) {
+      assert(level_size > 0 && level_size <= UINT32_MAX);
+      (void)level_size;
+    }
+    // The model of the current level that each record is routed to.
+    std::vector<uint32_t> assignment(data_.size(), 0);
+    build_level<0>(level_sizes, weights, num_threads, &assignment);
+  }
+
+  // If the key exists, return a pointer to the corresponding value in data_.
+  // If the key does not exist, return a nullptr.
+  V* get_value(K key) {
+    assert(!error_bounds_.empty());
+    size_t leaf;
+    int64_t predicted_index = predict_position<0>(key, 0, &leaf);
+    if (data_.key(predicted_index) == key) {
+      return data_.value(predicted_index);
+    }
+    last_mile_search_count_.add(1);
+
+    int64_t data_size = data_.size();
+    const ErrorBound& error_bound = error_bounds_[leaf];
+    int64_t start_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.min_error, 0), data_size);
+    int64_t end_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.max_error + 1, 0),
+        data_size);
+    int64_t pos;
+    if (error_bound.strategy == SearchStrategy::kExponential &&
+        start_search < end_search) {
+      predicted_index = std::min(std::max(predicted_index, start_search),
+                                 end_search - 1);
+      pos = exponential_search(data_, key, predicted_index, start_search,
+                               end_search);
+    } else {
+      pos = data_.lower_bound(key, start_search, end_search);
+    }
+    if (pos >= data_size || data_.key(pos) != key) {
+      return nullptr;
+    }
+    return data_.value(pos);
+  }
+
+  // Write the levels, model parameters and error bounds to `path` (see
+  // index_file.h). Return false if the file could not be written.
+  bool save(const std::string& path) const {
+    assert(!error_bounds_.empty());
+    IndexFileWriter writer(IndexKind::kRecursiveModelIndex, sizeof(K),
+                           data_.size(), data_fingerprint(data_));
+    std::vector<StoredLevel> levels;
+    std::vector<double> parameters;
+    for_each_level(models_, [&](const auto& models) {
+      typedef typename std::decay_t<decltype(models)>::value_type Model;
+      levels.push_back({Model::kModelId, models.size()});
+      size_t offset = parameters.size();
+      parameters.resize(offset + models.size() * Model::kNumParameters);
+      for (size_t i = 0; i < models.size(); i++) {
+        models[i].store(&parameters[offset + i * Model::kNumParameters]);
+      }
+    });
+    writer.add_section(SectionId::kLevels, levels);
+    writer.add_section(SectionId::kModelParameters, parameters);
+    writer.add_section(SectionId::kErrorBounds, store_error_bounds(error_bounds_));
+    return writer.write(path);
+  }
+
+  // Replace build() by loading what save() wrote for the same keys and the
+  // same model types. Return false, leaving the index unchanged, if the file
+  // is missing, corrupted, was built over other keys or has other levels.
+  bool load(const std::string& path) {
+    IndexFileReader reader;
+    if (!reader.open(path, IndexKind::kRecursiveModelIndex, sizeof(K),
+                     data_.size(), data_fingerprint(data_))) {
+      return false;
+    }
+    Span<StoredLevel> levels = reader.section<StoredLevel>(SectionId::kLevels);
+    Span<double> parameters =
+        reader.section<double>(SectionId::kModelParameters);
+    std::vector<ErrorBound> error_bounds;
+    if (levels.size() != kNumLevels || levels[0].num_models != 1 ||
+        !restore_error_bounds(
+            reader.section<StoredErrorBound>(SectionId::kErrorBounds),
+            &error_bounds) ||
+        levels[kNumLevels - 1].num_models != error_bounds.size()) {
+      return false;
+    }
+    ModelVectors models;
+    size_t level = 0;
+    size_t offset = 0;
+    bool valid = true;
+    for_each_level(models, [&](auto& level_models) {
+      typedef typename std::decay_t<decltype(level_models)>::value_type Model;
+      const StoredLevel& stored = levels[level++];
+      if (!valid || stored.model_id != Model::kModelId ||
+          stored.num_models == 0 || stored.num_models > UINT32_MAX ||
+          stored.num_models * Model::kNumParameters >
+              parameters.size() - offset) {
+        valid = false;
+        return;
+      }
+      level_models.resize(stored.num_models);
+      for (size_t i = 0; i < level_models.size(); i++) {
+        level_models[i].restore(&parameters[offset]);
+        offset += Model::kNumParameters;
+      }
+    });
+    if (!valid || offset != parameters.size()) {
+      return false;
+    }
+    models_ = std::move(models);
+    error_bounds_ = std::move(error_bounds);
+    return true;
+  }
+
+  // Number of models on every level, starting with the root.
+  std::vector<size_t> level_sizes() const {
+    std::vector<size_t> sizes;
+    for_each_level(models_, [&](const auto& models) {
+      sizes.push_back(models.size());
+    });
+    return sizes;
+  }
+
+  // Bytes of all models and error bounds.
+  size_t model_bytes() const {
+    size_t bytes = error_bounds_.size() * sizeof(ErrorBound);
+    for_each_level(models_, [&](const auto& models) {
+      bytes += models.size() * sizeof(models[0]);
+    });
+    return bytes;
+  }
+
+  const std::vector<ErrorBound>& leaf_error_bounds() const {
+    return error_bounds_;
+  }
+  const Storage& data() const { return data_; }
+
+  int64_t get_last_mile_search_count() {
+    return last_mile_search_count_.load();
+  }
+
+  void reset_last_mile_search_count() {
+    last_mile_search_count_.reset();
+  }
+
+ private:
+  typedef std::tuple<std::vector<Models>...> ModelVectors;
+
+  // Number of models a build worker trains per task.
+  static constexpr size_t kModelsPerBuildTask = 64;
+
+  // Call fn(models) on the model vector of every level, root first.
+  template <class Tuple, class Fn>
+  static void for_each_level(Tuple& levels, Fn fn) {
+    std::apply([&](auto&... level_models) { (fn(level_models), ...); },
+               levels);
+  }
+
+  // Train the models of level L on the records `assignment` routes to them,
+  // then route the records to level L + 1 and build it.
+  template <size_t L>
+  void build_level(const std::vector<size_t>& level_sizes,
+                   Span<double> weights, int num_threads,
+                   std::vector<uint32_t>* assignment) {
+    size_t num_records = data_.size();
+    size_t num_models = L == 0 ? 1 : level_sizes[L - 1];
+    auto& models = std::get<L>(models_);
+    models.assign(num_models, {});
+    if constexpr (L + 1 == kNumLevels) {
+      error_bounds_.assign(num_models, ErrorBound());
+    }
+
+    // Group the records by model with a counting sort, keeping each group in
+    // key order. If the assignment never decreases, the groups are already
+    // contiguous and the permutation is skipped.
+    std::vector<size_t> group_starts(num_models + 1, 0);
+    for (uint32_t model : *assignment) {
+      group_starts[model + 1]++;
+    }
+    for (size_t i = 0; i < num_models; i++) {
+      group_starts[i + 1] += group_starts[i];
+    }
+    bool contiguous = std::is_sorted(assignment->begin(), assignment->end());
+    std::vector<size_t> order;
+    if (!contiguous) {
+      order.resize(num_records);
+      std::vector<size_t> next(group_starts.begin(), group_starts.end() - 1);
+      for (size_t pos = 0; pos < num_records; pos++) {
+        order[next[(*assignment)[pos]]++] = pos;
+      }
+    }
+
+    parallel_for(num_models, num_threads, kModelsPerBuildTask,
+                 [&](size_t first_model, size_t last_model) {
+      for (size_t i = first_model; i < last_model; i++) {
+        auto for_each_position = [&](auto&& fn) {
+          for (size_t j = group_starts[i]; j < group_starts[i + 1]; j++) {
+            fn(contiguous ? j : order[j]);
+          }
+        };
+        train_model(&models[i], for_each_position, weights);
+        if constexpr (L + 1 < kNumLevels) {
+          models[i].rescale(static_cast<double>(level_sizes[L]) / num_records);
+        } else {
+          ErrorBoundTracker error_tracker;
+          for_each_position([&](size_t pos) {
+            error_tracker.add(static_cast<int64_t>(pos) -
+                              clamp(models[i].predict(data_.key(pos)),
+                                    num_records));
+          });
+          error_bounds_[i] = error_tracker.finish();
+        }
+      }
+    });
+
+    if constexpr (L + 1 < kNumLevels) {
+      parallel_chunks(num_records, num_threads,
+                      [&](size_t, size_t begin, size_t end) {
+        for (size_t pos = begin; pos < end; pos++) {
+          uint32_t& model = (*assignment)[pos];
+          model = clamp(models[model].predict(data_.key(pos)), level_sizes[L]);
+        }
+      });
+      build_level<L + 1>(level_sizes, weights, num_threads, assignment);
+    }
+  }
+
+  // Train `model` on the records at the positions for_each_position streams.
+  template <class Model, class ForEachPosition>
+  void train_model(Model* model, const ForEachPosition& for_each_position,
+                   Span<double> weights) const {
+    if constexpr (RmiModelTraits<Model>::kWeighted) {
+      model->train([&](auto&& add) {
+        for_each_position([&](size_t pos) {
+          add(data_.key(pos), pos, weights.empty() ? 1.0 : weights[pos]);
+        });
+      });
+    } else {
+      model->train([&](auto&& add) {
+        for_each_position([&](size_t pos) { add(data_.key(pos), pos); });
+      });
+    }
+  }
+
+  static int64_t clamp(int64_t prediction, size_t size) {
+    return std::min<int64_t>(std::max<int64_t>(prediction, 0),
+                             static_cast<int64_t>(size) - 1);
+  }
+
+  // Route `key` from model `model_index` of level L down to the last level.
+  // Return the clamped predicted position, and set *leaf to the model of the
+  // last level that made it.
+  template <size_t L>
+  int64_t predict_position(K key, size_t model_index, size_t* leaf) const {
+    int64_t prediction = std::get<L>(models_)[model_index].predict(key);
+    if constexpr (L + 1 == kNumLevels) {
+      *leaf = model_index;
+      return clamp(prediction, data_.size());
+    } else {
+      return predict_position<L + 1>(
+          key, clamp(prediction, std::get<L + 1>(models_).size()), leaf);
+    }
+  }
+
+  Storage data_;
+  ModelVectors models_;
+  // The signed prediction error range and last-mile search strategy of each
+  // model of the last level.
+  std::vector<ErrorBound> error_bounds_;
+  ShardedCounter last_mile_search_count_;
+};
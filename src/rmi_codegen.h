@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <ios>
+#include <limits>
+#include <ostream>
+#include <string>
+
+#include "index_file.h"
+#include "learned_index.h"
+
+/* Export a trained LearnedIndex as a C++ header for CompiledLearnedIndex (see
+ * compiled_rmi.h). Doubles are written as hexadecimal floating point literals
+ * so that the compiled models reproduce the trained ones bit for bit.
+ *
+ * The header holds one CompiledLeaf initializer per second-level model, so
+ * exports with very many models (hundreds of thousands) produce large headers
+ * that are slow to compile.
+ */
+
+// Write the header defining `struct <struct_name>` to `os`. Return false if
+// an error bound does not fit the 32-bit fields of CompiledLeaf, or if the
+// index was built with a radix root, which CompiledLearnedIndex does not
+// implement.
+template <class K, class V, class Storage>
+bool export_rmi_header(const LearnedIndex<K, V, Storage>& index,
+                       const std::string& struct_name, std::ostream& os) {
+  const auto& models = index.second_level_models();
+  const auto& error_bounds = index.second_level_error_bounds();
+  assert(models.size() > 0);
+  if (index.has_radix_root()) {
+    return false;
+  }
+  bool any_exponential_search = false;
+  for (const ErrorBound& error_bound : error_bounds) {
+    if (error_bound.min_error < std::numeric_limits<int32_t>::min() ||
+        error_bound.max_error > std::numeric_limits<int32_t>::max()) {
+      return false;
+    }
+    any_exponential_search |=
+        error_bound.strategy == SearchStrategy::kExponential;
+  }
+
+  std::ios_base::fmtflags flags = os.flags();
+  os << "// Generated by export_rmi_header (src/rmi_codegen.h). Do not edit.\n"
+     << "#pragma once\n\n"
+     << "#include <cstdint>\n\n"
+     << "#include \"compiled_rmi.h\"\n\n"
+     << "struct " << struct_name << " {\n"
+     << std::hexfloat
+     << "  static constexpr double kRootSlope = " << index.root_model().m_
+     << ";\n"
+     << "  static constexpr double kRootIntercept = " << index.root_model().b_
+     << ";\n"
+     << std::dec
+     << "  static constexpr int64_t kNumModels = " << models.size() << ";\n"
+     << "  static constexpr int64_t kNumRecords = " << index.data().size()
+     << ";\n"
+     << "  static constexpr uint64_t kDataFingerprint = "
+     << data_fingerprint(index.data()) << "ULL;\n"
+     << "  static constexpr bool kAnyExponentialSearch = "
+     << (any_exponential_search ? "true" : "false") << ";\n"
+     << "  alignas(64) static constexpr CompiledLeaf kLeaves[kNumModels] = {\n";
+  for (size_t i = 0; i < models.size(); i++) {
+    os << std::hexfloat << "      {" << models[i].m_ << ", " << models[i].b_
+       << ", " << std::dec << error_bounds[i].min_error << ", "
+       << error_bounds[i].max_error << ", "
+       << (error_bounds[i].strategy == SearchStrategy::kExponential
+               ? "SearchStrategy::kExponential"
+               : "SearchStrategy::kBinary")
+       << "},\n";
+  }
+  os << "  };\n"
+     << "};\n";
+  os.flags(flags);
+  return static_cast<bool>(os);
+}
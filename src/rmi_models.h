@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "linear_model.h"
+#include "weighted_linear_model.h"
+
+/* Model families for the levels of RecursiveModelIndex
+ * (recursive_model_index.h), after the model types of SOSD's RMI.
+ *
+ * Every model has the interface of LinearModel:
+ *  - train(for_each_point): fit the points that for_each_point streams to
+ *    add(key, position) in key order (add(key, position, weight) for the
+ *    weighted models, see RmiModelTraits);
+ *  - predict(key): the predicted position;
+ *  - rescale(factor): scale all predictions by `factor`, which turns a
+ *    position model into one that selects a model of the next level;
+ *  - kModelId, kNumParameters, store(parameters) and restore(parameters):
+ *    the model as a fixed number of doubles, for save() and load().
+ *
+ * Besides LinearModel (least squares) and WLinearModel (weighted least
+ * squares) there are:
+ *  - CubicModel: a least-squares cubic, which follows the S-shaped CDFs of
+ *    skewed keys far better than a line at the root;
+ *  - LinearSplineModel: the line through the first and the last point, which
+ *    unlike least squares is not pulled off the ends of the key range by
+ *    dense clusters;
+ *  - RadixModel: the key minus the smallest key, shifted right, i.e., the
+ *    top bits of the key range. It costs a subtraction and a shift and suits
+ *    roughly uniform integer keys.
+ */
+
+template <class Model>
+struct RmiModelTraits {
+  // Whether train() streams add(key, position, weight).
+  static constexpr bool kWeighted = false;
+};
+
+template <class K, class V>
+struct RmiModelTraits<WLinearModel<K, V>> {
+  static constexpr bool kWeighted = true;
+};
+
+// Distance of `key` from `origin` as a double. Integer keys are subtracted
+// before the conversion, so that 64-bit keys far from zero keep their low
+// bits.
+template <class K>
+double key_offset(K key, K origin) {
+  if constexpr (std::is_integral<K>::value) {
+    return key < origin ? -static_cast<double>(origin - key)
+                        : static_cast<double>(key - origin);
+  } else {
+    return static_cast<double>(key) - static_cast<double>(origin);
+  }
+}
+
+// A key stored bit for bit in a double parameter slot.
+template <class K>
+double key_to_parameter(K key) {
+  static_assert(sizeof(K) <= sizeof(double), "Keys must fit in 8 bytes.");
+  double parameter = 0;
+  std::memcpy(&parameter, &key, sizeof(K));
+  return parameter;
+}
+
+template <class K>
+K parameter_to_key(double parameter) {
+  K key;
+  std::memcpy(&key, &parameter, sizeof(K));
+  return key;
+}
+
+template <class K>
+class CubicModel {
+  static_assert(std::is_arithmetic<K>::value,
+                "Cubic model feature type must be numeric.");
+
+ public:
+  // Fit y = a t^3 + b t^2 + c t + d by least squares, where t is the key
+  // mapped to [0, 1] over the training keys, which keeps the normal
+  // equations well conditioned. Falls back to a line when the cubic is
+  // singular (e.g., fewer than four distinct keys).
+  template <class PointSource>
+  void train(const PointSource& for_each_point) {
+    bool first = true;
+    K max_key = K();
+    for_each_point([&](K key, int64_t) {
+      if (first || key < min_key_) {
+        min_key_ = key;
+      }
+      if (first || key > max_key) {
+        max_key = key;
+      }
+      first = false;
+    });
+    coefficients_[0] = coefficients_[1] = coefficients_[2] = 0;
+    coefficients_[3] = 0;
+    if (first) {
+      scale_ = 0;
+      return;
+    }
+    double range = key_offset(max_key, min_key_);
+    scale_ = range > 0 ? 1 / range : 0;
+
+    // Sums of t^k for k = 0..6 and of y t^k for k = 0..3.
+    double t_sums[7] = {};
+    double yt_sums[4] = {};
+    for_each_point([&](K key, int64_t position) {
+      double t = key_offset(key, min_key_) * scale_;
+      double y = static_cast<double>(position);
+      double power = 1;
+      for (int k = 0; k < 7; k++) {
+        t_sums[k] += power;
+        if (k < 4) {
+          yt_sums[k] += y * power;
+        }
+        power *= t;
+      }
+    });
+    if (!solve(3, t_sums, yt_sums) && !solve(1, t_sums, yt_sums)) {
+      coefficients_[3] = yt_sums[0] / t_sums[0];
+    }
+  }
+
+  int64_t predict(K key) const {
+    double t = key_offset(key, min_key_) * scale_;
+    return static_cast<int64_t>(
+        std::fma(std::fma(std::fma(coefficients_[0], t, coefficients_[1]), t,
+                          coefficients_[2]),
+                 t, coefficients_[3]));
+  }
+
+  void rescale(double scaling_factor) {
+    for (double& coefficient : coefficients_) {
+      coefficient *= scaling_factor;
+    }
+  }
+
+  static constexpr uint32_t kModelId = 3;
+  static constexpr size_t kNumParameters = 6;
+  void store(double* parameters) const {
+    parameters[0] = key_to_parameter(min_key_);
+    parameters[1] = scale_;
+    std::copy(coefficients_, coefficients_ + 4, parameters + 2);
+  }
+  void restore(const double* parameters) {
+    min_key_ = parameter_to_key<K>(parameters[0]);
+    scale_ = parameters[1];
+    std::copy(parameters + 2, parameters + 6, coefficients_);
+  }
+
+ private:
+  // Solve the normal equations of the polynomial of `degree` (1 or 3) by
+  // Gaussian elimination with partial pivoting, and set the coefficients.
+  // Return false if they are singular.
+  bool solve(int degree, const double* t_sums, const double* yt_sums) {
+    int size = degree + 1;
+    double system[4][5];
+    for (int row = 0; row < size; row++) {
+      for (int col = 0; col < size; col++) {
+        system[row][col] = t_sums[row + col];
+      }
+      system[row][size] = yt_sums[row];
+    }
+    for (int col = 0; col < size; col++) {
+      int pivot = col;
+      for (int row = col + 1; row < size; row++) {
+        if (std::abs(system[row][col]) > std::abs(system[pivot][col])) {
+          pivot = row;
+        }
+      }
+      if (std::abs(system[pivot][col]) <= 1e-12 * t_sums[0]) {
+        return false;
+      }
+      std::swap(system[col], system[pivot]);
+      for (int row = 0; row < size; row++) {
+        if (row == col) {
+          continue;
+        }
+        double factor = system[row][col] / system[col][col];
+        for (int k = col; k <= size; k++) {
+          system[row][k] -= factor * system[col][k];
+        }
+      }
+    }
+    // coefficients_ holds the highest power first.
+    for (int power = 0; power < size; power++) {
+      coefficients_[3 - power] = system[power][size] / system[power][power];
+    }
+    return true;
+  }
+
+  K min_key_ = K();
+  double scale_ = 0;
+  double coefficients_[4] = {};
+};
+
+template <class K>
+class LinearSplineModel {
+  static_assert(std::is_arithmetic<K>::value,
+                "Linear spline feature type must be numeric.");
+
+ public:
+  // Connect the points with the smallest and the largest key.
+  template <class PointSource>
+  void train(const PointSource& for_each_point) {
+    bool first = true;
+    K max_key = K();
+    double max_position = 0;
+    for_each_point([&](K key, int64_t position) {
+      if (first || key < min_key_) {
+        min_key_ = key;
+        min_position_ = static_cast<double>(position);
+      }
+      if (first || key > max_key) {
+        max_key = key;
+        max_position = static_cast<double>(position);
+      }
+      first = false;
+    });
+    if (first) {
+      min_key_ = K();
+      min_position_ = 0;
+      slope_ = 0;
+      return;
+    }
+    double range = key_offset(max_key, min_key_);
+    slope_ = range > 0 ? (max_position - min_position_) / range : 0;
+  }
+
+  int64_t predict(K key) const {
+    return static_cast<int64_t>(
+        std::fma(slope_, key_offset(key, min_key_), min_position_));
+  }
+
+  void rescale(double scaling_factor) {
+    slope_ *= scaling_factor;
+    min_position_ *= scaling_factor;
+  }
+
+  static constexpr uint32_t kModelId = 4;
+  static constexpr size_t kNumParameters = 3;
+  void store(double* parameters) const {
+    parameters[0] = key_to_parameter(min_key_);
+    parameters[1] = min_position_;
+    parameters[2] = slope_;
+  }
+  void restore(const double* parameters) {
+    min_key_ = parameter_to_key<K>(parameters[0]);
+    min_position_ = parameters[1];
+    slope_ = parameters[2];
+  }
+
+ private:
+  K min_key_ = K();
+  double min_position_ = 0;
+  double slope_ = 0;
+};
+
+template <class K>
+class RadixModel {
+  static_assert(std::is_integral<K>::value,
+                "Radix model keys must be integers.");
+
+ public:
+  // Map the key range of the points onto their position range with a
+  // power-of-two slope: predict(key) = first position + ((key - min key) >>
+  // shift), with the smallest shift that keeps predictions within the range.
+  template <class PointSource>
+  void train(const PointSource& for_each_point) {
+    bool first = true;
+    K max_key = K();
+    int64_t min_position = 0;
+    int64_t max_position = 0;
+    for_each_point([&](K key, int64_t position) {
+      if (first) {
+        min_key_ = max_key = key;
+        min_position = max_position = position;
+        first = false;
+        return;
+      }
+      min_key_ = std::min(min_key_, key);
+      max_key = std::max(max_key, key);
+      min_position = std::min(min_position, position);
+      max_position = std::max(max_position, position);
+    });
+    if (first) {
+      min_key_ = K();
+      max_key = K();
+    }
+    key_range_ = static_cast<uint64_t>(max_key) - static_cast<uint64_t>(min_key_);
+    first_position_ = static_cast<double>(min_position);
+    num_positions_ = static_cast<double>(max_position - min_position + 1);
+    set_shift();
+  }
+
+  int64_t predict(K key) const {
+    int64_t base = static_cast<int64_t>(first_position_);
+    if (key < min_key_) {
+      return base;
+    }
+    uint64_t offset = static_cast<uint64_t>(key) - static_cast<uint64_t>(min_key_);
+    return base + static_cast<int64_t>(shift_ < 64 ? offset >> shift_ : 0);
+  }
+
+  void rescale(double scaling_factor) {
+    first_position_ *= scaling_factor;
+    num_positions_ *= scaling_factor;
+    set_shift();
+  }
+
+  static constexpr uint32_t kModelId = 5;
+  static constexpr size_t kNumParameters = 4;
+  void store(double* parameters) const {
+    parameters[0] = key_to_parameter(min_key_);
+    parameters[1] = key_to_parameter(key_range_);
+    parameters[2] = first_position_;
+    parameters[3] = num_positions_;
+  }
+  void restore(const double* parameters) {
+    min_key_ = parameter_to_key<K>(parameters[0]);
+    key_range_ = parameter_to_key<uint64_t>(parameters[1]);
+    first_position_ = parameters[2];
+    num_positions_ = parameters[3];
+    set_shift();
+  }
+
+ private:
+  void set_shift() {
+    shift_ = 0;
+    while (shift_ < 64 &&
+           static_cast<double>(key_range_ >> shift_) >= num_positions_) {
+      shift_++;
+    }
+  }
+
+  K min_key_ = K();
+  uint64_t key_range_ = 0;
+  double first_position_ = 0;
+  double num_positions_ = 0;
+  unsigned shift_ = 0;
+};
@@ -1,17 +1,26 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <thread>
 
+#include "hot_key_table.h"
+#include "hot_tier.h"
+#include "latency_recorder.h"
 #include "learned_index.h"
+#include "look_up_table_learned_index.h"
+#include "piecewise_linear_index.h"
+#include "recursive_model_index.h"
+#include "sharded_counter.h"
+#include "updatable_learned_index.h"
+#include "weighted_learned_index.h"
 
-int main(int, char**) {
-  // Generate data consisting of 1000 key-value records.
-  // Keys are floating point numbers; values are integers.
-  std::vector<std::pair<double, int>> data;
-  for (int i = 1; i <= 1000; i++) {
-    data.emplace_back(static_cast<double>(std::log(i)), i);
-  }
-
+template <class Storage>
+void check_learned_index(const std::vector<std::pair<double, int>>& data) {
   // Build a learned index with 10 second-level models.
-  LearnedIndex<double, int> learned_index(data);
+  LearnedIndex<double, int, Storage> learned_index(data);
   learned_index.build(10);
     
   // For each key in the data, look up its value using the learned index.
@@ -38,4 +47,600 @@ int main(int, char**) {
                 << ", which does not exist" << std::endl;
     }
   }
+
+  // Verify that the fences reject keys outside the data, and that the
+  // negative-lookup filter rejects most keys between the keys but never an
+  // existing key.
+  learned_index.reset_negative_lookup_stats();
+  learned_index.get_value(-1.);
+  if (learned_index.get_negative_lookup_stats().fence_rejections != 1) {
+    std::cout << "Error: fences did not reject a key below the data"
+              << std::endl;
+  }
+  learned_index.build_negative_lookup_filter(10);
+  learned_index.reset_negative_lookup_stats();
+  for (size_t i = 0; i + 1 < data.size(); i++) {
+    double between = (data[i].first + data[i + 1].first) / 2;
+    const int* found_value = learned_index.get_value(data[i].first);
+    if (found_value == nullptr || *found_value != data[i].second ||
+        learned_index.get_value(between) != nullptr) {
+      std::cout << "Error: incorrect lookup with the filter near key "
+                << data[i].first << std::endl;
+    }
+  }
+  if (learned_index.get_negative_lookup_stats().filter_false_positive_rate() >
+      0.05) {
+    std::cout << "Error: negative-lookup filter lets too many keys pass"
+              << std::endl;
+  }
+
+  // Verify lower_bound on every key, between keys and outside the keys, and
+  // that a scan visits exactly the records of its range.
+  for (size_t i = 0; i <= data.size(); i++) {
+    double below = i == 0 ? -1e9 : data[i - 1].first;
+    double key = i == data.size() ? 1e9 : data[i].first;
+    if (learned_index.lower_bound(key) != i ||
+        learned_index.lower_bound(below + (key - below) / 2) != i) {
+      std::cout << "Error: incorrect lower bound near key " << key
+                << std::endl;
+    }
+  }
+  int scan_sum = 0;
+  size_t num_scanned = learned_index.scan(
+      data[100].first, data[200].first,
+      [&](double, int value) { scan_sum += value; });
+  if (num_scanned != 100 || scan_sum != (101 + 200) * 100 / 2 ||
+      learned_index.range(-1e9, 1e9).size() != data.size()) {
+    std::cout << "Error: incorrect range scan" << std::endl;
+  }
+
+  // Verify that an index loaded from a saved file gives the same results, and
+  // that a file saved for other keys is rejected.
+  const std::string index_path = "sanity_check_index.bin";
+  if (!learned_index.save(index_path)) {
+    std::cout << "Error: could not save the index" << std::endl;
+  }
+  LearnedIndex<double, int, Storage> loaded_index(data);
+  if (!loaded_index.load(index_path)) {
+    std::cout << "Error: could not load the saved index" << std::endl;
+  } else {
+    for (const auto& record : data) {
+      const int* found_value = loaded_index.get_value(record.first);
+      if (found_value == nullptr || *found_value != record.second) {
+        std::cout << "Error: loaded index gives a wrong value for key "
+                  << record.first << std::endl;
+      }
+    }
+  }
+  std::vector<std::pair<double, int>> other_data(data.begin() + 1, data.end());
+  LearnedIndex<double, int, Storage> other_index(other_data);
+  if (other_index.load(index_path)) {
+    std::cout << "Error: loaded an index saved for other keys" << std::endl;
+  }
+  std::remove(index_path.c_str());
+
+  // Verify that batched lookups agree with single lookups.
+  std::vector<double> keys;
+  for (const auto& record : data) {
+    keys.push_back(record.first);
+  }
+  keys.insert(keys.end(), nonexistent_keys.begin(), nonexistent_keys.end());
+  std::vector<int*> found_values(keys.size());
+  learned_index.get_values(keys.data(), keys.size(), found_values.data());
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (found_values[i] != learned_index.get_value(keys[i])) {
+      std::cout << "Error: batched lookup disagrees for key " << keys[i]
+                << std::endl;
+    }
+  }
+
+  // Verify that concurrent lookups count every last-mile search.
+  learned_index.reset_last_mile_search_count();
+  for (double key : keys) {
+    learned_index.get_value(key);
+  }
+  int64_t single_thread_count = learned_index.get_last_mile_search_count();
+  learned_index.reset_last_mile_search_count();
+  const int kNumLookupThreads = 4;
+  std::vector<std::thread> lookup_threads;
+  for (int i = 0; i < kNumLookupThreads; i++) {
+    lookup_threads.emplace_back([&]() {
+      for (double key : keys) {
+        learned_index.get_value(key);
+      }
+    });
+  }
+  for (auto& thread : lookup_threads) {
+    thread.join();
+  }
+  if (learned_index.get_last_mile_search_count() !=
+      kNumLookupThreads * single_thread_count) {
+    std::cout << "Error: concurrent lookups lost last-mile search counts"
+              << std::endl;
+  }
+}
+
+// Build an RMI with the given levels over `data`, check every lookup, and
+// check that a saved copy loads only into an RMI with the same model types.
+template <class Levels, class OtherLevels>
+void check_recursive_model_index(
+    const std::vector<std::pair<uint64_t, int>>& data,
+    const std::vector<size_t>& level_sizes, Span<double> weights) {
+  RecursiveModelIndex<uint64_t, int, Levels> index(data);
+  index.build(level_sizes, weights, 2);
+  const std::string index_path = "sanity_check_rmi.bin";
+  index.save(index_path);
+  RecursiveModelIndex<uint64_t, int, Levels> loaded_index(data);
+  RecursiveModelIndex<uint64_t, int, OtherLevels> other_index(data);
+  if (!loaded_index.load(index_path) || other_index.load(index_path)) {
+    std::cout << "Error: RMI file was not loaded into the matching levels"
+              << std::endl;
+  }
+  std::remove(index_path.c_str());
+  for (const auto& record : data) {
+    for (auto* rmi : {&index, &loaded_index}) {
+      const int* found_value = rmi->get_value(record.first);
+      if (found_value == nullptr || *found_value != record.second ||
+          rmi->get_value(record.first + 1) != nullptr) {
+        std::cout << "Error: incorrect RMI lookup for key " << record.first
+                  << std::endl;
+      }
+    }
+  }
+}
+
+// The radix root gives every second-level model the same number of records
+// on skewed keys, and lookups, lower bounds, batched lookups and save/load
+// work with it as with the linear root.
+void check_radix_root() {
+  // Half of the keys crowd into a narrow cluster at the top of the range.
+  std::vector<std::pair<uint64_t, int>> data;
+  for (int i = 0; i < 2000; i++) {
+    uint64_t key = i < 1000 ? 2 * uint64_t(i) * i * i * i
+                            : (uint64_t(1) << 50) + uint64_t(i) * 3;
+    data.emplace_back(key, i);
+  }
+  LearnedIndex<uint64_t, int> linear_index(data);
+  linear_index.build(50);
+  LearnedIndex<uint64_t, int> radix_index(data);
+  radix_index.build_radix_root(50, 3);
+  const SegmentSizeStats& sizes = radix_index.segment_size_stats();
+  if (!radix_index.has_radix_root() || sizes.max_size != 40 ||
+      sizes.empty_segments != 0 ||
+      sizes.size_variance >= linear_index.segment_size_stats().size_variance) {
+    std::cout << "Error: radix root did not balance the second-level models"
+              << std::endl;
+  }
+
+  const std::string index_path = "sanity_check_radix_root.bin";
+  radix_index.save(index_path);
+  LearnedIndex<uint64_t, int> loaded_index(data);
+  if (!loaded_index.load(index_path) || !loaded_index.has_radix_root()) {
+    std::cout << "Error: could not load the radix root" << std::endl;
+  }
+  std::remove(index_path.c_str());
+  std::vector<uint64_t> keys;
+  for (size_t i = 0; i < data.size(); i++) {
+    keys.push_back(data[i].first);
+    for (auto* index : {&radix_index, &loaded_index}) {
+      const int* found_value = index->get_value(data[i].first);
+      if (found_value == nullptr || *found_value != data[i].second ||
+          index->get_value(data[i].first + 1) != nullptr ||
+          index->lower_bound(data[i].first + 1) != i + 1) {
+        std::cout << "Error: incorrect lookup with the radix root for key "
+                  << data[i].first << std::endl;
+      }
+    }
+  }
+  std::vector<int*> found_values(keys.size());
+  radix_index.get_values(keys.data(), keys.size(), found_values.data());
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (found_values[i] == nullptr || *found_values[i] != data[i].second) {
+      std::cout << "Error: batched lookup with the radix root failed for key "
+                << keys[i] << std::endl;
+    }
+  }
+}
+
+// The piecewise linear index keeps every last-mile window within
+// 2 * epsilon + 2 records, and finds every key and every lower bound, also
+// over duplicate keys and when built on several threads. data[i].second
+// must be i.
+void check_piecewise_linear_index(
+    const std::vector<std::pair<uint64_t, int>>& data, size_t epsilon) {
+  PiecewiseLinearIndex<uint64_t, int> index(data);
+  index.build(epsilon, 2, 3);
+  const ErrorBound& error_bound = index.leaf_error_bound();
+  if (error_bound.max_error - error_bound.min_error + 1 >
+      2 * static_cast<int64_t>(epsilon) + 2) {
+    std::cout << "Error: piecewise linear window exceeds epsilon " << epsilon
+              << std::endl;
+  }
+  for (size_t i = 0; i < data.size(); i++) {
+    // A duplicate key may find any of its records. The values are the
+    // positions of the records.
+    const int* found_value = index.get_value(data[i].first);
+    if (found_value == nullptr || data[*found_value].first != data[i].first) {
+      std::cout << "Error: incorrect piecewise linear lookup for key "
+                << data[i].first << std::endl;
+    }
+    for (uint64_t key : {data[i].first - 1, data[i].first, data[i].first + 1}) {
+      size_t expected =
+          std::lower_bound(data.begin(), data.end(),
+                           std::make_pair(key, INT_MIN)) -
+          data.begin();
+      if (index.lower_bound(key) != expected) {
+        std::cout << "Error: incorrect piecewise linear lower bound for key "
+                  << key << std::endl;
+      }
+    }
+  }
+}
+
+int main(int, char**) {
+  // Generate data consisting of 1000 key-value records.
+  // Keys are floating point numbers; values are integers.
+  std::vector<std::pair<double, int>> data;
+  for (int i = 1; i <= 1000; i++) {
+    data.emplace_back(static_cast<double>(std::log(i)), i);
+  }
+
+  check_learned_index<PairStorage<double, int>>(data);
+  check_learned_index<SplitStorage<double, int>>(data);
+
+  // More threads than owned counter shards: the later ones share shards.
+  ShardedCounter counter;
+  std::vector<std::thread> counting_threads;
+  for (int i = 0; i < 100; i++) {
+    counting_threads.emplace_back([&]() {
+      for (int j = 0; j < 1000; j++) {
+        counter.add(1);
+      }
+    });
+  }
+  for (auto& thread : counting_threads) {
+    thread.join();
+  }
+  if (counter.load() != 100 * 1000) {
+    std::cout << "Error: concurrent threads lost counts" << std::endl;
+  }
+  // Shards that exited threads gave back keep their counts under new owners.
+  for (int round = 0; round < 5; round++) {
+    counting_threads.clear();
+    for (int i = 0; i < 20; i++) {
+      counting_threads.emplace_back([&]() {
+        for (int j = 0; j < 1000; j++) {
+          counter.add(1);
+        }
+      });
+    }
+    for (auto& thread : counting_threads) {
+      thread.join();
+    }
+  }
+  if (counter.load() != 200 * 1000) {
+    std::cout << "Error: reused counter shards lost counts" << std::endl;
+  }
+
+  // Build from a key view and a payload vector; SplitStorage uses the sorted
+  // keys in place.
+  std::vector<double> keys;
+  std::vector<int> values;
+  for (const auto& record : data) {
+    keys.push_back(record.first);
+    values.push_back(record.second);
+  }
+  LearnedIndex<double, int, SplitStorage<double, int>> span_index(keys, values);
+  span_index.build(10);
+  for (const auto& record : data) {
+    const int* found_value = span_index.get_value(record.first);
+    if (found_value == nullptr || *found_value != record.second) {
+      std::cout << "Error: incorrect lookup for key " << record.first
+                << " in an index built from a key view" << std::endl;
+    }
+  }
+
+  // The weighted index drops its weights after build(), so it refuses to be
+  // built again and keeps answering from the first build.
+  std::vector<std::tuple<double, int, double>> weighted_data;
+  for (const auto& record : data) {
+    weighted_data.emplace_back(record.first, record.second, record.second % 3);
+  }
+  WLearnedIndex<double, int> weighted_index(weighted_data);
+  if (!weighted_index.build(10) || weighted_index.build(20)) {
+    std::cout << "Error: weighted index was built twice" << std::endl;
+  }
+  for (const auto& record : data) {
+    const int* found_value = weighted_index.get_value(record.first);
+    if (found_value == nullptr || *found_value != record.second) {
+      std::cout << "Error: incorrect weighted lookup for key " << record.first
+                << std::endl;
+    }
+  }
+
+  // Large 64-bit keys: squaring them overflows integer arithmetic, so this
+  // checks that training stays accurate for keys of this magnitude.
+  std::vector<std::pair<uint64_t, int>> large_key_data;
+  for (int i = 0; i < 1000; i++) {
+    large_key_data.emplace_back((uint64_t(1) << 50) + 7 * uint64_t(i) * i, i);
+  }
+  LearnedIndex<uint64_t, int> large_key_index(large_key_data);
+  large_key_index.build(10);
+  for (const auto& record : large_key_data) {
+    const int* found_value = large_key_index.get_value(record.first);
+    if (found_value == nullptr || *found_value != record.second) {
+      std::cout << "Error: incorrect lookup for large key " << record.first
+                << std::endl;
+    }
+  }
+
+  // RMIs with other root model families, three levels and weighted leaves.
+  // The keys are the large keys above (7 i^2 + 1 is never a multiple of 7,
+  // so key + 1 is never a key).
+  std::vector<double> rmi_weights(large_key_data.size());
+  for (size_t i = 0; i < rmi_weights.size(); i++) {
+    rmi_weights[i] = 1 + i % 7;
+  }
+  typedef std::tuple<LinearModel<uint64_t>, LinearModel<uint64_t>> LinearRmi;
+  check_recursive_model_index<LinearRmi,
+                              std::tuple<CubicModel<uint64_t>,
+                                         LinearModel<uint64_t>>>(
+      large_key_data, {10}, Span<double>());
+  check_recursive_model_index<std::tuple<CubicModel<uint64_t>,
+                                         LinearModel<uint64_t>>,
+                              LinearRmi>(large_key_data, {10}, Span<double>());
+  check_recursive_model_index<std::tuple<RadixModel<uint64_t>,
+                                         LinearModel<uint64_t>>,
+                              LinearRmi>(large_key_data, {10}, Span<double>());
+  check_recursive_model_index<std::tuple<LinearSplineModel<uint64_t>,
+                                         LinearModel<uint64_t>>,
+                              LinearRmi>(large_key_data, {10}, Span<double>());
+  check_recursive_model_index<
+      std::tuple<CubicModel<uint64_t>, LinearSplineModel<uint64_t>,
+                 LinearModel<uint64_t>>,
+      LinearRmi>(large_key_data, {4, 16}, Span<double>());
+  check_recursive_model_index<std::tuple<LinearModel<uint64_t>,
+                                         WLinearModel<uint64_t, int>>,
+                              LinearRmi>(large_key_data, {10}, rmi_weights);
+
+  check_radix_root();
+  check_piecewise_linear_index(large_key_data, 8);
+  check_piecewise_linear_index(large_key_data, 0);
+  std::vector<std::pair<uint64_t, int>> duplicate_key_data;
+  for (int i = 0; i < 3000; i++) {
+    duplicate_key_data.emplace_back(uint64_t(i / 7) * (i / 7) * (i / 7) + 1, i);
+  }
+  check_piecewise_linear_index(duplicate_key_data, 4);
+
+  // The tuner's frontier trades memory for cost, and the index it builds
+  // stays within the budget and finds every key.
+  TunerOptions tuner_options;
+  tuner_options.memory_budget_bytes = 2048;
+  tuner_options.model_counts = {1, 10, 100, 1000};
+  LearnedIndex<uint64_t, int> tuned_index(large_key_data);
+  TunerResult tuner_result = tuned_index.build_tuned(tuner_options);
+  for (size_t i = 1; i < tuner_result.frontier.size(); i++) {
+    if (tuner_result.frontier[i].memory_bytes <=
+            tuner_result.frontier[i - 1].memory_bytes ||
+        tuner_result.frontier[i].cost_ns >=
+            tuner_result.frontier[i - 1].cost_ns) {
+      std::cout << "Error: tuner frontier is not a Pareto frontier"
+                << std::endl;
+    }
+  }
+  if (tuner_result.chosen_candidate().memory_bytes >
+      tuner_options.memory_budget_bytes) {
+    std::cout << "Error: tuner exceeded the memory budget" << std::endl;
+  }
+  for (const auto& record : large_key_data) {
+    const int* found_value = tuned_index.get_value(record.first);
+    if (found_value == nullptr || *found_value != record.second) {
+      std::cout << "Error: incorrect lookup in the tuned index for key "
+                << record.first << std::endl;
+    }
+  }
+  // Fewer records than the smallest model count, or no model counts at all,
+  // still leave a candidate to build.
+  std::vector<std::pair<uint64_t, int>> small_data;
+  for (int i = 0; i < 50; i++) {
+    small_data.push_back({7 * uint64_t(i), i});
+  }
+  LearnedIndex<uint64_t, int> small_tuned_index(small_data);
+  TunerResult small_result = small_tuned_index.build_tuned(TunerOptions());
+  TunerOptions no_model_counts;
+  no_model_counts.model_counts.clear();
+  LookUpTableLearnedIndex<uint64_t, int> small_tuned_lut(
+      small_data, std::vector<double>(small_data.size(), 1));
+  TunerResult small_lut_result = small_tuned_lut.build_tuned(no_model_counts);
+  if (small_result.frontier.empty() ||
+      small_result.chosen_candidate().num_models != 50 ||
+      small_lut_result.frontier.empty() ||
+      small_lut_result.chosen_candidate().num_models != 1) {
+    std::cout << "Error: tuner left no candidate for a small index"
+              << std::endl;
+  }
+  for (const auto& record : small_data) {
+    const int* found_value = small_tuned_index.get_value(record.first);
+    const int* found_lut_value = small_tuned_lut.get_value(record.first);
+    if (found_value == nullptr || *found_value != record.second ||
+        found_lut_value == nullptr || *found_lut_value != record.second) {
+      std::cout << "Error: incorrect lookup in a small tuned index for key "
+                << record.first << std::endl;
+    }
+  }
+
+  // The latency histogram keeps percentiles within its bucket precision and
+  // the maximum exactly.
+  LatencyHistogram histogram;
+  for (uint64_t value = 1; value <= 100000; value++) {
+    histogram.record(value);
+  }
+  for (double q : {0.5, 0.9, 0.99, 0.999}) {
+    double exact = q * 100000;
+    if (std::abs(histogram.percentile(q) - exact) > exact / 64) {
+      std::cout << "Error: latency percentile " << q << " is "
+                << histogram.percentile(q) << ", expected about " << exact
+                << std::endl;
+    }
+  }
+  if (histogram.max() != 100000 || histogram.count() != 100000) {
+    std::cout << "Error: latency histogram lost values" << std::endl;
+  }
+
+  // The hot-key table finds every inserted key (also after growing), rejects
+  // duplicates and treats +0.0 and -0.0 as the same key.
+  HotKeyTable<double, int> hot_keys;
+  for (int i = 0; i < 1000; i++) {
+    hot_keys.insert(i * 0.5, i, i);
+  }
+  if (hot_keys.size() != 1000 || hot_keys.insert(0.5, -1, -1) ||
+      hot_keys.find(-0.0) == nullptr || hot_keys.find(1000.25) != nullptr) {
+    std::cout << "Error: hot-key table lookups are inconsistent" << std::endl;
+  }
+  for (int i = 0; i < 1000; i++) {
+    const int* found_value = hot_keys.find(i * 0.5);
+    if (found_value == nullptr || *found_value != i) {
+      std::cout << "Error: hot-key table lost key " << i * 0.5 << std::endl;
+    }
+  }
+
+  // A table that holds every key still leaves a model for ordered queries.
+  std::vector<std::pair<uint64_t, int>> full_table_data;
+  for (int i = 0; i < 100; i++) {
+    full_table_data.emplace_back(5 * uint64_t(i), i);
+  }
+  LookUpTableLearnedIndex<uint64_t, int> full_table_index(
+      full_table_data, std::vector<double>(full_table_data.size(), 1));
+  full_table_index.build(10, 1000);
+  if (full_table_index.get_value(5 * 42) == nullptr ||
+      *full_table_index.get_value(5 * 42) != 42 ||
+      full_table_index.get_value(5 * 42 + 1) != nullptr ||
+      full_table_index.lower_bound(5 * 42 + 1) != 43 ||
+      full_table_index.range(0, 5 * 50).size() != 50) {
+    std::cout << "Error: incorrect lookup with every key in the table"
+              << std::endl;
+  }
+
+  // In adaptive mode the hot-key table picks up the keys the lookups repeat,
+  // and every key stays reachable while the table changes.
+  std::vector<uint64_t> adaptive_keys;
+  std::vector<int> adaptive_values;
+  for (int i = 0; i < 10000; i++) {
+    adaptive_keys.push_back(3 * uint64_t(i) * i);
+    adaptive_values.push_back(i);
+  }
+  LookUpTableLearnedIndex<uint64_t, int> adaptive_index(adaptive_keys,
+                                                        adaptive_values);
+  LookUpTableLearnedIndex<uint64_t, int>::AdaptiveOptions options;
+  options.table_size = 10;
+  options.sample_period = 1;
+  options.refresh_samples = 100;
+  adaptive_index.build_adaptive(10, options);
+  // Every other lookup is one of 10 hot keys, the rest sweep all keys.
+  for (int lookup = 0; lookup < 20000; lookup++) {
+    adaptive_index.maybe_refresh();
+    int i = lookup % 2 == 0 ? (lookup / 2 % 10) * 1000 : lookup / 2;
+    const int* found_value = adaptive_index.get_value(adaptive_keys[i]);
+    if (found_value == nullptr || *found_value != i) {
+      std::cout << "Error: adaptive lookup failed for key "
+                << adaptive_keys[i] << std::endl;
+    }
+  }
+  auto adaptive_stats = adaptive_index.get_adaptive_stats();
+  if (adaptive_stats.refreshes == 0 || adaptive_stats.hit_ratio() < 0.4 ||
+      adaptive_index.get_value(1) != nullptr) {
+    std::cout << "Error: adaptive hot-key table never served a lookup"
+              << std::endl;
+  }
+  // Lookups keep finding their values while another thread refreshes the
+  // table, and a hot key's value outlives the table it was found in.
+  adaptive_index.build_adaptive(10, options);
+  const int* hot_value = nullptr;
+  std::vector<std::thread> adaptive_threads;
+  for (int t = 0; t < 4; t++) {
+    adaptive_threads.emplace_back([&adaptive_index, &adaptive_keys] {
+      for (int lookup = 0; lookup < 20000; lookup++) {
+        int i = lookup % 2 == 0 ? (lookup / 2 % 10) * 1000 : lookup / 2;
+        const int* found_value = adaptive_index.get_value(adaptive_keys[i]);
+        if (found_value == nullptr || *found_value != i) {
+          std::cout << "Error: concurrent adaptive lookup failed for key "
+                    << adaptive_keys[i] << std::endl;
+        }
+      }
+    });
+  }
+  for (int refresh = 0; refresh < 1000; refresh++) {
+    adaptive_index.maybe_refresh();
+    if (refresh == 500) {
+      hot_value = adaptive_index.get_value(0);
+    }
+    std::this_thread::yield();
+  }
+  for (auto& thread : adaptive_threads) {
+    thread.join();
+  }
+  while (adaptive_index.maybe_refresh()) {
+  }
+  if (hot_value == nullptr || *hot_value != 0 ||
+      adaptive_index.get_value(0) != hot_value) {
+    std::cout << "Error: adaptive hot value moved with its table"
+              << std::endl;
+  }
+
+  // The sorted hot tier finds its keys through its model and rejects others.
+  std::vector<HotTier<uint64_t, int>::Entry> tier_entries;
+  for (int i = 0; i < 500; i++) {
+    tier_entries.push_back({2 * uint64_t(i) * i * i, i, i});
+  }
+  HotTier<uint64_t, int> hot_tier;
+  hot_tier.build(tier_entries);
+  for (const auto& entry : tier_entries) {
+    const int* found_value = hot_tier.find(entry.key);
+    if (found_value == nullptr || *found_value != entry.value ||
+        hot_tier.find(entry.key + 1) != nullptr) {
+      std::cout << "Error: incorrect hot tier lookup for key " << entry.key
+                << std::endl;
+    }
+  }
+
+  // The updatable index keeps every inserted key reachable through segment
+  // expansions and splits, and forgets erased keys.
+  std::vector<std::pair<uint64_t, int>> updatable_data;
+  for (int i = 0; i < 1000; i++) {
+    updatable_data.emplace_back(4 * uint64_t(i), i);
+  }
+  UpdatableLearnedIndex<uint64_t, int> updatable_index(updatable_data);
+  updatable_index.build(10);
+  for (int i = 0; i < 3000; i++) {
+    if (!updatable_index.insert(4 * uint64_t(i) + 1, i) ||
+        updatable_index.insert(4 * uint64_t(i) + 1, i)) {
+      std::cout << "Error: incorrect insert of key " << 4 * i + 1
+                << std::endl;
+    }
+  }
+  for (int i = 0; i < 1000; i += 2) {
+    updatable_index.erase(4 * uint64_t(i));
+  }
+  for (int i = 0; i < 3000; i++) {
+    const int* found_value = updatable_index.get_value(4 * uint64_t(i) + 1);
+    const int* erased_value = updatable_index.get_value(4 * uint64_t(i));
+    if (found_value == nullptr || *found_value != i ||
+        (i < 1000 && (erased_value != nullptr) != (i % 2 == 1))) {
+      std::cout << "Error: incorrect lookup after updates near key " << 4 * i
+                << std::endl;
+    }
+  }
+  if (updatable_index.size() != 3500 ||
+      updatable_index.get_update_stats().splits == 0) {
+    std::cout << "Error: updatable index did not split its segments"
+              << std::endl;
+  }
+  // A rebuild repartitions the keys indexed after the updates.
+  updatable_index.build(5);
+  if (updatable_index.size() != 3500 || updatable_index.num_segments() != 5 ||
+      updatable_index.get_value(4 * uint64_t(999) + 1) == nullptr ||
+      updatable_index.get_value(4 * uint64_t(998)) != nullptr ||
+      updatable_index.get_value(4 * uint64_t(999)) == nullptr) {
+    std::cout << "Error: incorrect updatable index rebuild" << std::endl;
+  }
 }
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* An event counter that many threads can bump concurrently, used for the
+ * last-mile search statistics of the learned indexes.
+ *
+ * Up to kNumOwnedShards live threads that count something each own a
+ * cache-line-sized shard, and give it back when they exit. As its only
+ * writer, a thread bumps it with a relaxed load and store rather than a
+ * locked read-modify-write, so a count costs about as much as a plain
+ * increment and concurrent lookups do not bounce a shared cache line
+ * between cores. Threads beyond that share the kNumSharedShards remaining
+ * shards and add with fetch_add. Reading the
+ * count sums the shards; it is exact once the threads that incremented it
+ * have been joined, and reset() must not run concurrently with add(). The
+ * shards live on the heap so that sizeof() of an index, which the
+ * benchmarks report as its model size, only grows by a pointer.
+ */
+class ShardedCounter {
+ public:
+  ShardedCounter() : shards_(new Shard[kNumShards]) { reset(); }
+
+  // Copies and assignments take a snapshot of the count.
+  ShardedCounter(const ShardedCounter& other) : ShardedCounter() {
+    shards_[0].count.store(other.load(), std::memory_order_relaxed);
+  }
+  ShardedCounter& operator=(const ShardedCounter& other) {
+    int64_t count = other.load();
+    reset();
+    shards_[0].count.store(count, std::memory_order_relaxed);
+    return *this;
+  }
+
+  void add(int64_t delta) {
+    size_t shard = thread_shard();
+    std::atomic<int64_t>& count = shards_[shard].count;
+    if (shard < kNumOwnedShards) {
+      count.store(count.load(std::memory_order_relaxed) + delta,
+                  std::memory_order_relaxed);
+    } else {
+      count.fetch_add(delta, std::memory_order_relaxed);
+    }
+  }
+
+  int64_t load() const {
+    int64_t count = 0;
+    for (size_t i = 0; i < kNumShards; i++) {
+      count += shards_[i].count.load(std::memory_order_relaxed);
+    }
+    return count;
+  }
+
+  void reset() {
+    for (size_t i = 0; i < kNumShards; i++) {
+      shards_[i].count.store(0, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  static constexpr size_t kNumOwnedShards = 64;
+  static constexpr size_t kNumSharedShards = 8;
+  static constexpr size_t kNumShards = kNumOwnedShards + kNumSharedShards;
+
+  struct alignas(64) Shard {
+    std::atomic<int64_t> count;
+  };
+
+  // The owned shards that no live thread holds. Ownership is by shard
+  // number, shared by every counter; a shard keeps its counts when it
+  // changes hands, and the mutex orders the old owner's writes before the
+  // new owner's.
+  struct ShardPool {
+    std::mutex mutex;
+    std::vector<size_t> free_shards;
+    size_t next_unused = 0;
+    size_t next_shared = 0;
+  };
+
+  // Takes a shard for its thread when the thread first counts something,
+  // and returns an owned shard to the pool when the thread exits.
+  struct ShardOwner {
+    ShardOwner() {
+      ShardPool& pool = shard_pool();
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      if (!pool.free_shards.empty()) {
+        shard = pool.free_shards.back();
+        pool.free_shards.pop_back();
+      } else if (pool.next_unused < kNumOwnedShards) {
+        shard = pool.next_unused++;
+      } else {
+        shard = kNumOwnedShards + pool.next_shared++ % kNumSharedShards;
+      }
+    }
+    ~ShardOwner() {
+      if (shard < kNumOwnedShards) {
+        ShardPool& pool = shard_pool();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.free_shards.push_back(shard);
+      }
+    }
+
+    size_t shard;
+  };
+
+  // Constructed before the first ShardOwner, so it outlives them all.
+  static ShardPool& shard_pool() {
+    static ShardPool pool;
+    return pool;
+  }
+
+  static size_t thread_shard() {
+    thread_local ShardOwner owner;
+    return owner.shard;
+  }
+
+  std::unique_ptr<Shard[]> shards_;
+};
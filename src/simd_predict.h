@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define LEARNED_INDEX_X86_SIMD 1
+#endif
+
+/* Batched model inference: evaluate linear models for many keys at once and
+ * clamp the predicted positions to a range.
+ *
+ * Each kernel computes exactly what the scalar code does per key,
+ *
+ *   int64_t p = model.predict(key);   // (int64_t) fma(slope, key, intercept)
+ *   p = std::min(std::max(p, lo), hi);
+ *
+ * for 4 (AVX2) or 8 (AVX-512) keys per instruction, so batched and scalar
+ * lookups agree and error bounds computed in batches hold for scalar lookups.
+ * That includes predictions outside the int64_t range (e.g., keys far beyond
+ * the trained range), which x86 converts to INT64_MIN and therefore clamp to
+ * `lo`.
+ *
+ * The vector code is compiled with target attributes and picked at run time
+ * from the CPU features, so the header does not require building with
+ * -mavx2 or -mavx512f. Vector kernels exist for uint64_t and double keys (the
+ * SOSD key types); other key types and CPUs without AVX2 and FMA use the
+ * scalar loop.
+ */
+
+enum class SimdLevel { kScalar, kAvx2, kAvx512 };
+
+// The widest kernel supported by this CPU, detected once.
+inline SimdLevel simd_level() {
+#ifdef LEARNED_INDEX_X86_SIMD
+  static const SimdLevel level = []() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512dq")) {
+      return SimdLevel::kAvx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return SimdLevel::kAvx2;
+    }
+    return SimdLevel::kScalar;
+  }();
+  return level;
+#else
+  return SimdLevel::kScalar;
+#endif
+}
+
+namespace simd_predict_internal {
+
+template <class K>
+constexpr bool kHasVectorKernel =
+    std::is_same<K, uint64_t>::value || std::is_same<K, double>::value;
+
+template <class K>
+inline int64_t predict_clamped_scalar(double slope, double intercept, K key,
+                                      int64_t lo, int64_t hi) {
+  int64_t p = static_cast<int64_t>(
+      std::fma(slope, static_cast<double>(key), intercept));
+  return std::min(std::max(p, lo), hi);
+}
+
+#ifdef LEARNED_INDEX_X86_SIMD
+
+// GCC 12 reports the placeholder operands of its own AVX-512 intrinsics as
+// maybe-uninitialized once they are inlined.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// ---- AVX2: 4 keys per vector ----
+
+// Exact (correctly rounded) uint64_t to double conversion: the high and low
+// 32-bit halves convert exactly, and adding them rounds once.
+__attribute__((target("avx2,fma"))) inline __m256d avx2_to_double(
+    const uint64_t* keys) {
+  __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys));
+  const __m256i kLowMagic = _mm256_set1_epi64x(0x4330000000000000);   // 2^52
+  const __m256i kHighMagic = _mm256_set1_epi64x(0x4530000000000000);  // 2^84
+  const __m256d kBothMagic = _mm256_set1_pd(19342813118337666422669312.);
+  __m256i low = _mm256_blend_epi32(kLowMagic, x, 0x55);
+  __m256i high = _mm256_or_si256(_mm256_srli_epi64(x, 32), kHighMagic);
+  __m256d high_minus_magic =
+      _mm256_sub_pd(_mm256_castsi256_pd(high), kBothMagic);
+  return _mm256_add_pd(high_minus_magic, _mm256_castsi256_pd(low));
+}
+
+__attribute__((target("avx2,fma"))) inline __m256d avx2_to_double(
+    const double* keys) {
+  return _mm256_loadu_pd(keys);
+}
+
+// Clamp 4 predictions to [lo, hi] and truncate them. Out-of-range and NaN
+// predictions become `lo`, like the scalar INT64_MIN conversion result.
+__attribute__((target("avx2,fma"))) inline void avx2_clamp_store(
+    __m256d v, double lo, double hi, int64_t* out) {
+  const __m256d kTwo63 = _mm256_set1_pd(9223372036854775808.);
+  __m256d in_range =
+      _mm256_and_pd(_mm256_cmp_pd(v, kTwo63, _CMP_LT_OQ),
+                    _mm256_cmp_pd(v, _mm256_set1_pd(-9223372036854775808.),
+                                  _CMP_GE_OQ));
+  __m256d vlo = _mm256_set1_pd(lo);
+  v = _mm256_blendv_pd(vlo, v, in_range);
+  v = _mm256_min_pd(_mm256_max_pd(v, vlo), _mm256_set1_pd(hi));
+  v = _mm256_round_pd(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+  // v is now an integer in [lo, hi], |v| < 2^51: convert it exactly by
+  // adding 1.5 * 2^52 and reading the low mantissa bits.
+  const __m256d kMagic = _mm256_set1_pd(6755399441055744.);
+  __m256i bits = _mm256_castpd_si256(_mm256_add_pd(v, kMagic));
+  __m256i result = _mm256_sub_epi64(bits, _mm256_castpd_si256(kMagic));
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), result);
+}
+
+template <class K>
+__attribute__((target("avx2,fma"))) void avx2_predict_clamped(
+    double slope, double intercept, const K* keys, size_t n, int64_t lo,
+    int64_t hi, int64_t* out) {
+  __m256d vslope = _mm256_set1_pd(slope);
+  __m256d vintercept = _mm256_set1_pd(intercept);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d v = _mm256_fmadd_pd(vslope, avx2_to_double(keys + i), vintercept);
+    avx2_clamp_store(v, lo, hi, out + i);
+  }
+  for (; i < n; i++) {
+    out[i] = predict_clamped_scalar(slope, intercept, keys[i], lo, hi);
+  }
+}
+
+template <class K>
+__attribute__((target("avx2,fma"))) void avx2_predict_clamped_gather(
+    const double* params, size_t stride, const int64_t* model_index,
+    const K* keys, size_t n, int64_t lo, int64_t hi, int64_t* out) {
+  __m256i vstride = _mm256_set1_epi64x(stride);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i index = _mm256_mul_epu32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(model_index + i)),
+        vstride);
+    __m256d slope = _mm256_i64gather_pd(params, index, 8);
+    __m256d intercept = _mm256_i64gather_pd(params + 1, index, 8);
+    __m256d v = _mm256_fmadd_pd(slope, avx2_to_double(keys + i), intercept);
+    avx2_clamp_store(v, lo, hi, out + i);
+  }
+  for (; i < n; i++) {
+    const double* model = params + model_index[i] * stride;
+    out[i] = predict_clamped_scalar(model[0], model[1], keys[i], lo, hi);
+  }
+}
+
+// ---- AVX-512: 8 keys per vector ----
+
+__attribute__((target("avx512f,avx512dq"))) inline __m512d avx512_to_double(
+    const uint64_t* keys) {
+  return _mm512_cvtepu64_pd(_mm512_loadu_si512(keys));
+}
+
+__attribute__((target("avx512f,avx512dq"))) inline __m512d avx512_to_double(
+    const double* keys) {
+  return _mm512_loadu_pd(keys);
+}
+
+// vcvttpd2qq returns INT64_MIN for out-of-range and NaN inputs, exactly like
+// the scalar conversion, so the clamp can use 64-bit integer min/max.
+__attribute__((target("avx512f,avx512dq"))) inline void avx512_clamp_store(
+    __m512d v, int64_t lo, int64_t hi, int64_t* out) {
+  __m512i p = _mm512_cvttpd_epi64(v);
+  p = _mm512_min_epi64(_mm512_max_epi64(p, _mm512_set1_epi64(lo)),
+                       _mm512_set1_epi64(hi));
+  _mm512_storeu_si512(out, p);
+}
+
+template <class K>
+__attribute__((target("avx512f,avx512dq"))) void avx512_predict_clamped(
+    double slope, double intercept, const K* keys, size_t n, int64_t lo,
+    int64_t hi, int64_t* out) {
+  __m512d vslope = _mm512_set1_pd(slope);
+  __m512d vintercept = _mm512_set1_pd(intercept);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512d v =
+        _mm512_fmadd_pd(vslope, avx512_to_double(keys + i), vintercept);
+    avx512_clamp_store(v, lo, hi, out + i);
+  }
+  for (; i < n; i++) {
+    out[i] = predict_clamped_scalar(slope, intercept, keys[i], lo, hi);
+  }
+}
+
+template <class K>
+__attribute__((target("avx512f,avx512dq"))) void avx512_predict_clamped_gather(
+    const double* params, size_t stride, const int64_t* model_index,
+    const K* keys, size_t n, int64_t lo, int64_t hi, int64_t* out) {
+  __m512i vstride = _mm512_set1_epi64(stride);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i index = _mm512_mullo_epi64(_mm512_loadu_si512(model_index + i),
+                                       vstride);
+    __m512d slope = _mm512_i64gather_pd(index, params, 8);
+    __m512d intercept = _mm512_i64gather_pd(index, params + 1, 8);
+    __m512d v = _mm512_fmadd_pd(slope, avx512_to_double(keys + i), intercept);
+    avx512_clamp_store(v, lo, hi, out + i);
+  }
+  for (; i < n; i++) {
+    const double* model = params + model_index[i] * stride;
+    out[i] = predict_clamped_scalar(model[0], model[1], keys[i], lo, hi);
+  }
+}
+
+#pragma GCC diagnostic pop
+
+#endif  // LEARNED_INDEX_X86_SIMD
+
+// The kernels read a model as two doubles, slope then intercept, at the
+// start of the model object.
+template <class Model>
+const double* model_params(const Model& model) {
+  static_assert(std::is_standard_layout<Model>::value &&
+                    sizeof(Model) % sizeof(double) == 0,
+                "Models must start with their slope and intercept.");
+  return &model.m_;
+}
+
+}  // namespace simd_predict_internal
+
+// out[i] = model's prediction for keys[i], clamped to [lo, hi].
+template <class Model, class K>
+void predict_clamped(const Model& model, const K* keys, size_t n, int64_t lo,
+                     int64_t hi, int64_t* out) {
+  using namespace simd_predict_internal;
+#ifdef LEARNED_INDEX_X86_SIMD
+  if constexpr (kHasVectorKernel<K>) {
+    switch (simd_level()) {
+      case SimdLevel::kAvx512:
+        avx512_predict_clamped(model.m_, model.b_, keys, n, lo, hi, out);
+        return;
+      case SimdLevel::kAvx2:
+        avx2_predict_clamped(model.m_, model.b_, keys, n, lo, hi, out);
+        return;
+      case SimdLevel::kScalar:
+        break;
+    }
+  }
+#endif
+  for (size_t i = 0; i < n; i++) {
+    out[i] = predict_clamped_scalar(model.m_, model.b_, keys[i], lo, hi);
+  }
+}
+
+// out[i] = models[model_index[i]]'s prediction for keys[i], clamped to
+// [lo, hi]. The slopes and intercepts are gathered from the model array.
+template <class Model, class K>
+void predict_clamped_gather(const Model* models, const int64_t* model_index,
+                            const K* keys, size_t n, int64_t lo, int64_t hi,
+                            int64_t* out) {
+  using namespace simd_predict_internal;
+#ifdef LEARNED_INDEX_X86_SIMD
+  if constexpr (kHasVectorKernel<K>) {
+    const double* params = model_params(models[0]);
+    size_t stride = sizeof(Model) / sizeof(double);
+    switch (simd_level()) {
+      case SimdLevel::kAvx512:
+        avx512_predict_clamped_gather(params, stride, model_index, keys, n, lo,
+                                      hi, out);
+        return;
+      case SimdLevel::kAvx2:
+        avx2_predict_clamped_gather(params, stride, model_index, keys, n, lo,
+                                    hi, out);
+        return;
+      case SimdLevel::kScalar:
+        break;
+    }
+  }
+#endif
+  for (size_t i = 0; i < n; i++) {
+    const Model& model = models[model_index[i]];
+    out[i] = predict_clamped_scalar(model.m_, model.b_, keys[i], lo, hi);
+  }
+}
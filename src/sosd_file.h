@@ -0,0 +1,146 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "span.h"
+
+/* Zero-copy loading of the benchmark inputs.
+ *
+ * A MappedFile maps a whole file read-only into memory; the loaders below
+ * return Spans straight into the mapping, so keys, workloads and weights are
+ * never copied into intermediate buffers. Pages are read from the page cache
+ * (or disk) on first touch, and the madvise hints let the kernel read ahead
+ * for sequential scans such as build().
+ *
+ * File formats:
+ *  - SOSD key files start with an 8-byte record count followed by the keys
+ *    (this is the header that generate_workloads.py drops with `[1:]`).
+ *  - Workload and weight files are raw arrays without a header.
+ */
+
+// Access pattern hint passed to madvise().
+enum class AccessAdvice { kNormal, kSequential, kRandom, kWillNeed };
+
+class MappedFile {
+ public:
+  MappedFile() = default;
+
+  // Map `path` read-only. On failure the file is left unmapped and is_open()
+  // returns false. With `huge_pages`, the mapping is also advised to be
+  // backed by transparent huge pages, which cuts TLB misses on random
+  // lookups over large files where the kernel and file system support it
+  // (the hint is silently ignored elsewhere).
+  explicit MappedFile(const std::string& path,
+                      AccessAdvice advice = AccessAdvice::kNormal,
+                      bool huge_pages = false) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return;
+    }
+    void* addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      return;
+    }
+    data_ = static_cast<const char*>(addr);
+    size_ = st.st_size;
+    if (huge_pages) {
+#ifdef MADV_HUGEPAGE
+      ::madvise(addr, size_, MADV_HUGEPAGE);
+#endif
+    }
+    advise(advice);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept
+      : data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)) {}
+
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+      unmap();
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+
+  ~MappedFile() { unmap(); }
+
+  bool is_open() const { return data_ != nullptr; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Change the access pattern hint, e.g., from kSequential while an index is
+  // built to kRandom while it serves lookups.
+  void advise(AccessAdvice advice) const {
+    if (!is_open()) {
+      return;
+    }
+    int flag = MADV_NORMAL;
+    switch (advice) {
+      case AccessAdvice::kNormal: flag = MADV_NORMAL; break;
+      case AccessAdvice::kSequential: flag = MADV_SEQUENTIAL; break;
+      case AccessAdvice::kRandom: flag = MADV_RANDOM; break;
+      case AccessAdvice::kWillNeed: flag = MADV_WILLNEED; break;
+    }
+    ::madvise(const_cast<char*>(data_), size_, flag);
+  }
+
+ private:
+  void unmap() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<char*>(data_), size_);
+      data_ = nullptr;
+      size_ = 0;
+    }
+  }
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// View of the first `count` elements of a raw array file (workloads,
+// weights). Returns an empty span if the file holds fewer elements.
+template <class T>
+Span<T> raw_array(const MappedFile& file, size_t count) {
+  if (!file.is_open() || file.size() / sizeof(T) < count) {
+    return Span<T>();
+  }
+  return Span<T>(reinterpret_cast<const T*>(file.data()), count);
+}
+
+// View of the first `count` keys of a SOSD key file, skipping its 8-byte
+// record count header. Returns an empty span if the header announces fewer
+// keys or the file is truncated.
+template <class K>
+Span<K> sosd_keys(const MappedFile& file, size_t count) {
+  if (!file.is_open() || file.size() < sizeof(uint64_t)) {
+    return Span<K>();
+  }
+  uint64_t num_keys;
+  std::memcpy(&num_keys, file.data(), sizeof(num_keys));
+  size_t available = (file.size() - sizeof(uint64_t)) / sizeof(K);
+  if (num_keys < count || available < count) {
+    return Span<K>();
+  }
+  return Span<K>(reinterpret_cast<const K*>(file.data() + sizeof(uint64_t)),
+                 count);
+}
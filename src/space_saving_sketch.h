@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/* Space-saving sketch (Metwally et al.) of the most frequent keys of a stream.
+ *
+ * The sketch monitors at most `capacity` keys. A new key that arrives when
+ * all counters are taken replaces the key with the smallest count and
+ * inherits that count plus one, so the count of a monitored key overestimates
+ * its true frequency by at most the smallest count. Every key whose frequency
+ * exceeds (stream length / capacity) is monitored.
+ *
+ * The counters form a binary min-heap on their counts, so an update costs
+ * O(log capacity). The sketch is not thread-safe.
+ */
+template <class K>
+class SpaceSavingSketch {
+ public:
+  explicit SpaceSavingSketch(size_t capacity = 1) : capacity_(capacity) {
+    counters_.reserve(capacity_);
+    slot_of_.reserve(capacity_);
+  }
+
+  size_t size() const { return counters_.size(); }
+
+  // Count one occurrence of `key`.
+  void add(K key) {
+    auto it = slot_of_.find(key);
+    if (it != slot_of_.end()) {
+      counters_[it->second].count++;
+      sift_down(it->second);
+    } else if (counters_.size() < capacity_) {
+      counters_.push_back({key, 1});
+      slot_of_.emplace(key, counters_.size() - 1);
+      sift_up(counters_.size() - 1);
+    } else if (capacity_ > 0) {
+      slot_of_.erase(counters_[0].key);
+      counters_[0].key = key;
+      counters_[0].count++;
+      slot_of_.emplace(key, 0);
+      sift_down(0);
+    }
+  }
+
+  // Return up to `k` monitored keys in decreasing order of their count.
+  std::vector<K> top(size_t k) const {
+    std::vector<Counter> sorted = counters_;
+    k = std::min(k, sorted.size());
+    std::partial_sort(sorted.begin(), sorted.begin() + k, sorted.end(),
+                      [](const Counter& a, const Counter& b) {
+                        return a.count > b.count;
+                      });
+    std::vector<K> keys(k);
+    for (size_t i = 0; i < k; i++) {
+      keys[i] = sorted[i].key;
+    }
+    return keys;
+  }
+
+  // Halve every count, so that recent occurrences outweigh older ones.
+  // Halving keeps the order of the counts, and with it the heap.
+  void decay() {
+    for (Counter& counter : counters_) {
+      counter.count /= 2;
+    }
+  }
+
+ private:
+  struct Counter {
+    K key;
+    uint64_t count;
+  };
+
+  void swap_counters(size_t a, size_t b) {
+    std::swap(counters_[a], counters_[b]);
+    slot_of_[counters_[a].key] = a;
+    slot_of_[counters_[b].key] = b;
+  }
+
+  void sift_up(size_t i) {
+    while (i > 0 && counters_[(i - 1) / 2].count > counters_[i].count) {
+      swap_counters(i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+  }
+
+  void sift_down(size_t i) {
+    while (true) {
+      size_t smallest = i;
+      for (size_t child = 2 * i + 1; child <= 2 * i + 2; child++) {
+        if (child < counters_.size() &&
+            counters_[child].count < counters_[smallest].count) {
+          smallest = child;
+        }
+      }
+      if (smallest == i) {
+        return;
+      }
+      swap_counters(i, smallest);
+      i = smallest;
+    }
+  }
+
+  size_t capacity_;
+  std::vector<Counter> counters_;
+  std::unordered_map<K, size_t> slot_of_;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+/* A read-only view of a contiguous array that the view does not own, e.g.,
+ * keys in a memory-mapped SOSD file (see sosd_file.h). The viewed memory must
+ * outlive the view and anything built on top of it.
+ */
+template <class T>
+class Span {
+ public:
+  Span() = default;
+  Span(const T* data, size_t size) : data_(data), size_(size) {}
+  Span(const std::vector<T>& v) : data_(v.data()), size_(v.size()) {}
+
+  const T* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const T& operator[](size_t i) const { return data_[i]; }
+
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+
+  // View of the `count` elements starting at `offset`.
+  Span subspan(size_t offset, size_t count) const {
+    assert(offset + count <= size_);
+    return Span(data_ + offset, count);
+  }
+
+ private:
+  const T* data_ = nullptr;
+  size_t size_ = 0;
+};
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "last_mile_search.h"
+#include "linear_model.h"
+#include "span.h"
+
+/* One second-level segment of UpdatableLearnedIndex: a gapped array.
+ *
+ * The segment's keys are sorted over `capacity` slots, some of which are
+ * gaps. A bitmap marks the occupied slots, and every gap holds a copy of the
+ * key of the next occupied slot to its right (or the largest K after the last
+ * one), so the key array stays sorted and can be searched as is. A linear
+ * model maps keys to slots, with the signed error range of the occupied keys.
+ *
+ * An insert goes to a gap between its neighbours (the one nearest to the
+ * model's prediction), or, if the neighbours are adjacent, shifts the keys up
+ * to the nearest gap by one slot. Erasing turns the slot into a gap. Shifted
+ * keys widen the error range, which never shrinks until the segment is
+ * rebuilt with assign().
+ */
+template <class K, class V>
+class GappedSegment {
+ public:
+  typedef std::pair<K, V> record;
+
+  // Spread the sorted, distinct `records` evenly over `capacity` slots (at
+  // least one per record, plus one gap) and fit the model.
+  void assign(const std::vector<record>& records, size_t capacity) {
+    capacity = std::max(capacity, records.size() + 1);
+    keys_.assign(capacity, kGapKey);
+    values_.assign(capacity, V());
+    occupied_.assign((capacity + 63) / 64, 0);
+    num_keys_ = records.size();
+    for (size_t i = 0; i < records.size(); i++) {
+      size_t slot = i * capacity / records.size();
+      keys_[slot] = records[i].first;
+      values_[slot] = records[i].second;
+      set_occupied(slot);
+    }
+    K next_key = kGapKey;
+    for (size_t slot = capacity; slot-- > 0;) {
+      if (is_occupied(slot)) {
+        next_key = keys_[slot];
+      } else {
+        keys_[slot] = next_key;
+      }
+    }
+
+    model_ = LinearModel<K>();
+    model_.train([&](auto&& add) {
+      for (size_t i = 0; i < records.size(); i++) {
+        add(records[i].first, i * capacity / records.size());
+      }
+    });
+    min_error_ = 0;
+    max_error_ = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+      track_error(i * capacity / records.size(), records[i].first);
+    }
+    base_error_window_ = error_window();
+  }
+
+  // The occupied slots' records in key order.
+  std::vector<record> records() const {
+    std::vector<record> result;
+    result.reserve(num_keys_);
+    for (int64_t slot = next_occupied(0); slot < capacity();
+         slot = next_occupied(slot + 1)) {
+      result.emplace_back(keys_[slot], values_[slot]);
+    }
+    return result;
+  }
+
+  size_t num_keys() const { return num_keys_; }
+  int64_t capacity() const { return keys_.size(); }
+  int64_t error_window() const { return max_error_ - min_error_; }
+  // The error window right after the last assign().
+  int64_t base_error_window() const { return base_error_window_; }
+
+  // Return the slot of `key`, or -1 if it is not in the segment.
+  int64_t find(K key) const {
+    int64_t slot = next_occupied(lower_bound_slot(key));
+    return slot < capacity() && keys_[slot] == key ? slot : -1;
+  }
+
+  V* value(int64_t slot) { return &values_[slot]; }
+
+  // Insert `key` unless it is already in the segment; return whether it was
+  // inserted. The segment must have a gap.
+  bool insert(K key, V value) {
+    int64_t bound = lower_bound_slot(key);
+    int64_t next = next_occupied(bound);
+    if (next < capacity() && keys_[next] == key) {
+      return false;
+    }
+    int64_t prev = prev_occupied(bound - 1);
+    int64_t slot;
+    if (next - prev > 1) {
+      // Take the gap between the neighbours nearest to the prediction.
+      slot = std::min(std::max(predict_clamped(key), prev + 1), next - 1);
+    } else {
+      int64_t right_gap = next_gap(next);
+      int64_t left_gap = prev_gap(prev);
+      assert(right_gap < capacity() || left_gap >= 0);
+      if (right_gap < capacity() &&
+          (left_gap < 0 || right_gap - next <= prev - left_gap)) {
+        for (int64_t i = right_gap; i > next; i--) {
+          move_slot(i - 1, i);
+        }
+        set_occupied(right_gap);
+        slot = next;
+      } else {
+        for (int64_t i = left_gap; i < prev; i++) {
+          move_slot(i + 1, i);
+        }
+        set_occupied(left_gap);
+        slot = prev;
+      }
+    }
+    keys_[slot] = key;
+    values_[slot] = value;
+    set_occupied(slot);
+    for (int64_t i = slot - 1; i >= 0 && !is_occupied(i); i--) {
+      keys_[i] = key;
+    }
+    track_error(slot, key);
+    num_keys_++;
+    return true;
+  }
+
+  // Erase `key`; return false if it is not in the segment.
+  bool erase(K key) {
+    int64_t slot = find(key);
+    if (slot == -1) {
+      return false;
+    }
+    clear_occupied(slot);
+    int64_t next = next_occupied(slot + 1);
+    K next_key = next < capacity() ? keys_[next] : kGapKey;
+    for (int64_t i = slot; i >= 0 && !is_occupied(i); i--) {
+      keys_[i] = next_key;
+    }
+    num_keys_--;
+    return true;
+  }
+
+ private:
+  static constexpr K kGapKey = std::numeric_limits<K>::max();
+
+  int64_t predict_clamped(K key) const {
+    return std::min<int64_t>(std::max<int64_t>(model_.predict(key), 0),
+                             capacity() - 1);
+  }
+
+  void track_error(int64_t slot, K key) {
+    int64_t error = slot - predict_clamped(key);
+    min_error_ = std::min(min_error_, error);
+    max_error_ = std::max(max_error_, error);
+  }
+
+  // First slot whose key is not less than `key`, searched in the model's
+  // error window widened by one slot, which also holds the insert position of
+  // a missing key since the model is monotone.
+  int64_t lower_bound_slot(K key) const {
+    int64_t predicted_slot = predict_clamped(key);
+    int64_t start = std::min(
+        std::max<int64_t>(predicted_slot + min_error_ - 1, 0), capacity());
+    int64_t end = std::min(
+        std::max<int64_t>(predicted_slot + max_error_ + 2, 0), capacity());
+    return std::lower_bound(keys_.begin() + start, keys_.begin() + end, key) -
+           keys_.begin();
+  }
+
+  void move_slot(int64_t from, int64_t to) {
+    keys_[to] = keys_[from];
+    values_[to] = values_[from];
+    track_error(to, keys_[to]);
+  }
+
+  bool is_occupied(int64_t slot) const {
+    return occupied_[slot / 64] >> (slot % 64) & 1;
+  }
+  void set_occupied(int64_t slot) {
+    occupied_[slot / 64] |= uint64_t(1) << (slot % 64);
+  }
+  void clear_occupied(int64_t slot) {
+    occupied_[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+  }
+
+  // First occupied slot (gap if kGaps) at or after `slot`, or capacity().
+  template <bool kGaps = false>
+  int64_t next_slot(int64_t slot) const {
+    if (slot >= capacity()) {
+      return capacity();
+    }
+    size_t word = slot / 64;
+    uint64_t bits = (kGaps ? ~occupied_[word] : occupied_[word]) &
+                    (~uint64_t(0) << (slot % 64));
+    while (bits == 0) {
+      if (++word == occupied_.size()) {
+        return capacity();
+      }
+      bits = kGaps ? ~occupied_[word] : occupied_[word];
+    }
+    return std::min<int64_t>(word * 64 + __builtin_ctzll(bits), capacity());
+  }
+
+  // Last occupied slot (gap if kGaps) at or before `slot`, or -1.
+  template <bool kGaps = false>
+  int64_t prev_slot(int64_t slot) const {
+    if (slot < 0) {
+      return -1;
+    }
+    size_t word = slot / 64;
+    uint64_t bits = (kGaps ? ~occupied_[word] : occupied_[word]) &
+                    (~uint64_t(0) >> (63 - slot % 64));
+    while (bits == 0) {
+      if (word == 0) {
+        return -1;
+      }
+      word--;
+      bits = kGaps ? ~occupied_[word] : occupied_[word];
+    }
+    return word * 64 + 63 - __builtin_clzll(bits);
+  }
+
+  int64_t next_occupied(int64_t slot) const { return next_slot(slot); }
+  int64_t prev_occupied(int64_t slot) const { return prev_slot(slot); }
+  int64_t next_gap(int64_t slot) const { return next_slot<true>(slot); }
+  int64_t prev_gap(int64_t slot) const { return prev_slot<true>(slot); }
+
+  std::vector<K> keys_;
+  std::vector<V> values_;
+  std::vector<uint64_t> occupied_;
+  size_t num_keys_ = 0;
+  LinearModel<K> model_;
+  int64_t min_error_ = 0;
+  int64_t max_error_ = 0;
+  int64_t base_error_window_ = 0;
+};
+
+/* Updatable variant of LearnedIndex: a two-level RMI whose second-level
+ * segments are gapped arrays (see GappedSegment), so keys can be inserted and
+ * erased in place.
+ *
+ * build() partitions the sorted keys into segments of equal size. Each
+ * segment covers the keys from its pivot (its first key at build or split
+ * time) up to the next segment's pivot, and the root model predicts the
+ * segment from a key with an error range over the pivots. A segment is
+ * expanded when an insert makes it denser than kMaxDensity, split in two
+ * (and the root model retrained) when it holds more than twice the keys of a
+ * segment at build time, and retrained when inserts have widened its error
+ * window past twice its size at the last rebuild. Keys are unique.
+ */
+template <class K, class V>
+class UpdatableLearnedIndex {
+  static_assert(std::is_arithmetic<K>::value,
+                "Learned index key type must be numeric.");
+
+ public:
+  typedef std::pair<K, V> record;
+
+  // Counters of the structural changes since build().
+  struct UpdateStats {
+    int64_t expansions = 0;
+    int64_t splits = 0;
+    int64_t retrains = 0;
+  };
+
+  // Takes ownership of the records. Only the first record of each key is
+  // kept.
+  UpdatableLearnedIndex(std::vector<record> data) : records_(std::move(data)) {
+    if (!std::is_sorted(records_.begin(), records_.end())) {
+      std::sort(records_.begin(), records_.end());
+    }
+    records_.erase(std::unique(records_.begin(), records_.end(),
+                               [](const record& a, const record& b) {
+                                 return a.first == b.first;
+                               }),
+                   records_.end());
+  }
+
+  // Index keys[i] with payload values[i].
+  UpdatableLearnedIndex(Span<K> keys, std::vector<V> values)
+      : UpdatableLearnedIndex(make_records(keys, values)) {}
+
+  // Partition the keys into `num_second_level_models` gapped segments. A
+  // later build() repartitions the keys indexed at that point, with their
+  // inserts and erases.
+  void build(int num_second_level_models) {
+    assert(num_second_level_models > 0);
+    if (!segments_.empty()) {
+      records_.reserve(size_);
+      for (const auto& segment : segments_) {
+        std::vector<record> records = segment.records();
+        records_.insert(records_.end(), records.begin(), records.end());
+      }
+    }
+    size_t num_segments = std::max<size_t>(
+        std::min<size_t>(num_second_level_models, records_.size()), 1);
+    max_segment_keys_ = std::max<size_t>(
+        2 * ((records_.size() + num_segments - 1) / num_segments),
+        kMinSplitKeys);
+    segments_.assign(num_segments, GappedSegment<K, V>());
+    pivots_.assign(num_segments, K());
+    for (size_t i = 0; i < num_segments; i++) {
+      size_t begin = records_.size() * i / num_segments;
+      size_t end = records_.size() * (i + 1) / num_segments;
+      std::vector<record> records(records_.begin() + begin,
+                                  records_.begin() + end);
+      if (!records.empty()) {
+        pivots_[i] = records.front().first;
+      }
+      segments_[i].assign(records, records.size() / kInitialDensity);
+    }
+    records_ = std::vector<record>();
+    stats_ = UpdateStats();
+    train_root_model();
+  }
+
+  // If the key exists, return a pointer to the corresponding value.
+  // If the key does not exist, return a nullptr.
+  V* get_value(K key) {
+    assert(!segments_.empty());
+    GappedSegment<K, V>& segment = segments_[find_segment(key)];
+    int64_t slot = segment.find(key);
+    return slot == -1 ? nullptr : segment.value(slot);
+  }
+
+  // Insert the key with its value. Return false, leaving the index
+  // unchanged, if the key is already indexed.
+  bool insert(K key, V value) {
+    assert(!segments_.empty());
+    size_t i = find_segment(key);
+    if (!segments_[i].insert(key, value)) {
+      return false;
+    }
+    size_++;
+    GappedSegment<K, V>& segment = segments_[i];
+    if (segment.num_keys() > kMaxDensity * segment.capacity()) {
+      if (segment.num_keys() > max_segment_keys_) {
+        split_segment(i);
+      } else {
+        segment.assign(segment.records(),
+                       segment.num_keys() / kExpandedDensity);
+        stats_.expansions++;
+      }
+    } else if (segment.error_window() > 2 * segment.base_error_window() +
+                                            kMinRetrainErrorWindow) {
+      segment.assign(segment.records(), segment.capacity());
+      stats_.retrains++;
+    }
+    return true;
+  }
+
+  // Erase the key. Return false if it is not indexed.
+  bool erase(K key) {
+    assert(!segments_.empty());
+    if (!segments_[find_segment(key)].erase(key)) {
+      return false;
+    }
+    size_--;
+    return true;
+  }
+
+  size_t size() const { return size_; }
+  size_t num_segments() const { return segments_.size(); }
+  UpdateStats get_update_stats() const { return stats_; }
+
+ private:
+  static constexpr double kInitialDensity = 0.7;
+  static constexpr double kMaxDensity = 0.8;
+  static constexpr double kExpandedDensity = 0.6;
+  static constexpr size_t kMinSplitKeys = 64;
+  static constexpr int64_t kMinRetrainErrorWindow = 16;
+
+  static std::vector<record> make_records(Span<K> keys,
+                                          const std::vector<V>& values) {
+    assert(keys.size() == values.size());
+    std::vector<record> records(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      records[i] = {keys[i], values[i]};
+    }
+    return records;
+  }
+
+  // Fit the root model to the pivots and record its error range.
+  void train_root_model() {
+    size_ = 0;
+    for (const auto& segment : segments_) {
+      size_ += segment.num_keys();
+    }
+    root_model_ = LinearModel<K>();
+    root_model_.train([this](auto&& add) {
+      for (size_t i = 0; i < pivots_.size(); i++) {
+        add(pivots_[i], i);
+      }
+    });
+    ErrorBoundTracker error_tracker;
+    for (size_t i = 0; i < pivots_.size(); i++) {
+      error_tracker.add(static_cast<int64_t>(i) - predict_segment(pivots_[i]));
+    }
+    root_error_bound_ = error_tracker.finish();
+  }
+
+  int64_t predict_segment(K key) const {
+    return std::min<int64_t>(std::max<int64_t>(root_model_.predict(key), 0),
+                             static_cast<int64_t>(pivots_.size()) - 1);
+  }
+
+  // The segment of the last pivot not greater than `key` (segment 0 for keys
+  // below every pivot). Searched in the root model's error window, widened
+  // by one segment on the left since a key can predict a later segment than
+  // its pivot.
+  size_t find_segment(K key) const {
+    int64_t predicted = predict_segment(key);
+    int64_t num_segments = pivots_.size();
+    int64_t start = std::min<int64_t>(
+        std::max<int64_t>(predicted + root_error_bound_.min_error - 1, 0),
+        num_segments);
+    int64_t end = std::min<int64_t>(
+        std::max<int64_t>(predicted + root_error_bound_.max_error + 1, 0),
+        num_segments);
+    int64_t segment = std::upper_bound(pivots_.begin() + start,
+                                       pivots_.begin() + end, key) -
+                      pivots_.begin() - 1;
+    return std::max<int64_t>(segment, 0);
+  }
+
+  void split_segment(size_t i) {
+    std::vector<record> records = segments_[i].records();
+    size_t middle = records.size() / 2;
+    std::vector<record> right(records.begin() + middle, records.end());
+    records.resize(middle);
+    segments_[i].assign(records, records.size() / kInitialDensity);
+    GappedSegment<K, V> right_segment;
+    right_segment.assign(right, right.size() / kInitialDensity);
+    segments_.insert(segments_.begin() + i + 1, std::move(right_segment));
+    pivots_.insert(pivots_.begin() + i + 1, right.front().first);
+    stats_.splits++;
+    train_root_model();
+  }
+
+  // The records until build() distributes them over the segments (which
+  // are in key order, so a rebuild collects them back in order).
+  std::vector<record> records_;
+  std::vector<GappedSegment<K, V>> segments_;
+  // pivots_[i] is the smallest key routed to segment i (except for i = 0).
+  std::vector<K> pivots_;
+  LinearModel<K> root_model_;
+  ErrorBound root_error_bound_;
+  size_t max_segment_keys_ = kMinSplitKeys;
+  size_t size_ = 0;
+  UpdateStats stats_;
+};
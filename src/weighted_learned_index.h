@@ -1,12 +1,22 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
 #include <iostream>
 #include <numeric>
+#include <tuple>
 #include <vector>
 
+#include "last_mile_search.h"
+#include "parallel_build.h"
+#include "range_scan.h"
+#include "record_storage.h"
+#include "simd_predict.h"
+#include "sharded_counter.h"
+#include "span.h"
 #include "weighted_linear_model.h"
 
-template <class K, class V>
+template <class K, class V, class Storage = PairStorage<K, V>>
 class WLearnedIndex {
   static_assert(std::is_arithmetic<K>::value,
                 "Learned index key type must be numeric.");
@@ -14,91 +24,124 @@ class WLearnedIndex {
  public:
   typedef std::tuple<K, V, double> record;
 
-  WLearnedIndex(std::vector<record> data) : data_(data) {
-    std::sort(data_.begin(), data_.end());
+  // The training weight of each record is split off so that the storage
+  // only holds keys and payloads, and is freed once build() has used it.
+  // Takes ownership of the records.
+  WLearnedIndex(std::vector<record> data) { init(std::move(data)); }
+
+  // Index keys[i] with payload values[i] and training weight weights[i]
+  // without first building a record vector. Sorted keys (e.g., a SOSD file)
+  // are used in place with SplitStorage, so they must outlive the index.
+  // The weights of sorted keys are not copied either: they must stay valid
+  // until build(), which is their only reader.
+  WLearnedIndex(Span<K> keys, std::vector<V> values, Span<double> weights) {
+    assert(keys.size() == values.size());
+    assert(keys.size() == weights.size());
+    if (!std::is_sorted(keys.begin(), keys.end())) {
+      std::vector<record> data(keys.size());
+      for (size_t i = 0; i < keys.size(); i++) {
+        data[i] = record(keys[i], values[i], weights[i]);
+      }
+      init(std::move(data));
+      return;
+    }
+    data_ = Storage(keys, std::move(values));
+    weights_ = weights;
   }
 
   // Build a two-level RMI that only uses linear regression models, with the
-  // specified number of second-level models.
-  void build(int num_second_level_models) {
+  // specified number of second-level models, using `num_threads` threads.
+  // The index lets go of the weights afterwards, so it can be built once: a
+  // second build() returns false and leaves the trained models unchanged.
+  bool build(int num_second_level_models, int num_threads = 1) {
     assert(num_second_level_models > 0);
+    assert(num_threads > 0);
+    if (weights_.size() != data_.size()) {
+      return false;
+    }
     second_level_models_.clear();
+    second_level_error_bounds_.clear();
 
-    // Construct the root model over the entire data.
-    // Extract keys from key-value records. In practice, you would want to avoid
-    // this because it requires making a redundant temporary copy of all the
-    // keys, but for simplicity in this lab we will make some redundant copies.
-    std::vector<K> keys;
-    std::transform(std::begin(data_), std::end(data_), std::back_inserter(keys),
-                   [](auto const& tuple) { return std::get<0>(tuple); });
-      
-    std::vector<double> workload;
-    std::transform(std::begin(data_), std::end(data_), std::back_inserter(workload),
-                   [](auto const& tuple) { return std::get<2>(tuple); });
-      
-    // Build a vector of positions (i.e., indexes) for each key.
-    // For the root node over n records, these are simply the integers 0 through
-    // n-1.
-    std::vector<int> positions(keys.size());
-    std::iota(std::begin(positions), std::end(positions), 0);
-    root_model_.train(keys, positions, workload);
+    // Construct the root model over the entire data, streaming the sorted
+    // records with their positions (0 through n-1) and training weights.
+    root_model_.train([this](auto&& add) {
+      for (size_t pos = 0; pos < data_.size(); pos++) {
+        add(data_.key(pos), pos, weights_[pos]);
+      }
+    });
     // Rescale the root model so that instead of predicting a position, it
     // predicts the index for the second-level model. Feeding a key through
     // the root model will output the index of the second-level model to which
     // the key should be assigned (root model outputs may need to be manually
     // bounded between 0 and num_second_level_models-1).
     root_model_.rescale(static_cast<double>(num_second_level_models) /
-                        keys.size());
+                        data_.size());
 
     // Use the trained root model to assign records to each of the second-level
     // models. Then train the second-level models to predict the positions for
-    // each of their assigned records and compute the maximum prediction error
-    // for each second-level model. Unlike the paper, in which each model
-    // stores both a min-error (i.e., a left-error) and a max-error (i.e., a
-    // right error), here we will only store a single maximum bi-directional
-    // error for each second-level model.
-    int start_pos;
-    int end_pos = 0;  // exclusive
-    for (int i = 0; i < num_second_level_models; i++) {
-      start_pos = end_pos;
-      while (end_pos < static_cast<int>(data_.size()) &&
-             root_model_.predict(std::get<0>(data_[end_pos])) <= i) {
-        end_pos++;
-      }
-      // Edge case
-      if (i == num_second_level_models - 1) {
-        end_pos = static_cast<int>(data_.size());
-      }
-      keys.clear();
-      std::transform(std::begin(data_) + start_pos, std::begin(data_) + end_pos,
-                     std::back_inserter(keys),
-                     [](auto const& tuple) { return std::get<0>(tuple); });
-      workload.clear();
-      std::transform(std::begin(data_) + start_pos, std::begin(data_) + end_pos,
-                     std::back_inserter(workload),
-                     [](auto const& tuple) { return std::get<2>(tuple); });
-      positions.clear();
-      positions.resize(end_pos - start_pos);
-      std::iota(std::begin(positions), std::end(positions), start_pos);
-      WLinearModel<K, V> model;
-      model.train(keys, positions, workload);
-      second_level_models_.push_back(model);
-
-      // Compute error bound
-      int max_error = 0;
-      for (int pos = start_pos; pos < end_pos; pos++) {
-        int predicted_pos = model.predict(std::get<0>(data_[pos]));
-        max_error = std::max(max_error, std::abs(pos - predicted_pos));
-      }
-      second_level_error_bounds_.push_back(max_error);
+    // each of their assigned records and compute the prediction errors for
+    // each second-level model. As in the paper, each model stores both a
+    // min-error (i.e., a left-error) and a max-error (i.e., a right error),
+    // together with the last-mile search strategy that suits its errors.
+    //
+    // The record-to-model assignment comes from a parallel scan of the root
+    // model's predictions, and the second-level models are trained by a pool
+    // of `num_threads` workers. Each model and error bound only depends on its
+    // own records, so the result is the same for any number of threads.
+    std::vector<size_t> segment_ends = compute_segment_ends(
+        data_.size(), num_second_level_models, num_threads,
+        [&](size_t begin, size_t count, int64_t* out) {
+          K keys[kPredictBlockSize];
+          data_.copy_keys(begin, count, keys);
+          predict_clamped(root_model_, keys, count, 0,
+                          num_second_level_models - 1, out);
+        });
+
+    second_level_models_.resize(num_second_level_models);
+    second_level_error_bounds_.resize(num_second_level_models);
+    parallel_for(num_second_level_models, num_threads, kModelsPerBuildTask,
+                 [&](size_t first_model, size_t last_model) {
+      for (size_t i = first_model; i < last_model; i++) {
+        int64_t start_pos = i == 0 ? 0 : segment_ends[i - 1];
+        int64_t end_pos = segment_ends[i];  // exclusive
+        WLinearModel<K, V> model;
+        model.train([&](auto&& add) {
+          for (int64_t pos = start_pos; pos < end_pos; pos++) {
+            add(data_.key(pos), pos, weights_[pos]);
+          }
+        });
+        second_level_models_[i] = model;
+
+        // Compute error bound. Errors are measured against the clamped
+        // prediction, which is what get_value searches around.
+        ErrorBoundTracker error_tracker;
+        K keys[kPredictBlockSize];
+        int64_t predicted_pos[kPredictBlockSize];
+        for (int64_t block = start_pos; block < end_pos;
+             block += kPredictBlockSize) {
+          size_t count = std::min<int64_t>(kPredictBlockSize, end_pos - block);
+          data_.copy_keys(block, count, keys);
+          predict_clamped(model, keys, count, 0, data_.size() - 1,
+                          predicted_pos);
+          for (size_t j = 0; j < count; j++) {
+            error_tracker.add(block + j - predicted_pos[j]);
+          }
+        }
+        second_level_error_bounds_[i] = error_tracker.finish();
       }
+    });
+
+    // Lookups only need the keys and payloads.
+    weights_ = Span<double>();
+    sorted_weights_ = std::vector<double>();
+    return true;
   }
 
   // If the key exists, return a pointer to the corresponding value in data_.
   // If the key does not exist, return a nullptr.
   V* get_value(K key) {
     assert(second_level_models_.size() > 0);
-    int root_model_output = root_model_.predict(key);
+    int64_t root_model_output = root_model_.predict(key);
 
     // Use the root model's output to select a second-level model, then use
     // the second-level model to predict the key's position, then do a
@@ -108,66 +151,134 @@ class WLearnedIndex {
     // NOTE: to receive full credit, the last-mile search should use the
     // `last_mile_search` method provided below.
       
-    int num_second_level_models = second_level_models_.size();
-    int second_level_index = std::max<int>(root_model_output, 0);
-    second_level_index = std::min<int>(second_level_index, num_second_level_models - 1);
+    int64_t num_second_level_models = second_level_models_.size();
+    int64_t second_level_index = std::max<int64_t>(root_model_output, 0);
+    second_level_index = std::min<int64_t>(second_level_index, num_second_level_models - 1);
     
-    int data_size = data_.size();
-    int predicted_index = second_level_models_[second_level_index].predict(key);
-    predicted_index = std::max<int>(predicted_index, 0);
-    predicted_index = std::min<int>(predicted_index, data_size - 1);
+    int64_t data_size = data_.size();
+    int64_t predicted_index = second_level_models_[second_level_index].predict(key);
+    predicted_index = std::max<int64_t>(predicted_index, 0);
+    predicted_index = std::min<int64_t>(predicted_index, data_size - 1);
 
-    if (std::get<0>(data_[predicted_index]) == key) {
-      return &std::get<1>(data_[predicted_index]);
+    if (data_.key(predicted_index) == key) {
+      return data_.value(predicted_index);
     } else {
-      last_mile_search_count_ = last_mile_search_count_ + 1;
+      last_mile_search_count_.add(1);
     }
       
-    int error_bound = second_level_error_bounds_[second_level_index];
-    int start_search = predicted_index - error_bound;
-    int end_search = predicted_index + error_bound;
+    const ErrorBound& error_bound = second_level_error_bounds_[second_level_index];
+    int64_t start_search = predicted_index + error_bound.min_error;
+    int64_t end_search = predicted_index + error_bound.max_error + 1;
     //clip
-    start_search = std::max<int>(start_search, 0);
-    end_search = std::max<int>(end_search, 0);
-    start_search = std::min<int>(start_search, data_size);
-    end_search = std::min<int>(end_search, data_size);
+    start_search = std::max<int64_t>(start_search, 0);
+    end_search = std::max<int64_t>(end_search, 0);
+    start_search = std::min<int64_t>(start_search, data_size);
+    end_search = std::min<int64_t>(end_search, data_size);
       
-    int pos = last_mile_search(key, start_search, end_search);
+    int64_t pos = last_mile_search(key, predicted_index, start_search,
+                                   end_search, error_bound.strategy);
     if (pos == -1) {
         return nullptr;
     }
-    return &std::get<1>(data_[pos]);
+    return data_.value(pos);
   }
 
-  int get_last_mile_search_count() {
-    return last_mile_search_count_;
+  // Return the position of the first record whose key is not less than
+  // `key`, or the number of records if there is none. Unlike get_value this
+  // also holds for keys that are not in the data, including keys outside the
+  // trained key range (see range_scan.h).
+  size_t lower_bound(K key) const {
+    assert(second_level_models_.size() > 0);
+    int64_t num_second_level_models = second_level_models_.size();
+    int64_t second_level_index = std::min<int64_t>(
+        std::max<int64_t>(root_model_.predict(key), 0),
+        num_second_level_models - 1);
+    int64_t data_size = data_.size();
+    int64_t predicted_index = std::min<int64_t>(
+        std::max<int64_t>(second_level_models_[second_level_index].predict(key),
+                          0),
+        data_size - 1);
+    const ErrorBound& error_bound = second_level_error_bounds_[second_level_index];
+    int64_t start_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.min_error, 0), data_size);
+    int64_t end_search = std::min<int64_t>(
+        std::max<int64_t>(predicted_index + error_bound.max_error + 1, 0),
+        data_size);
+    return window_lower_bound(data_, key, predicted_index, start_search,
+                              end_search, error_bound.strategy);
+  }
+
+  // The records whose keys lie in [lo, hi), in key order.
+  RecordRange<Storage> range(K lo, K hi) const {
+    return RecordRange<Storage>::until(data_, lower_bound(lo), hi);
+  }
+
+  // Call fn(key, value) for every record whose key lies in [lo, hi), in key
+  // order, and return the number of records visited.
+  template <class Fn>
+  size_t scan(K lo, K hi, Fn fn) const {
+    RecordRange<Storage> records = range(lo, hi);
+    records.for_each(fn);
+    return records.size();
+  }
+
+  int64_t get_last_mile_search_count() {
+    return last_mile_search_count_.load();
   }
 
   void reset_last_mile_search_count() {
-    last_mile_search_count_ = 0;
+    last_mile_search_count_.reset();
   }
 
  private:
-  // Do a binary search for the position of a key in the data.
+  // Number of second-level models a build worker trains per task.
+  static constexpr size_t kModelsPerBuildTask = 64;
+
+  void init(std::vector<record> data) {
+    std::sort(data.begin(), data.end());
+    std::vector<std::pair<K, V>> pairs(data.size());
+    sorted_weights_.resize(data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+      pairs[i] = {std::get<0>(data[i]), std::get<1>(data[i])};
+      sorted_weights_[i] = std::get<2>(data[i]);
+    }
+    data = std::vector<record>();
+    data_ = Storage(std::move(pairs));
+    weights_ = sorted_weights_;
+  }
+
+  // Search for the position of a key in the data, either with a binary search
+  // or by galloping outward from the predicted position (see
+  // last_mile_search.h).
   // Only search in the range between the given start position (inclusive)
   // and end position (exclusive).
   // If the key is not found in the data, return -1.
-  int last_mile_search(K key, int start_pos, int end_pos) const {
-    int pos = std::lower_bound(
-                  data_.begin() + start_pos, data_.begin() + end_pos, key,
-                  [](auto const& tuple, K key) { return std::get<0>(tuple) < key; }) -
-              data_.begin();
-    if (pos > static_cast<int>(data_.size()) || std::get<0>(data_[pos]) != key) {
+  int64_t last_mile_search(K key, int64_t predicted_pos, int64_t start_pos,
+                           int64_t end_pos, SearchStrategy strategy) const {
+    int64_t pos;
+    if (strategy == SearchStrategy::kExponential && start_pos < end_pos) {
+      predicted_pos = std::min(std::max(predicted_pos, start_pos), end_pos - 1);
+      pos = exponential_search(data_, key, predicted_pos, start_pos, end_pos);
+    } else {
+      pos = data_.lower_bound(key, start_pos, end_pos);
+    }
+    if (pos >= static_cast<int64_t>(data_.size()) || data_.key(pos) != key) {
       return -1;
     } else {
       return pos;
     }
   }
 
-  std::vector<record> data_;
+  Storage data_;
+  // Training weight of each record, in the same (sorted) order as data_,
+  // until build(). It views the caller's weights, or sorted_weights_ if the
+  // records had to be sorted.
+  Span<double> weights_;
+  std::vector<double> sorted_weights_;
   WLinearModel<K, V> root_model_;
   std::vector<WLinearModel<K, V>> second_level_models_;
-  // The maximum prediction error for each second-level model.
-  std::vector<int> second_level_error_bounds_;
-  int last_mile_search_count_;
+  // The signed prediction error range and last-mile search strategy for each
+  // second-level model.
+  std::vector<ErrorBound> second_level_error_bounds_;
+  ShardedCounter last_mile_search_count_;
 };
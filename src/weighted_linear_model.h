@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
 #include <vector>
 #include <numeric>
 #include <cmath>
@@ -25,30 +28,38 @@ class WLinearModel {
   // of scalar model inputs, and `positions` is the vector of the corresponding
   // desired model outputs (e.g., for input `keys[0]`, the desired output is
   // `positions[0]`).
-  void train(const std::vector<K>& keys, const std::vector<int>& positions,
+  void train(const std::vector<K>& keys, const std::vector<int64_t>& positions,
              const std::vector<double>& workloads) {
     assert(keys.size() == positions.size());
     assert(keys.size() == workloads.size());
-      
-    double n = keys.size(); // number elements
-    double tot_workload = std::accumulate(workloads.begin(), workloads.end(), 0.0);
-    /*
-    std::vector<double> weights;
-    for (int i = 0; i < n; i++) {
-        weights.push_back(workloads[i]);
-    }
-    */
-    
+    train([&](auto&& add) {
+      for (size_t i = 0; i < keys.size(); i++) {
+        add(keys[i], positions[i], workloads[i]);
+      }
+    });
+  }
+
+  // Train the model on points streamed by `for_each_point`, which must call
+  // add(key, position, weight) once per training point. The weighted fit
+  // makes two passes, so `for_each_point` is invoked twice and must produce
+  // the same points both times.
+  template <class PointSource>
+  void train(const PointSource& for_each_point) {
+    double n = 0; // number elements
+    double tot_workload = 0;
+
     // keys to search for in the index (x)
     // positions to retrieve (y)
       
     double x_mean = 0;
     double y_mean = 0;
-      
-    for (int i = 0; i < n; i++) {
-        x_mean += workloads[i] * keys[i];
-        y_mean += workloads[i] * positions[i];
-    }
+
+    for_each_point([&](K key, int64_t position, double weight) {
+        n += 1;
+        tot_workload += weight;
+        x_mean += weight * key;
+        y_mean += weight * position;
+    });
       
     x_mean = x_mean / tot_workload;
     y_mean = y_mean / tot_workload;
@@ -61,11 +72,11 @@ class WLinearModel {
       
     double numerator = 0;
     double denominator = 0;
-      
-    for (int i = 0; i < n; i++) {
-        numerator += workloads[i] * (keys[i] - x_mean) * (positions[i] - y_mean);
-        denominator += workloads[i] * pow(keys[i] - x_mean, 2);
-    }
+
+    for_each_point([&](K key, int64_t position, double weight) {
+        numerator += weight * (key - x_mean) * (position - y_mean);
+        denominator += weight * pow(key - x_mean, 2);
+    });
 
     if (denominator == 0) {
         m_ = 0;
@@ -78,11 +89,13 @@ class WLinearModel {
       
   }
 
-  int predict(K key) const {
-    return static_cast<int>(m_ * static_cast<double>(key) + b_);
+  // Evaluated as a fused multiply-add, the same rounding as the batched
+  // kernels in simd_predict.h.
+  int64_t predict(K key) const {
+    return static_cast<int64_t>(std::fma(m_, static_cast<double>(key), b_));
   }
 
-  K inverse_predict(int position) const {
+  K inverse_predict(int64_t position) const {
     return static_cast<K>((static_cast<double>(position) - b_) / m_);
   }
 
@@ -91,7 +104,15 @@ class WLinearModel {
     b_ *= scaling_factor;
   }
 
- private:
-  double x_ = 0;  // slope
-  double y_ = 0;  // intercept
+  // Parameters as stored by RecursiveModelIndex::save (see rmi_models.h).
+  static constexpr uint32_t kModelId = 2;
+  static constexpr size_t kNumParameters = 2;
+  void store(double* parameters) const {
+    parameters[0] = m_;
+    parameters[1] = b_;
+  }
+  void restore(const double* parameters) {
+    m_ = parameters[0];
+    b_ = parameters[1];
+  }
 };